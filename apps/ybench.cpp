@@ -0,0 +1,255 @@
+//
+// LICENSE:
+//
+// Copyright (c) 2016 -- 2017 Fabio Pellacini
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+
+// Reproducible benchmark suite. Runs a fixed matrix of benchmarks on
+// procedural test scenes -- BVH builds, tracing per shader, OBJ io,
+// Catmull-Clark subdivision and image operations -- with warmup and
+// repetition statistics, writes the results as JSON, and optionally
+// compares them against a baseline file, failing when a benchmark
+// regresses past a threshold. Baselines are per machine: regenerate with
+// --output on the host that will run the comparison.
+
+#include "../yocto/yocto_gl.h"
+using namespace ygl;
+
+#include "../yocto/ext/json.hpp"
+using json = nlohmann::json;
+
+#include <cstdio>
+#include <fstream>
+
+// Per-benchmark repetition statistics, in milliseconds.
+struct bench_result {
+    string name;
+    int reps = 0;
+    double min_ms = 0, mean_ms = 0, max_ms = 0;
+};
+
+// Runs func warmup + reps times and records per-repetition statistics.
+// The minimum is what baselines compare, being the least noisy.
+template <typename Func>
+bench_result run_benchmark(
+    const string& name, int warmup, int reps, const Func& func) {
+    for (auto i = 0; i < warmup; i++) func();
+    auto res = bench_result();
+    res.name = name;
+    res.reps = reps;
+    res.min_ms = flt_max;
+    for (auto i = 0; i < reps; i++) {
+        auto t = timer(true);
+        func();
+        auto ms = t.elapsed() * 1000;
+        res.min_ms = std::min(res.min_ms, ms);
+        res.max_ms = std::max(res.max_ms, ms);
+        res.mean_ms += ms / reps;
+    }
+    printf("%-28s %10.3f ms  (mean %10.3f, max %10.3f, %d reps)\n",
+        name.c_str(), res.min_ms, res.mean_ms, res.max_ms, reps);
+    fflush(stdout);
+    return res;
+}
+
+int main(int argc, char** argv) {
+    // command line params
+    using namespace string_literals;
+    auto parser = make_parser(argc, argv, "ybench", "runs benchmarks");
+    auto warmup = parse_opt(parser, "--warmup", "-w", "warmup runs", 1);
+    auto reps = parse_opt(parser, "--reps", "-r", "timed repetitions", 5);
+    auto threshold = parse_opt(parser, "--threshold", "-t",
+        "max slowdown over the baseline before failing", 0.25f);
+    auto baseline = parse_opt(
+        parser, "--baseline", "-b", "baseline json to compare against", ""s);
+    auto output =
+        parse_opt(parser, "--output", "-o", "output json filename", ""s);
+    auto scratch = parse_opt(
+        parser, "--scratch", "-s", "directory for io benchmark files", "."s);
+    if (should_exit(parser)) {
+        printf("%s\n", get_usage(parser).c_str());
+        exit(1);
+    }
+
+    auto results = vector<bench_result>();
+
+    // bvh builds on a dense mesh and on a heavily instanced scene
+    {
+        auto shp = new shape();
+        tie(shp->triangles, shp->pos, shp->norm) = make_geodesicsphere(8);
+        results += run_benchmark("bvh_build_shape", warmup, reps, [shp]() {
+            if (shp->bvh) delete shp->bvh;
+            shp->bvh = nullptr;
+            build_bvh(shp);
+        });
+        results +=
+            run_benchmark("bvh_build_shape_parallel", warmup, reps, [shp]() {
+                if (shp->bvh) delete shp->bvh;
+                shp->bvh = nullptr;
+                build_bvh_parallel(shp);
+            });
+        delete shp;
+    }
+    {
+        auto scn = make_test_scene(test_scene_type::instancel_pl);
+        add_elements(scn, add_elements_options());
+        results += run_benchmark("bvh_build_scene", warmup, reps, [scn]() {
+            for (auto shp : scn->shapes) {
+                if (shp->bvh) delete shp->bvh;
+                shp->bvh = nullptr;
+            }
+            if (scn->bvh) delete scn->bvh;
+            scn->bvh = nullptr;
+            build_bvh(scn);
+        });
+        delete scn;
+    }
+
+    // tracing per shader on the textured area-light scene
+    {
+        auto scn = make_test_scene(test_scene_type::simple_al);
+        add_elements(scn, add_elements_options());
+        build_bvh(scn);
+        update_lights(scn, false);
+        for (auto& shader : trace_shader_names()) {
+            auto params = trace_params();
+            params.stype = shader.second;
+            params.height = 240;
+            params.width =
+                (int)round(scn->cameras[0]->aspect * params.height);
+            params.nsamples = 2;
+            auto img = image4f(params.width, params.height);
+            auto rngs = trace_rngs(params);
+            results += run_benchmark("trace_" + shader.first, warmup, reps,
+                [scn, &img, &rngs, &params]() {
+                    trace_samples(
+                        scn, img, 0, params.nsamples, rngs, params);
+                });
+        }
+        delete scn;
+    }
+
+    // obj io round trip
+    {
+        auto scn = make_test_scene(test_scene_type::simple_al);
+        add_elements(scn, add_elements_options());
+        auto filename = scratch + "/ybench_scratch.obj";
+        auto sopts = save_options();
+        sopts.save_textures = false;
+        results += run_benchmark(
+            "save_obj", warmup, reps, [scn, &filename, &sopts]() {
+                save_scene(filename, scn, sopts);
+            });
+        auto lopts = load_options();
+        lopts.load_textures = false;
+        results +=
+            run_benchmark("load_obj", warmup, reps, [&filename, &lopts]() {
+                delete load_scene(filename, lopts);
+            });
+        std::remove(filename.c_str());
+        std::remove((scratch + "/ybench_scratch.mtl").c_str());
+        delete scn;
+    }
+
+    // catmull-clark subdivision, topology cache plus application
+    {
+        auto shp = new shape();
+        tie(shp->quads, shp->pos, shp->norm, shp->texcoord) =
+            make_uvsphere(64, 64);
+        results +=
+            run_benchmark("subdivide_catmullclark", warmup, reps, [shp]() {
+                auto tess = shape();
+                auto cache = make_subdivision_cache(shp, 2, true);
+                subdivide_shape_cached(shp, &tess, cache);
+                delete cache;
+            });
+        delete shp;
+    }
+
+    // image operations at preview resolution
+    {
+        auto hdr = image4f(1920, 1080);
+        for (auto j = 0; j < hdr.height(); j++)
+            for (auto i = 0; i < hdr.width(); i++)
+                hdr[{i, j}] = {(float)i / hdr.width(),
+                    (float)j / hdr.height(),
+                    (float)(i + j) / (hdr.width() + hdr.height()), 1};
+        results += run_benchmark("tonemap_image", warmup, reps,
+            [&hdr]() { tonemap_image(hdr, 0, 2.2f, true); });
+        auto res_img = image4f(960, 540);
+        results += run_benchmark("resize_image", warmup, reps, [&]() {
+            resize_image(hdr, res_img, resize_filter::def);
+        });
+        results += run_benchmark("make_sunsky", warmup, reps,
+            []() { make_sunsky_image(512, pif / 4); });
+    }
+
+    // write results
+    auto js = json();
+    js["benchmarks"] = json::array();
+    for (auto& res : results) {
+        js["benchmarks"].push_back({{"name", res.name}, {"reps", res.reps},
+            {"min_ms", res.min_ms}, {"mean_ms", res.mean_ms},
+            {"max_ms", res.max_ms}});
+    }
+    if (!output.empty()) {
+        auto fs = std::ofstream(output);
+        if (!fs) log_fatal("unable to write output %s\n", output.c_str());
+        fs << js.dump(2) << "\n";
+    }
+
+    // compare against the baseline
+    if (!baseline.empty()) {
+        auto fs = std::ifstream(baseline);
+        if (!fs) log_fatal("unable to open baseline %s\n", baseline.c_str());
+        auto bjs = json();
+        fs >> bjs;
+        auto base = unordered_map<string, double>();
+        for (auto& bench : bjs.at("benchmarks"))
+            base[bench.at("name").get<string>()] =
+                bench.at("min_ms").get<double>();
+        auto failed = 0;
+        printf("\ncomparison against %s (threshold %.0f%%)\n",
+            baseline.c_str(), threshold * 100);
+        for (auto& res : results) {
+            if (base.find(res.name) == base.end()) {
+                printf("%-28s NEW\n", res.name.c_str());
+                continue;
+            }
+            auto ratio = res.min_ms / base.at(res.name);
+            auto ok = ratio <= 1 + threshold;
+            printf("%-28s %+7.1f%%  %s\n", res.name.c_str(),
+                (ratio - 1) * 100, (ok) ? "ok" : "REGRESSION");
+            if (!ok) failed++;
+        }
+        if (failed) {
+            printf("%d benchmark(s) regressed\n", failed);
+            return 1;
+        }
+    }
+
+    // done
+    return 0;
+}
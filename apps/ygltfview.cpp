@@ -65,6 +65,10 @@ struct shade_state {
     std::vector<ygl::vec3f> lights_pos;
     std::vector<ygl::vec3f> lights_ke;
     std::vector<ygl::gl_ltype> lights_ltype;
+
+    // per-frame skinning buffers, kept across frames to avoid
+    // reallocation
+    std::vector<ygl::vec3f> skinned_pos, skinned_norm;
 };
 
 //
@@ -400,13 +404,14 @@ inline void shade_mesh(const ygl::gltf_mesh* msh, const ygl::gltf_skin* sk,
                                                     vert_vbo.skin_weights, vert_vbo.skin_joints, skin_xforms.size(),
                                                     skin_xforms.data());
 #else
-            std::vector<ygl::vec3f> skinned_pos, skinned_norm;
-            // ygl::compute_skinning(shp->pos, shp->norm, shp->skin_weights,
-            //     shp->skin_joints, skin_xforms, skinned_pos, skinned_norm);
-            ygl::compute_matrix_skinning(shp->pos, shp->norm, shp->skin_weights,
-                shp->skin_joints, skin_xforms, skinned_pos, skinned_norm);
-            update_vertex_buffer(vbo.pos, skinned_pos);
-            update_vertex_buffer(vbo.norm, skinned_norm);
+            // ygl::compute_skinning_parallel(shp->pos, shp->norm,
+            //     shp->skin_weights, shp->skin_joints, skin_xforms,
+            //     st->skinned_pos, st->skinned_norm);
+            ygl::compute_matrix_skinning_parallel(shp->pos, shp->norm,
+                shp->skin_weights, shp->skin_joints, skin_xforms,
+                st->skinned_pos, st->skinned_norm);
+            update_vertex_buffer(vbo.pos, st->skinned_pos);
+            update_vertex_buffer(vbo.norm, st->skinned_norm);
 #endif
         } else if (!morph_weights.empty() && !shp->morph_targets.empty()) {
             std::vector<ygl::vec3f> morph_pos, morph_norm;
@@ -67,6 +67,7 @@ struct app_state {
 
     // interactive trace
     gl_texture trace_texture = {};
+    gl_texture_stream trace_stream = {};
     gl_stdimage_program gl_prog = {};
     int trace_blocks_per_update = 8;
     image4f trace_img;
@@ -78,6 +79,14 @@ struct app_state {
 
     // editing support
     void* selection = nullptr;
+    bvh_update_state bvh_state;
+
+#if YGL_STATS
+    // live ray throughput
+    uint64_t stat_last_rays = 0;
+    timer stat_timer;
+    float stat_mrays_per_sec = 0;
+#endif
 
     ~app_state() {
         if (trace_pool) delete trace_pool;
@@ -91,8 +100,8 @@ void draw(gl_window* win) {
     // begin frame
     gl_clear_buffers(app->background);
 
-    // update texture
-    update_texture(app->trace_texture, app->trace_img);
+    // update texture without stalling on the driver copy
+    update_texture_async(app->trace_texture, app->trace_stream, app->trace_img);
 
     // draw image
     auto window_size = get_window_size(win);
@@ -105,6 +114,25 @@ void draw(gl_window* win) {
     if (begin_widgets(win, "yitrace")) {
         draw_label_widget(win, "scene", app->filename);
         draw_label_widget(win, "sample", app->trace_cur_sample);
+#if YGL_STATS
+        {
+            // rays since the last frame, smoothed to keep the label stable
+            auto stats = get_render_stats();
+            auto rays = stats.rays + stats.shadow_rays;
+            auto elapsed = app->stat_timer.elapsed();
+            app->stat_timer.start();
+            if (elapsed > 0) {
+                auto rate =
+                    (float)((rays - app->stat_last_rays) / (elapsed * 1e6));
+                app->stat_mrays_per_sec =
+                    (app->stat_mrays_per_sec) ?
+                        app->stat_mrays_per_sec * 0.9f + rate * 0.1f :
+                        rate;
+            }
+            app->stat_last_rays = rays;
+            draw_label_widget(win, "mrays/s", app->stat_mrays_per_sec);
+        }
+#endif
         draw_value_widget(
             win, "samples", app->trace_params.nsamples, 1, 4096, 1);
         edited += draw_value_widget(
@@ -134,8 +162,15 @@ bool update(app_state* app) {
         app->trace_cur_sample = 0;
         app->trace_async_rendering = false;
 
-        // update BVH
-        if (app->update_bvh) refit_bvh(app->scn);
+        // update BVH incrementally for the edited selection; camera and
+        // material edits leave the trees alone
+        if (app->update_bvh) {
+            for (auto shp : app->scn->shapes)
+                if (shp == app->selection) mark_edited(&app->bvh_state, shp);
+            for (auto ist : app->scn->instances)
+                if (ist == app->selection) mark_edited(&app->bvh_state, ist);
+            update_bvh(app->scn, &app->bvh_state);
+        }
 
         // render preview
         auto pparams = app->trace_params;
@@ -147,7 +182,8 @@ bool update(app_state* app) {
         auto prngs = trace_rngs(pparams);
         trace_samples(app->scn, app->preview_img, 0, 1, prngs, pparams);
         resize_image(app->preview_img, app->trace_img, resize_filter::box);
-        update_texture(app->trace_texture, app->trace_img);
+        update_texture_async(
+            app->trace_texture, app->trace_stream, app->trace_img);
 
         app->scene_updated = false;
     } else if (!app->trace_async_rendering) {
@@ -306,7 +342,7 @@ int main(int argc, char* argv[]) {
 
     // build bvh
     log_info("building bvh");
-    build_bvh(app->scn);
+    build_bvh_parallel(app->scn);
 
     // init renderer
     log_info("initializing tracer");
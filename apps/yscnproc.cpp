@@ -160,13 +160,25 @@ int main(int argc, char** argv) {
 
     if (tesselation) {
         for (auto shp : scn->shapes) {
-            for (auto l = 0; l < tesselation; l++) { subdivide_shape(shp); }
+            auto cache = unique_ptr<subdivision_cache>(
+                make_subdivision_cache(shp, tesselation));
+            if (cache) {
+                subdivide_shape_cached(shp, shp, cache.get());
+            } else {
+                for (auto l = 0; l < tesselation; l++) subdivide_shape(shp);
+            }
         }
     }
 
     if (subdiv) {
         for (auto shp : scn->shapes) {
-            for (auto l = 0; l < subdiv; l++) { subdivide_shape(shp, true); }
+            auto cache = unique_ptr<subdivision_cache>(
+                make_subdivision_cache(shp, subdiv, true));
+            if (cache) {
+                subdivide_shape_cached(shp, shp, cache.get());
+            } else {
+                for (auto l = 0; l < subdiv; l++) subdivide_shape(shp, true);
+            }
         }
     }
 
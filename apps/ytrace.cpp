@@ -29,6 +29,13 @@
 #include "../yocto/yocto_gl.h"
 using namespace ygl;
 
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 // Application state
 struct app_state {
     // scene data
@@ -50,17 +57,220 @@ struct app_state {
     int trace_block_size = 32;
     int trace_batch_size = 16;
 
+    // texture streaming
+    int texture_budget = 0;
+    texture_cache* tcache = nullptr;
+
     // rendered images and buffers
     image4f trace_img;
     image4f trace_acc;
     image4f trace_weight;
+    image4f trace_var;
     vector<rng_pcg32> trace_rngs;
 
+    // feature buffers for denoising
+    bool save_aovs = false;
+    trace_aovs aovs;
+
+    // checkpointing
+    string checkpoint;
+
+    // incremental image output
+    bool incremental = false;
+    incremental_image_writer* iwriter = nullptr;
+
+    // distributed rendering
+    int worker_port = 0;
+    vector<string> workers;
+
     ~app_state() {
+        if (iwriter) delete iwriter;
+        if (tcache) delete tcache;
         if (scn) delete scn;
     }
 };
 
+// Distributed tile rendering over TCP. Workers are launched with
+// --worker PORT and the same scene and render flags as the coordinator,
+// which connects with --distribute host:port,... and hands out whole
+// tiles from trace_blocks(). Each tile carries its full sample range, so
+// the per-pixel rngs make the distributed image bit-identical to a local
+// render no matter which worker traces it. Tiles held by a worker that
+// dies are reassigned; tiles left when all workers are gone are rendered
+// locally by the coordinator.
+#ifndef _WIN32
+
+// Reads exactly len bytes; false on a closed or failed socket.
+bool sock_read(int fd, void* data, size_t len) {
+    auto ptr = (char*)data;
+    while (len) {
+        auto n = recv(fd, ptr, len, 0);
+        if (n <= 0) return false;
+        ptr += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Writes exactly len bytes; false on a closed or failed socket.
+bool sock_write(int fd, const void* data, size_t len) {
+    auto ptr = (const char*)data;
+    while (len) {
+        auto n = send(fd, ptr, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        ptr += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Serves tile requests until the coordinator disconnects.
+void run_worker(app_state* app) {
+    auto lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0) log_fatal("cannot open socket");
+    auto reuse = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    auto addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons((uint16_t)app->worker_port);
+    if (bind(lfd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(lfd, 1) < 0)
+        log_fatal("cannot listen on port {}", app->worker_port);
+    log_info("worker listening on port {}", app->worker_port);
+    auto fd = accept(lfd, nullptr, nullptr);
+    if (fd < 0) log_fatal("accept failed");
+    auto& params = app->trace_params;
+    while (true) {
+        int req[4];
+        if (!sock_read(fd, req, sizeof(req))) break;
+        if (req[0] < 0) break;
+        auto tile_min = vec2i{req[0], req[1]},
+             tile_max = vec2i{req[2], req[3]};
+        log_info("rendering tile {} {} - {} {}", tile_min.x, tile_min.y,
+            tile_max.x, tile_max.y);
+        // subdivide the tile so all cores help with it
+        auto blocks = vector<pair<vec2i, vec2i>>();
+        for (auto j = tile_min.y; j < tile_max.y; j += params.block_size)
+            for (auto i = tile_min.x; i < tile_max.x; i += params.block_size)
+                blocks.push_back(
+                    {{i, j}, {min(i + params.block_size, tile_max.x),
+                                 min(j + params.block_size, tile_max.y)}});
+        if (params.parallel) {
+            parallel_for((int)blocks.size(), [app, &blocks, &params](int idx) {
+                trace_block(app->scn, app->trace_img, blocks[idx].first,
+                    blocks[idx].second, 0, params.nsamples, app->trace_rngs,
+                    params);
+            });
+        } else {
+            for (auto& block : blocks)
+                trace_block(app->scn, app->trace_img, block.first,
+                    block.second, 0, params.nsamples, app->trace_rngs, params);
+        }
+        // stream the accumulated tile back, row by row
+        auto ok = sock_write(fd, req, sizeof(req));
+        for (auto j = tile_min.y; j < tile_max.y && ok; j++)
+            ok = sock_write(fd, &app->trace_img.at(tile_min.x, j),
+                (tile_max.x - tile_min.x) * sizeof(vec4f));
+        if (!ok) break;
+    }
+    close(fd);
+    close(lfd);
+    log_info("coordinator disconnected");
+}
+
+// Connects to a worker given as host:port; -1 on failure.
+int connect_worker(const string& host) {
+    auto sep = host.find(':');
+    if (sep == string::npos) return -1;
+    auto hints = addrinfo();
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    auto res = (addrinfo*)nullptr;
+    if (getaddrinfo(host.substr(0, sep).c_str(),
+            host.substr(sep + 1).c_str(), &hints, &res))
+        return -1;
+    auto fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Assigns tiles to the workers and collects the results.
+void run_coordinator(app_state* app) {
+    auto& params = app->trace_params;
+    // hand out tiles a few blocks wide, so workers can spread each one
+    // over their own cores
+    auto tparams = params;
+    tparams.block_size = params.block_size * 4;
+    auto blocks = trace_blocks(tparams);
+    std::mutex qlock;
+    std::deque<pair<vec2i, vec2i>> queue(blocks.begin(), blocks.end());
+    auto threads = vector<std::thread>();
+    for (auto& host : app->workers) {
+        threads.push_back(std::thread([app, &qlock, &queue, &host]() {
+            auto fd = connect_worker(host);
+            if (fd < 0) {
+                log_error("cannot connect to worker {}", host);
+                return;
+            }
+            while (true) {
+                auto tile = pair<vec2i, vec2i>();
+                {
+                    std::unique_lock<std::mutex> lock(qlock);
+                    if (queue.empty()) break;
+                    tile = queue.front();
+                    queue.pop_front();
+                }
+                int req[4] = {tile.first.x, tile.first.y, tile.second.x,
+                    tile.second.y};
+                int resp[4];
+                auto ok = sock_write(fd, req, sizeof(req)) &&
+                          sock_read(fd, resp, sizeof(resp));
+                for (auto j = tile.first.y; j < tile.second.y && ok; j++)
+                    ok = sock_read(fd, &app->trace_img.at(tile.first.x, j),
+                        (tile.second.x - tile.first.x) * sizeof(vec4f));
+                if (ok)
+                    update_incremental_writer(app->iwriter, app->trace_img,
+                        tile.first, tile.second - tile.first);
+                if (!ok) {
+                    log_error("worker {} lost, reassigning tile", host);
+                    std::unique_lock<std::mutex> lock(qlock);
+                    queue.push_back(tile);
+                    break;
+                }
+            }
+            int bye[4] = {-1, -1, -1, -1};
+            sock_write(fd, bye, sizeof(bye));
+            close(fd);
+        }));
+    }
+    for (auto& t : threads) t.join();
+    // render anything the lost workers left behind
+    if (!queue.empty()) {
+        log_info("rendering {} leftover tiles locally", (int)queue.size());
+        for (auto& tile : queue) {
+            trace_block(app->scn, app->trace_img, tile.first, tile.second, 0,
+                params.nsamples, app->trace_rngs, params);
+            update_incremental_writer(app->iwriter, app->trace_img, tile.first,
+                tile.second - tile.first);
+        }
+    }
+}
+
+#else
+
+void run_worker(app_state* app) {
+    log_fatal("distributed rendering is not supported on this platform");
+}
+void run_coordinator(app_state* app) {
+    log_fatal("distributed rendering is not supported on this platform");
+}
+
+#endif
+
 int main(int argc, char* argv[]) {
     // create empty scene
     auto app = new app_state();
@@ -87,6 +297,28 @@ int main(int argc, char* argv[]) {
         parse_opt(parser, "--batch-size", "", "batch size", 16);
     app->trace_params.nsamples =
         parse_opt(parser, "--samples", "-s", "image samples", 256);
+    app->trace_params.adaptive =
+        parse_flag(parser, "--adaptive", "", "adaptive sampling");
+    app->trace_params.wavefront =
+        parse_flag(parser, "--wavefront", "", "wavefront path tracing");
+    app->texture_budget = parse_opt(parser, "--texture-budget", "",
+        "streaming texture budget in MB (0 loads eagerly)", 0);
+    app->save_aovs = parse_flag(parser, "--aovs", "",
+        "save albedo, normal, depth and id buffers (box filter only)");
+    app->checkpoint = parse_opt(parser, "--checkpoint", "",
+        "checkpoint file, saved every batch and resumed from when present "
+        "(box filter only)",
+        ""s);
+    app->incremental = parse_flag(parser, "--incremental", "",
+        "keep the output exr open and update it in place as the render "
+        "progresses (exr output only)");
+    app->worker_port = parse_opt(parser, "--worker", "",
+        "serve tiles to a distributed coordinator on this port", 0);
+    auto workers = parse_opt(parser, "--distribute", "",
+        "comma-separated worker host:port list for distributed rendering "
+        "(box filter only)",
+        ""s);
+    if (workers != "") app->workers = split(workers, ',');
     app->trace_params.parallel =
         !parse_flag(parser, "--no-parallel", "", "so not run in parallel");
     app->exposure =
@@ -115,18 +347,35 @@ int main(int argc, char* argv[]) {
     // setting up rendering
     log_info("loading scene {}", app->filename);
     try {
-        app->scn = load_scene(app->filename);
+        auto load_opts = load_options();
+        if (app->texture_budget) load_opts.load_textures = false;
+        app->scn = load_scene(app->filename, load_opts);
     } catch (exception e) {
         log_fatal("cannot load scene {}", app->filename);
         return 1;
     }
     auto opts = add_elements_options();
     opts.pointline_radius = 0.001f;
+    if (app->texture_budget) opts.texture_data = false;
     add_elements(app->scn, opts);
+    if (app->texture_budget) {
+        app->tcache = make_texture_cache(app->scn,
+            path_dirname(app->filename), (size_t)app->texture_budget << 20);
+    }
 
-    // build bvh
-    log_info("building bvh");
-    build_bvh(app->scn);
+    // build bvh, warm starting from the cache when possible
+    auto bvh_cache = app->filename + ".ybvh";
+    if (load_bvh(app->scn, bvh_cache)) {
+        log_info("loaded bvh cache {}", bvh_cache);
+    } else {
+        log_info("building bvh");
+        if (app->trace_params.parallel) {
+            build_bvh_parallel(app->scn);
+        } else {
+            build_bvh(app->scn);
+        }
+        save_bvh(app->scn, bvh_cache);
+    }
 
     // init renderer
     log_info("initializing tracer");
@@ -142,11 +391,79 @@ int main(int argc, char* argv[]) {
     app->trace_img = image4f(width, height);
     app->trace_acc = image4f(width, height);
     app->trace_weight = image4f(width, height);
+    app->trace_var = image4f(width, height);
     app->trace_rngs = trace_rngs(app->trace_params);
+    if (app->save_aovs) {
+        app->aovs.albedo = image4f(width, height);
+        app->aovs.norm = image4f(width, height);
+        app->aovs.depth = image4f(width, height);
+        app->aovs.id = image4f(width, height);
+    }
+
+    // worker mode: serve tiles instead of rendering an image
+    if (app->worker_port) {
+        run_worker(app);
+        delete app;
+        return 0;
+    }
+
+    // incremental output: keep the exr open and update it in place,
+    // flushing dirty rows from a background thread
+    if (app->incremental) {
+        if (path_extension(app->imfilename) == ".exr")
+            app->iwriter =
+                make_incremental_writer(app->imfilename, width, height);
+        if (!app->iwriter)
+            log_error("cannot write incremental image {}", app->imfilename);
+    }
+
+    // distributed mode: assign tiles to the workers
+    if (!app->workers.empty()) {
+        log_info("starting distributed render on {} workers",
+            (int)app->workers.size());
+        run_coordinator(app);
+        log_info("rendering done");
+        if (app->iwriter) {
+            update_incremental_writer(app->iwriter, app->trace_img);
+            delete app->iwriter;  // final flush and close
+            app->iwriter = nullptr;
+            log_info("saved image {}", app->imfilename);
+        } else {
+            log_info("saving image {}", app->imfilename);
+            save_image(app->imfilename, app->trace_img, app->exposure,
+                app->gamma, app->filmic);
+        }
+        delete app;
+        return 0;
+    }
+
+    // resume from a previous checkpoint, warm starting like the bvh cache;
+    // guarded like the save below, since checkpoints carry no acc/weight/var
+    // buffers and resuming one into the filtered or adaptive loops would
+    // silently discard its samples
+    auto first_sample = 0;
+    if (app->checkpoint != "" && !app->trace_params.adaptive &&
+        app->trace_params.ftype == trace_filter_type::box) {
+        auto resumed =
+            (app->save_aovs) ?
+                load_trace_checkpoint(app->checkpoint, app->trace_img,
+                    app->aovs, app->trace_rngs, first_sample,
+                    app->trace_params) :
+                load_trace_checkpoint(app->checkpoint, app->trace_img,
+                    app->trace_rngs, first_sample, app->trace_params);
+        if (resumed) {
+            log_info("resuming checkpoint {} at sample {}", app->checkpoint,
+                first_sample);
+            if (app->iwriter)
+                update_incremental_writer(app->iwriter, app->trace_img);
+        }
+    }
 
     // render
     log_info("starting renderer");
-    for (auto cur_sample = 0; cur_sample < app->trace_params.nsamples;
+    auto render_timer = timer();
+    for (auto cur_sample = first_sample;
+         cur_sample < app->trace_params.nsamples;
          cur_sample += app->trace_batch_size) {
         if (app->trace_save_progressive && cur_sample) {
             auto imfilename = format("{}{}.{}{}",
@@ -158,11 +475,24 @@ int main(int argc, char* argv[]) {
         }
         log_info(
             "rendering sample {}/{}", cur_sample, app->trace_params.nsamples);
-        if (app->trace_params.ftype == trace_filter_type::box) {
-            trace_samples(app->scn, app->trace_img, cur_sample,
+        if (app->trace_params.adaptive) {
+            trace_adaptive_samples(app->scn, app->trace_img, app->trace_acc,
+                app->trace_var, cur_sample,
                 min(cur_sample + app->trace_batch_size,
                     app->trace_params.nsamples),
                 app->trace_rngs, app->trace_params);
+        } else if (app->trace_params.ftype == trace_filter_type::box) {
+            if (app->save_aovs) {
+                trace_samples(app->scn, app->trace_img, app->aovs, cur_sample,
+                    min(cur_sample + app->trace_batch_size,
+                        app->trace_params.nsamples),
+                    app->trace_rngs, app->trace_params);
+            } else {
+                trace_samples(app->scn, app->trace_img, cur_sample,
+                    min(cur_sample + app->trace_batch_size,
+                        app->trace_params.nsamples),
+                    app->trace_rngs, app->trace_params);
+            }
         } else {
             trace_filtered_samples(app->scn, app->trace_img, app->trace_acc,
                 app->trace_weight, cur_sample,
@@ -170,13 +500,88 @@ int main(int argc, char* argv[]) {
                     app->trace_params.nsamples),
                 app->trace_rngs, app->trace_params);
         }
+        if (app->tcache) trim_texture_cache(app->tcache);
+        if (app->checkpoint != "" && !app->trace_params.adaptive &&
+            app->trace_params.ftype == trace_filter_type::box) {
+            auto done_sample = min(cur_sample + app->trace_batch_size,
+                app->trace_params.nsamples);
+            auto saved = (app->save_aovs) ?
+                             save_trace_checkpoint(app->checkpoint,
+                                 app->trace_img, app->aovs, app->trace_rngs,
+                                 done_sample, app->trace_params) :
+                             save_trace_checkpoint(app->checkpoint,
+                                 app->trace_img, app->trace_rngs, done_sample,
+                                 app->trace_params);
+            if (!saved)
+                log_error("cannot save checkpoint {}", app->checkpoint);
+        }
+        if (app->iwriter)
+            update_incremental_writer(app->iwriter, app->trace_img);
     }
     log_info("rendering done");
 
+#if YGL_STATS
+    // print the hot-path counters gathered during the render
+    {
+        auto elapsed = render_timer.elapsed();
+        auto stats = get_render_stats();
+        auto per_thread = get_thread_render_stats();
+        printf("render statistics (%.2f s)\n", elapsed);
+        printf("  %-16s %14llu  (%.2f Mrays/s)\n", "rays",
+            (unsigned long long)stats.rays,
+            stats.rays / (elapsed * 1e6));
+        printf("  %-16s %14llu  (%.2f Mrays/s)\n", "shadow rays",
+            (unsigned long long)stats.shadow_rays,
+            stats.shadow_rays / (elapsed * 1e6));
+        printf("  %-16s %14llu  (%.1f per ray)\n", "bvh nodes",
+            (unsigned long long)stats.bvh_nodes,
+            stats.bvh_nodes /
+                (double)std::max(stats.rays + stats.shadow_rays, (uint64_t)1));
+        printf("  %-16s %14llu  (%.1f per ray)\n", "bvh leaf tests",
+            (unsigned long long)stats.bvh_leaf_tests,
+            stats.bvh_leaf_tests /
+                (double)std::max(stats.rays + stats.shadow_rays, (uint64_t)1));
+        printf("  %-16s %14llu\n", "texture fetches",
+            (unsigned long long)stats.texture_fetches);
+        printf("  %-16s %14llu  (%.2f Msamples/s)\n", "samples",
+            (unsigned long long)stats.samples,
+            stats.samples / (elapsed * 1e6));
+        for (auto tid = 0; tid < (int)per_thread.size(); tid++) {
+            if (!per_thread[tid].samples) continue;
+            printf("  thread %-9d %14llu  (%.2f Msamples/s)\n", tid,
+                (unsigned long long)per_thread[tid].samples,
+                per_thread[tid].samples / (elapsed * 1e6));
+        }
+    }
+#endif
+
     // save image
-    log_info("saving image {}", app->imfilename);
-    save_image(app->imfilename, app->trace_img, app->exposure, app->gamma,
-        app->filmic);
+    if (app->iwriter) {
+        update_incremental_writer(app->iwriter, app->trace_img);
+        delete app->iwriter;  // final flush and close
+        app->iwriter = nullptr;
+        log_info("saved image {}", app->imfilename);
+    } else {
+        log_info("saving image {}", app->imfilename);
+        save_image(app->imfilename, app->trace_img, app->exposure, app->gamma,
+            app->filmic);
+    }
+
+    // save feature buffers
+    if (app->save_aovs) {
+        auto aovname = [&app](const string& aov) {
+            return format("{}{}-{}.hdr", path_dirname(app->imfilename),
+                path_basename(app->imfilename), aov);
+        };
+        log_info("saving aovs {}", aovname("albedo"));
+        save_image4f(aovname("albedo"), app->aovs.albedo);
+        save_image4f(aovname("normal"), app->aovs.norm);
+        save_image4f(aovname("depth"), app->aovs.depth);
+        save_image4f(aovname("id"), app->aovs.id);
+    }
+
+    // the render completed; drop the checkpoint
+    if (app->checkpoint != "") remove(app->checkpoint.c_str());
 
     // cleanup
     delete app;
@@ -60,6 +60,11 @@ struct shade_state {
     unordered_map<texture*, gl_texture> txt;
     unordered_map<shape*, shape_vbo> vbo;
 
+    // batched drawing: per-shape instance transforms, packed as mat4
+    // columns, plus the cpu-side copy used to detect edits
+    unordered_map<shape*, gl_vertex_buffer> ist_xforms;
+    unordered_map<shape*, vector<mat4f>> ist_xforms_data;
+
     // lights
     vector<vec3f> lights_pos;
     vector<vec3f> lights_ke;
@@ -98,6 +103,7 @@ struct app_state {
     // shade
     bool wireframe = false, edges = false;
     bool alpha_cutout = true;
+    bool batch = true;
     shade_state* shstate = nullptr;
 
     // navigation
@@ -209,13 +215,18 @@ inline void update_shade_state(const scene* scn, shade_state* st) {
     }
 }
 
-// Draw a shape
+// Draw a shape, either with a single transform or hardware-instanced
+// over a buffer of per-instance transforms.
 inline void shade_shape(shape* shp, shade_state* st, const mat4f& xform,
-    bool highlighted, bool edges, bool wireframe, bool cutout) {
+    bool highlighted, bool edges, bool wireframe, bool cutout,
+    const gl_vertex_buffer& ist_xforms = {}, int ninstances = 0) {
     static auto default_material = material();
     default_material.kd = {0.2f, 0.2f, 0.2f};
 
-    begin_stdsurface_shape(st->prog, mat4f(xform));
+    if (ninstances)
+        set_stdsurface_instances(st->prog, ist_xforms);
+    else
+        begin_stdsurface_shape(st->prog, mat4f(xform));
 
     auto etype = gl_etype::triangle;
     if (!shp->lines.empty()) etype = gl_etype::line;
@@ -239,10 +250,17 @@ inline void shade_shape(shape* shp, shade_state* st, const mat4f& xform,
     set_stdsurface_vert(
         st->prog, vbo.pos, vbo.norm, vbo.texcoord, vbo.color, vbo.tangsp);
 
-    draw_elems(vbo.points);
-    draw_elems(vbo.lines);
-    draw_elems(vbo.triangles);
-    draw_elems(vbo.quads);
+    if (ninstances) {
+        draw_elems_instanced(vbo.points, ninstances);
+        draw_elems_instanced(vbo.lines, ninstances);
+        draw_elems_instanced(vbo.triangles, ninstances);
+        draw_elems_instanced(vbo.quads, ninstances);
+    } else {
+        draw_elems(vbo.points);
+        draw_elems(vbo.lines);
+        draw_elems(vbo.triangles);
+        draw_elems(vbo.quads);
+    }
 
     if (edges && !wireframe) {
         assert(gl_check_error());
@@ -253,12 +271,16 @@ inline void shade_shape(shape* shp, shade_state* st, const mat4f& xform,
         assert(gl_check_error());
         gl_line_width(2);
         gl_enable_edges(true);
-        draw_elems(vbo.edges);
+        if (ninstances)
+            draw_elems_instanced(vbo.edges, ninstances);
+        else
+            draw_elems(vbo.edges);
         gl_enable_edges(false);
         gl_line_width(1);
         assert(gl_check_error());
     }
 
+    if (ninstances) set_stdsurface_instances_off(st->prog);
     end_stdsurface_shape(st->prog);
 }
 
@@ -266,7 +288,7 @@ inline void shade_shape(shape* shp, shade_state* st, const mat4f& xform,
 inline void shade_scene(const scene* scn, shade_state* st, const camera* cam,
     void* selection, const vec4f& background, float exposure, float gamma,
     bool filmic, bool wireframe, bool edges, bool cutout, bool camera_lights,
-    const vec3f& amb) {
+    const vec3f& amb, bool batch) {
     // update state
     update_shade_state(scn, st);
 
@@ -292,7 +314,43 @@ inline void shade_scene(const scene* scn, shade_state* st, const camera* cam,
             st->lights_ltype.data());
     }
 
-    if (!scn->instances.empty()) {
+    if (!scn->instances.empty() && batch) {
+        // group instances by shape; per-instance highlights cannot be
+        // expressed in a batch, so selected instances take the single
+        // path below
+        auto groups = unordered_map<shape*, vector<mat4f>>();
+        for (auto ist : scn->instances) {
+            if (ist == selection || ist->shp == selection) {
+                shade_shape(ist->shp, st, ist->xform(), true, edges, wireframe,
+                    cutout);
+                continue;
+            }
+            groups[ist->shp].push_back(ist->xform());
+        }
+
+        // submit groups in material order so shapes sharing a material
+        // bind their textures back to back
+        auto shapes = vector<shape*>();
+        for (auto& group : groups) shapes.push_back(group.first);
+        std::sort(shapes.begin(), shapes.end(),
+            [](shape* a, shape* b) { return a->mat < b->mat; });
+
+        for (auto shp : shapes) {
+            auto& xforms = groups.at(shp);
+            auto& buf = st->ist_xforms[shp];
+            auto& data = st->ist_xforms_data[shp];
+            if (!is_vertex_buffer_valid(buf) || data.size() < xforms.size()) {
+                if (is_vertex_buffer_valid(buf)) clear_vertex_buffer(buf);
+                buf = make_vertex_buffer(xforms, true);
+                data = xforms;
+            } else if (data != xforms) {
+                update_vertex_buffer(buf, xforms);
+                data = xforms;
+            }
+            shade_shape(shp, st, identity_mat4f, false, edges, wireframe,
+                cutout, buf, (int)xforms.size());
+        }
+    } else if (!scn->instances.empty()) {
         for (auto ist : scn->instances) {
             shade_shape(ist->shp, st, ist->xform(),
                 (ist == selection || ist->shp == selection), edges, wireframe,
@@ -322,7 +380,8 @@ inline void draw(gl_window* win) {
     gl_clear_buffers();
     shade_scene(app->scn, app->shstate, app->scam, app->selection,
         app->background, app->exposure, app->gamma, app->filmic, app->wireframe,
-        app->edges, app->alpha_cutout, app->camera_lights, app->amb);
+        app->edges, app->alpha_cutout, app->camera_lights, app->amb,
+        app->batch);
 
     if (begin_widgets(win, "yview")) {
         draw_label_widget(win, "scene", app->filename);
@@ -333,6 +392,8 @@ inline void draw(gl_window* win) {
         draw_continue_widget(win);
         draw_value_widget(win, "cutout", app->alpha_cutout);
         draw_continue_widget(win);
+        draw_value_widget(win, "batch", app->batch);
+        draw_continue_widget(win);
         draw_value_widget(win, "fps", app->navigation_fps);
         draw_tonemap_widgets(win, "", app->exposure, app->gamma, app->filmic);
         draw_scene_widgets(
@@ -86,6 +86,14 @@
 #include "ext/json.hpp"
 #endif
 
+// memory mapping for the fast obj parser
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #if YGL_OPENGL
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
@@ -98,6 +106,23 @@
 #include "ext/imgui/imgui_impl_glfw_gl3.h"
 #endif
 
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION FOR CONCURRENCY UTILITIES
+// -----------------------------------------------------------------------------
+namespace ygl {
+
+// Runs a chunked loop on the pool. Kept as the entry point for loops
+// that may run from inside one of the pool's own workers (e.g. shape
+// refinement triggered from inside the tracer); with the work-stealing
+// pool, workers waiting on a loop run queued tasks instead of blocking,
+// so nested dispatch is safe and this forwards directly.
+static void parallel_for_nested(
+    thread_pool* pool, int nchunks, const function<void(int)>& task) {
+    parallel_for(pool, nchunks, task);
+}
+
+}  // namespace ygl
+
 // -----------------------------------------------------------------------------
 // IMPLEMENTATION FOR PERLIN NOISE
 // -----------------------------------------------------------------------------
@@ -367,6 +392,14 @@ image4f load_image4f(const string& filename) {
     return image4f(w, h, (vec4f*)pixels.get());
 }
 
+// Loads an hdr image into half float storage. Decodes through floats and
+// narrows, since both tinyexr and stb expand to floats anyway.
+image4h load_image4h(const string& filename) {
+    auto img = load_image4f(filename);
+    if (!img) return {};
+    return float_to_half(img);
+}
+
 // Saves an ldr image.
 bool save_image4b(const string& filename, const image4b& img) {
     if (path_extension(filename) == ".png") {
@@ -393,6 +426,12 @@ bool save_image4f(const string& filename, const image4f& img) {
     }
 }
 
+// Saves an hdr image stored as half floats.
+bool save_image4h(const string& filename, const image4h& img) {
+    if (!img) return false;
+    return save_image4f(filename, half_to_float(img));
+}
+
 // Loads an image
 vector<float> load_imagef(
     const string& filename, int& width, int& height, int& ncomp) {
@@ -458,7 +497,198 @@ bool save_image(
     }
 }
 
-// Resize image.
+// Writes the header of an uncompressed float RGBA OpenEXR file and
+// returns the offset of the first scanline chunk.
+static size_t write_exr_header(FILE* f, int width, int height) {
+    auto write_int = [f](int32_t v) { fwrite(&v, 4, 1, f); };
+    auto write_str = [f](const char* s) { fwrite(s, 1, strlen(s) + 1, f); };
+    // magic and version
+    write_int(20000630);
+    write_int(2);
+    // channels, alphabetical as required, float pixel type
+    write_str("channels");
+    write_str("chlist");
+    write_int(4 * 18 + 1);
+    for (auto name : {"A", "B", "G", "R"}) {
+        write_str(name);
+        write_int(2);  // float
+        write_int(0);  // pLinear and reserved
+        write_int(1);  // x sampling
+        write_int(1);  // y sampling
+    }
+    fputc(0, f);
+    // compression: none, so scanline chunks have a fixed size
+    write_str("compression");
+    write_str("compression");
+    write_int(1);
+    fputc(0, f);
+    // data and display windows
+    for (auto name : {"dataWindow", "displayWindow"}) {
+        write_str(name);
+        write_str("box2i");
+        write_int(16);
+        write_int(0);
+        write_int(0);
+        write_int(width - 1);
+        write_int(height - 1);
+    }
+    // line order: increasing y
+    write_str("lineOrder");
+    write_str("lineOrder");
+    write_int(1);
+    fputc(0, f);
+    // pixel aspect ratio and screen window
+    auto one = 1.0f;
+    write_str("pixelAspectRatio");
+    write_str("float");
+    write_int(4);
+    fwrite(&one, 4, 1, f);
+    write_str("screenWindowCenter");
+    write_str("v2f");
+    write_int(8);
+    auto center = zero2f;
+    fwrite(&center, 8, 1, f);
+    write_str("screenWindowWidth");
+    write_str("float");
+    write_int(4);
+    fwrite(&one, 4, 1, f);
+    fputc(0, f);
+    // scanline offset table
+    auto data_offset = (size_t)ftell(f) + (size_t)height * 8;
+    auto chunk_size = (size_t)8 + (size_t)width * 16;
+    for (auto j = 0; j < height; j++) {
+        auto offset = (uint64_t)(data_offset + j * chunk_size);
+        fwrite(&offset, 8, 1, f);
+    }
+    return data_offset;
+}
+
+// Rewrites one scanline chunk in place.
+static void write_exr_scanline(FILE* f, size_t data_offset, int width, int j,
+    const vec4f* row, vector<float>& plane) {
+    auto chunk_size = (size_t)8 + (size_t)width * 16;
+    fseek(f, (long)(data_offset + j * chunk_size), SEEK_SET);
+    auto y = (int32_t)j;
+    fwrite(&y, 4, 1, f);
+    auto size = (int32_t)(width * 16);
+    fwrite(&size, 4, 1, f);
+    // channels are stored alphabetically: A, B, G, R
+    for (auto c : {3, 2, 1, 0}) {
+        for (auto i = 0; i < width; i++) plane[i] = (&row[i].x)[c];
+        fwrite(plane.data(), 4, width, f);
+    }
+}
+
+// Creates an incremental image writer. Public API, see above.
+incremental_image_writer* make_incremental_writer(
+    const string& filename, int width, int height) {
+    if (path_extension(filename) != ".exr") return nullptr;
+    auto f = fopen(filename.c_str(), "wb");
+    if (!f) return nullptr;
+    auto wrt = new incremental_image_writer();
+    wrt->filename = filename;
+    wrt->width = width;
+    wrt->height = height;
+    wrt->_file = f;
+    wrt->_img = image4f(width, height);
+    wrt->_dirty = vector<bool>(height, false);
+    wrt->_data_offset = write_exr_header(f, width, height);
+
+    // write an all-zero image so the file is complete from the start
+    auto zero = vector<vec4f>(width, zero4f);
+    auto plane = vector<float>(width);
+    for (auto j = 0; j < height; j++)
+        write_exr_scanline(f, wrt->_data_offset, width, j, zero.data(), plane);
+    fflush(f);
+
+    // writer thread: snapshots dirty rows under the lock, writes them
+    // with the lock released, then signals flush waiters
+    wrt->_thread = std::thread([wrt]() {
+        auto plane = vector<float>(wrt->width);
+        auto rows = vector<pair<int, vector<vec4f>>>();
+        auto lock = std::unique_lock<std::mutex>(wrt->_mutex);
+        while (true) {
+            wrt->_condition.wait(lock, [wrt]() {
+                return wrt->_stop || std::find(wrt->_dirty.begin(),
+                                         wrt->_dirty.end(),
+                                         true) != wrt->_dirty.end();
+            });
+            rows.clear();
+            for (auto j = 0; j < wrt->height; j++) {
+                if (!wrt->_dirty[j]) continue;
+                wrt->_dirty[j] = false;
+                rows.push_back({j, vector<vec4f>(wrt->_img.data() +
+                                                     (size_t)j * wrt->width,
+                                       wrt->_img.data() +
+                                           (size_t)(j + 1) * wrt->width)});
+            }
+            if (!rows.empty()) {
+                wrt->_writing = true;
+                lock.unlock();
+                for (auto& row : rows)
+                    write_exr_scanline(wrt->_file, wrt->_data_offset,
+                        wrt->width, row.first, row.second.data(), plane);
+                fflush(wrt->_file);
+                lock.lock();
+                wrt->_writing = false;
+                wrt->_condition.notify_all();
+            } else if (wrt->_stop) {
+                break;
+            }
+        }
+    });
+    return wrt;
+}
+
+// Hands a region of pixels to an incremental writer. Public API, see
+// above.
+void update_incremental_writer(incremental_image_writer* wrt,
+    const image4f& img, const vec2i& origin, const vec2i& size) {
+    if (!wrt) return;
+    auto sz = size;
+    if (sz.x < 0) sz.x = wrt->width - origin.x;
+    if (sz.y < 0) sz.y = wrt->height - origin.y;
+    sz.x = min(sz.x, wrt->width - origin.x);
+    sz.y = min(sz.y, wrt->height - origin.y);
+    if (sz.x <= 0 || sz.y <= 0) return;
+    {
+        std::lock_guard<std::mutex> lock(wrt->_mutex);
+        for (auto j = origin.y; j < origin.y + sz.y; j++) {
+            memcpy(wrt->_img.data() + (size_t)j * wrt->width + origin.x,
+                img.data() + (size_t)j * img.width() + origin.x,
+                sz.x * sizeof(vec4f));
+            wrt->_dirty[j] = true;
+        }
+    }
+    wrt->_condition.notify_all();
+}
+
+// Blocks until all dirty rows are on disk. Public API, see above.
+void flush_incremental_writer(incremental_image_writer* wrt) {
+    if (!wrt) return;
+    auto lock = std::unique_lock<std::mutex>(wrt->_mutex);
+    wrt->_condition.wait(lock, [wrt]() {
+        return !wrt->_writing &&
+               std::find(wrt->_dirty.begin(), wrt->_dirty.end(), true) ==
+                   wrt->_dirty.end();
+    });
+}
+
+// Final flush, stop the writer thread and close the file.
+incremental_image_writer::~incremental_image_writer() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _condition.notify_all();
+    if (_thread.joinable()) _thread.join();
+    if (_file) fclose(_file);
+}
+
+// Resize image. The output is split into scanline bands resized
+// concurrently on the pool; stbir's subpixel interface positions each
+// band in the full mapping, so the result is identical to a single
+// resize.
 void resize_image(const image4f& img, image4f& res_img, resize_filter filter,
     resize_edge edge, bool premultiplied_alpha) {
     static const auto filter_map = map<resize_filter, stbir_filter>{
@@ -476,15 +706,26 @@ void resize_image(const image4f& img, image4f& res_img, resize_filter filter,
             {resize_edge::wrap, STBIR_EDGE_WRAP},
             {resize_edge::zero, STBIR_EDGE_ZERO}};
 
-    stbir_resize_float_generic((float*)img.data(), img.width(), img.height(),
-        sizeof(vec4f) * img.width(), (float*)res_img.data(), res_img.width(),
-        res_img.height(), sizeof(vec4f) * res_img.width(), 4, 3,
-        (premultiplied_alpha) ? STBIR_FLAG_ALPHA_PREMULTIPLIED : 0,
-        edge_map.at(edge), filter_map.at(filter), STBIR_COLORSPACE_LINEAR,
-        nullptr);
-}
-
-// Resize image.
+    auto xs = (float)res_img.width() / img.width();
+    auto ys = (float)res_img.height() / img.height();
+    auto pool = get_global_pool();
+    auto nbands = min((int)pool->_threads.size(), res_img.height());
+    parallel_for_nested(pool, nbands, [&](int b) {
+        auto j0 = (int)(((int64_t)res_img.height() * b) / nbands);
+        auto j1 = (int)(((int64_t)res_img.height() * (b + 1)) / nbands);
+        stbir_resize_subpixel((float*)img.data(), img.width(), img.height(),
+            sizeof(vec4f) * img.width(),
+            (float*)(res_img.data() + (size_t)j0 * res_img.width()),
+            res_img.width(), j1 - j0, sizeof(vec4f) * res_img.width(),
+            STBIR_TYPE_FLOAT, 4, 3,
+            (premultiplied_alpha) ? STBIR_FLAG_ALPHA_PREMULTIPLIED : 0,
+            edge_map.at(edge), edge_map.at(edge), filter_map.at(filter),
+            filter_map.at(filter), STBIR_COLORSPACE_LINEAR, nullptr, xs, ys,
+            0.0f, (float)j0);
+    });
+}
+
+// Resize image, banded as above.
 void resize_image(const image4b& img, image4b& res_img, resize_filter filter,
     resize_edge edge, bool premultiplied_alpha) {
     static const auto filter_map = map<resize_filter, stbir_filter>{
@@ -502,13 +743,163 @@ void resize_image(const image4b& img, image4b& res_img, resize_filter filter,
             {resize_edge::wrap, STBIR_EDGE_WRAP},
             {resize_edge::zero, STBIR_EDGE_ZERO}};
 
-    stbir_resize_uint8_generic((unsigned char*)img.data(), img.width(),
-        img.height(), sizeof(vec4b) * img.width(),
-        (unsigned char*)res_img.data(), res_img.width(), res_img.height(),
-        sizeof(vec4b) * res_img.width(), 4, 3,
-        (premultiplied_alpha) ? STBIR_FLAG_ALPHA_PREMULTIPLIED : 0,
-        edge_map.at(edge), filter_map.at(filter), STBIR_COLORSPACE_LINEAR,
-        nullptr);
+    auto xs = (float)res_img.width() / img.width();
+    auto ys = (float)res_img.height() / img.height();
+    auto pool = get_global_pool();
+    auto nbands = min((int)pool->_threads.size(), res_img.height());
+    parallel_for_nested(pool, nbands, [&](int b) {
+        auto j0 = (int)(((int64_t)res_img.height() * b) / nbands);
+        auto j1 = (int)(((int64_t)res_img.height() * (b + 1)) / nbands);
+        stbir_resize_subpixel((unsigned char*)img.data(), img.width(),
+            img.height(), sizeof(vec4b) * img.width(),
+            (unsigned char*)(res_img.data() + (size_t)j0 * res_img.width()),
+            res_img.width(), j1 - j0, sizeof(vec4b) * res_img.width(),
+            STBIR_TYPE_UINT8, 4, 3,
+            (premultiplied_alpha) ? STBIR_FLAG_ALPHA_PREMULTIPLIED : 0,
+            edge_map.at(edge), edge_map.at(edge), filter_map.at(filter),
+            filter_map.at(filter), STBIR_COLORSPACE_LINEAR, nullptr, xs, ys,
+            0.0f, (float)j0);
+    });
+}
+
+#if YGL_SSE
+
+// log2 of four positive floats, with cephes-style polynomials on the
+// mantissa; relative error is a few float ulps, which is below the
+// quantization of the byte output this is used for.
+static inline __m128 log2_ps(__m128 x) {
+    // split into exponent and mantissa in [sqrt(2)/2, sqrt(2))
+    x = _mm_max_ps(x, _mm_set1_ps(1.17549435e-38f));
+    auto xi = _mm_castps_si128(x);
+    auto e = _mm_cvtepi32_ps(_mm_sub_epi32(
+        _mm_srli_epi32(xi, 23), _mm_set1_epi32(127)));
+    auto m = _mm_or_ps(
+        _mm_castsi128_ps(_mm_and_si128(xi, _mm_set1_epi32(0x007fffff))),
+        _mm_set1_ps(1.0f));
+    auto above = _mm_cmpge_ps(m, _mm_set1_ps(1.41421356237f));
+    auto halved = _mm_mul_ps(m, _mm_set1_ps(0.5f));
+    m = _mm_or_ps(_mm_and_ps(above, halved), _mm_andnot_ps(above, m));
+    e = _mm_add_ps(e, _mm_and_ps(above, _mm_set1_ps(1.0f)));
+    // ln(m) around 1
+    auto t = _mm_sub_ps(m, _mm_set1_ps(1.0f));
+    auto p = _mm_set1_ps(7.0376836292e-2f);
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-1.1514610310e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.1676998740e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-1.2420140846e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.4249322787e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-1.6668057665e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(2.0000714765e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-2.4999993993e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(3.3333331174e-1f));
+    auto t2 = _mm_mul_ps(t, t);
+    auto ln = _mm_mul_ps(_mm_mul_ps(p, t2), t);
+    ln = _mm_sub_ps(ln, _mm_mul_ps(t2, _mm_set1_ps(0.5f)));
+    ln = _mm_add_ps(ln, t);
+    // log2(x) = ln(m) / ln(2) + e
+    return _mm_add_ps(_mm_mul_ps(ln, _mm_set1_ps(1.44269504089f)), e);
+}
+
+// 2^x of four floats, split into an integer exponent and a polynomial
+// for the fraction.
+static inline __m128 exp2_ps(__m128 x) {
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.0f)), _mm_set1_ps(126.0f));
+    // round to nearest keeps the fraction in [-0.5, 0.5]
+    auto n = _mm_cvtepi32_ps(_mm_cvtps_epi32(x));
+    auto f = _mm_sub_ps(x, n);
+    // exp(f * ln(2))
+    auto z = _mm_mul_ps(f, _mm_set1_ps(0.693147180560f));
+    auto p = _mm_set1_ps(1.9875691500e-4f);
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.3981999507e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(8.3334519073e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(4.1665795894e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.6666665459e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(5.0000001201e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.0f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.0f));
+    // scale by 2^n through the exponent bits
+    auto pow2n = _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(p, pow2n);
+}
+
+// x^y for four non-negative bases; zero and negative bases map to zero.
+static inline __m128 pow_ps(__m128 x, __m128 y) {
+    auto r = exp2_ps(_mm_mul_ps(y, log2_ps(x)));
+    return _mm_and_ps(r, _mm_cmpgt_ps(x, _mm_setzero_ps()));
+}
+
+#endif
+
+// Tonemap a scanline range; the vectorized paths process the rgb
+// channels of one pixel per iteration and keep the alpha untouched.
+static void tonemap_scanlines(const image4f& hdr, image4b& ldr, int jmin,
+    int jmax, float scale, float gamma, bool filmic) {
+#if YGL_SSE
+    auto src = hdr.data() + (size_t)jmin * hdr.width();
+    auto dst = ldr.data() + (size_t)jmin * ldr.width();
+    auto npixels = (size_t)(jmax - jmin) * hdr.width();
+    auto rgb_mask = _mm_castsi128_ps(
+        _mm_setr_epi32(~0, ~0, ~0, 0));
+    for (auto i = (size_t)0; i < npixels; i++) {
+        auto h = _mm_loadu_ps(&src[i].x);
+        auto c = _mm_mul_ps(h, _mm_set1_ps(scale));
+        if (filmic) {
+            // fitted aces curve, as in tonemap_filmic()
+            auto x = _mm_mul_ps(c, _mm_set1_ps(2.05f));
+            auto num = _mm_mul_ps(x,
+                _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.51f)),
+                    _mm_set1_ps(0.03f)));
+            auto den = _mm_add_ps(
+                _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.43f)),
+                                  _mm_set1_ps(0.59f))),
+                _mm_set1_ps(0.14f));
+            auto y = _mm_div_ps(num, den);
+            y = _mm_min_ps(_mm_max_ps(y, _mm_setzero_ps()),
+                _mm_set1_ps(1.0f));
+            c = pow_ps(y, _mm_set1_ps(1 / 2.2f));
+        } else {
+            c = pow_ps(c, _mm_set1_ps(1 / gamma));
+        }
+        auto t = vec4f();
+        _mm_storeu_ps(&t.x,
+            _mm_or_ps(_mm_and_ps(rgb_mask, c), _mm_andnot_ps(rgb_mask, h)));
+        dst[i] = float_to_byte(t);
+    }
+#else
+    for (auto j = jmin; j < jmax; j++) {
+        for (auto i = 0; i < hdr.width(); i++) {
+            auto h = hdr[{i, j}];
+            h.xyz() *= scale;
+            if (filmic) {
+                h.xyz() = {tonemap_filmic(h.x), tonemap_filmic(h.y),
+                    tonemap_filmic(h.z)};
+            } else {
+                h.xyz() = {pow(h.x, 1 / gamma), pow(h.y, 1 / gamma),
+                    pow(h.z, 1 / gamma)};
+            }
+            ldr[{i, j}] = float_to_byte(h);
+        }
+    }
+#endif
+}
+
+// Tone mapping HDR to LDR images, over scanline ranges on the pool.
+image4b tonemap_image(
+    const image4f& hdr, float exposure, float gamma, bool filmic) {
+    auto ldr = image4b(hdr.width(), hdr.height());
+    auto scale = pow(2.0f, exposure);
+    auto pool = get_global_pool();
+    auto nchunks = min((int)pool->_threads.size() * 4, hdr.height());
+    if (nchunks < 2) {
+        tonemap_scanlines(hdr, ldr, 0, hdr.height(), scale, gamma, filmic);
+        return ldr;
+    }
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto jmin = (int)(((int64_t)hdr.height() * c) / nchunks);
+        auto jmax = (int)(((int64_t)hdr.height() * (c + 1)) / nchunks);
+        tonemap_scanlines(hdr, ldr, jmin, jmax, scale, gamma, filmic);
+    });
+    return ldr;
 }
 
 }  // namespace ygl
@@ -602,19 +993,28 @@ image4f make_sunsky_image(
                                                        zero3f;
     };
 
+    // scanline ranges are independent, so they run on the pool
     auto img = image4f(2 * res, res);
-    for (auto j = 0; j < img.height(); j++) {
-        if (!has_ground && j > img.height() / 2) continue;
-        auto theta = pif * ((j + 0.5f) / img.height());
-        theta = clamp(theta, 0.0f, pif / 2);
-        for (int i = 0; i < img.width(); i++) {
-            auto phi = 2 * pif * (float(i + 0.5f) / img.width());
-            auto w =
-                vec3f(cos(phi) * sin(theta), cos(theta), sin(phi) * sin(theta));
-            auto gamma = acos(clamp(dot(w, wSun), -1.0f, 1.0f));
-            img[{i, j}] = {sky(theta, gamma) + sun(theta, gamma), 1};
+    auto pool = get_global_pool();
+    auto nchunks = min((int)pool->_threads.size() * 4, img.height());
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto jmin = (int)(((int64_t)img.height() * c) / nchunks);
+        auto jmax = (int)(((int64_t)img.height() * (c + 1)) / nchunks);
+        for (auto j = jmin; j < jmax; j++) {
+            if (!has_ground && j > img.height() / 2) continue;
+            auto theta = pif * ((j + 0.5f) / img.height());
+            // stay below the horizon since the Perez formulas blow up at
+            // grazing angles where cos(theta) goes to zero
+            theta = clamp(theta, 0.0f, pif / 2 - 0.001f);
+            for (int i = 0; i < img.width(); i++) {
+                auto phi = 2 * pif * (float(i + 0.5f) / img.width());
+                auto w = vec3f(
+                    cos(phi) * sin(theta), cos(theta), sin(phi) * sin(theta));
+                auto gamma = acos(clamp(dot(w, wSun), -1.0f, 1.0f));
+                img[{i, j}] = {sky(theta, gamma) + sun(theta, gamma), 1};
+            }
         }
-    }
+    });
 
     return img;
 }
@@ -686,6 +1086,490 @@ image4b make_turbulence_image(int resx, int resy, float scale, float lacunarity,
 
 }  // namespace ygl
 
+#if YGL_STATS
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION FOR RENDER STATISTICS
+// -----------------------------------------------------------------------------
+namespace ygl {
+
+namespace _impl_stats {
+
+// Registry of the per-thread counter blocks. Threads only ever touch
+// their own block; the mutex guards the registry itself, taken on thread
+// creation and exit and when aggregating.
+struct stats_registry {
+    std::mutex mutex;
+    vector<render_stats*> blocks;
+    // counters inherited from exited threads
+    render_stats retired;
+};
+
+// The global registry.
+inline stats_registry& registry() {
+    static stats_registry reg;
+    return reg;
+}
+
+// Adds one counter block into another.
+inline void merge_stats(render_stats& into, const render_stats& from) {
+    into.rays += from.rays;
+    into.shadow_rays += from.shadow_rays;
+    into.bvh_nodes += from.bvh_nodes;
+    into.bvh_leaf_tests += from.bvh_leaf_tests;
+    into.texture_fetches += from.texture_fetches;
+    into.samples += from.samples;
+}
+
+// Per-thread block that registers itself on construction and folds its
+// counts into the retired total when the thread exits.
+struct thread_stats_block {
+    render_stats stats;
+
+    thread_stats_block() {
+        auto& reg = registry();
+        std::unique_lock<std::mutex> lock(reg.mutex);
+        reg.blocks.push_back(&stats);
+    }
+
+    ~thread_stats_block() {
+        auto& reg = registry();
+        std::unique_lock<std::mutex> lock(reg.mutex);
+        merge_stats(reg.retired, stats);
+        reg.blocks.erase(
+            std::find(reg.blocks.begin(), reg.blocks.end(), &stats));
+    }
+};
+
+}  // namespace _impl_stats
+
+// This thread's counter block. Public API, see above.
+render_stats& thread_render_stats() {
+    thread_local _impl_stats::thread_stats_block block;
+    return block.stats;
+}
+
+// Sum of the counters over all threads. Public API, see above.
+render_stats get_render_stats() {
+    auto& reg = _impl_stats::registry();
+    std::unique_lock<std::mutex> lock(reg.mutex);
+    auto total = reg.retired;
+    for (auto block : reg.blocks) _impl_stats::merge_stats(total, *block);
+    return total;
+}
+
+// Snapshot of the live per-thread blocks. Public API, see above.
+vector<render_stats> get_thread_render_stats() {
+    auto& reg = _impl_stats::registry();
+    std::unique_lock<std::mutex> lock(reg.mutex);
+    auto stats = vector<render_stats>();
+    for (auto block : reg.blocks) stats.push_back(*block);
+    return stats;
+}
+
+// Zeroes all counters. Public API, see above.
+void clear_render_stats() {
+    auto& reg = _impl_stats::registry();
+    std::unique_lock<std::mutex> lock(reg.mutex);
+    reg.retired = render_stats();
+    for (auto block : reg.blocks) *block = render_stats();
+}
+
+}  // namespace ygl
+
+#endif
+
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION FOR BVH
+// -----------------------------------------------------------------------------
+namespace ygl {
+
+namespace _impl_bvh {
+
+// ranges of primitives below this size are not worth splitting further
+// during the serial top-of-tree phase
+const int parallel_grain = 4096;
+
+// shapes above this size are built with parallel subtree splitting
+const int parallel_shape_cutoff = 512 * 1024;
+
+// range of primitives covered by a pending subtree
+struct bvh_subtree {
+    int nodeid = 0;  // placeholder node in the main array
+    int start = 0;   // first primitive
+    int end = 0;     // one past the last primitive
+};
+
+// Build a BVH building independent subtrees concurrently on the pool.
+bvh_tree* build_bvh_parallel(int nprims, const bvh_build_params& params,
+    const function<bbox3f(int)>& elem_bbox, thread_pool* pool) {
+    // grab the global pool if none was given
+    if (!pool) pool = get_global_pool();
+    auto nthreads = (int)pool->_threads.size();
+
+    // allocate if needed
+    auto bvh = new bvh_tree();
+
+    // prepare prims in parallel chunks
+    auto bound_prims = vector<bvh_bound_prim>(nprims);
+    auto nchunks = min(nprims, nthreads * 4);
+    parallel_for(pool, nchunks, [&](int c) {
+        auto cstart = (int)(((int64_t)nprims * c) / nchunks);
+        auto cend = (int)(((int64_t)nprims * (c + 1)) / nchunks);
+        for (auto i = cstart; i < cend; i++) {
+            bound_prims[i].pid = i;
+            bound_prims[i].bbox = elem_bbox(i);
+            bound_prims[i].center = bbox_center(bound_prims[i].bbox);
+        }
+    });
+
+    // split the top of the tree serially until there are enough
+    // independent subtrees to keep all the threads busy
+    auto max_subtrees = max(nthreads * 8, 1);
+    auto queue = vector<bvh_subtree>();
+    auto subtrees = vector<bvh_subtree>();
+    bvh->nodes.emplace_back();
+    queue.push_back({0, 0, nprims});
+    while (!queue.empty() &&
+           (int)(queue.size() + subtrees.size()) < max_subtrees) {
+        auto range = queue.front();
+        queue.erase(queue.begin());
+
+        // ranges too small to split concurrently are left to the tasks
+        if (range.end - range.start <= parallel_grain) {
+            subtrees.push_back(range);
+            continue;
+        }
+
+        // compute the node bounds and try to split; unsplittable ranges
+        // become leaves inside their subtree build
+        auto bbox = invalid_bbox3f;
+        for (auto i = range.start; i < range.end; i++)
+            bbox += bound_prims[i].bbox;
+        auto axis = 0, mid = 0;
+        if (!split_bvh_prims(
+                bound_prims.data(), range.start, range.end, params, axis, mid)) {
+            subtrees.push_back(range);
+            continue;
+        }
+
+        // make the internal node and queue up the children
+        auto childid = (int)bvh->nodes.size();
+        bvh->nodes.emplace_back();
+        bvh->nodes.emplace_back();
+        auto node = &bvh->nodes[range.nodeid];
+        node->bbox = bbox;
+        node->isleaf = false;
+        node->axis = axis;
+        node->start = childid;
+        node->count = 2;
+        queue.push_back({childid, range.start, mid});
+        queue.push_back({childid + 1, mid, range.end});
+    }
+    subtrees.insert(subtrees.end(), queue.begin(), queue.end());
+
+    // build each subtree into its own node array on the pool
+    auto subtree_nodes = vector<vector<bvh_node>>(subtrees.size());
+    parallel_for(pool, (int)subtrees.size(), [&](int i) {
+        auto& nodes = subtree_nodes[i];
+        nodes.reserve((subtrees[i].end - subtrees[i].start) * 2);
+        nodes.emplace_back();
+        make_bvh_node(&nodes[0], nodes, bound_prims.data(), subtrees[i].start,
+            subtrees[i].end, params);
+    });
+
+    // splice the subtrees into the main array remapping node indices;
+    // a subtree root replaces its placeholder while the other nodes are
+    // appended, so local index i maps to offset + i - 1
+    for (auto i = 0; i < (int)subtrees.size(); i++) {
+        auto& nodes = subtree_nodes[i];
+        auto offset = (int)bvh->nodes.size();
+        bvh->nodes[subtrees[i].nodeid] = nodes[0];
+        if (!nodes[0].isleaf)
+            bvh->nodes[subtrees[i].nodeid].start += offset - 1;
+        for (auto j = 1; j < (int)nodes.size(); j++) {
+            bvh->nodes.push_back(nodes[j]);
+            if (!nodes[j].isleaf) bvh->nodes.back().start += offset - 1;
+        }
+    }
+    bvh->nodes.shrink_to_fit();
+
+    // init sorted element arrays
+    // for shared memory, stored pointer to the external data
+    // store the sorted primitive order for BVH walk
+    bvh->sorted_prim.resize(nprims);
+    for (int i = 0; i < nprims; i++) {
+        bvh->sorted_prim[i] = bound_prims[i].pid;
+    }
+
+    // optionally collapse into wide nodes
+    if (params.wide) make_wide_bvh(bvh);
+
+    // done
+    return bvh;
+}
+
+// Build a shape BVH with parallel subtree splitting.
+void build_bvh_parallel(
+    shape* shp, const bvh_build_params& params, thread_pool* pool) {
+    if (!shp->points.empty()) {
+        shp->bvh = _impl_bvh::build_bvh_parallel((int)shp->points.size(), params,
+            [shp](int eid) {
+                auto f = shp->points[eid];
+                return point_bbox(shp->pos[f], shp->radius[f]);
+            },
+            pool);
+    } else if (!shp->lines.empty()) {
+        shp->bvh = _impl_bvh::build_bvh_parallel((int)shp->lines.size(), params,
+            [shp](int eid) {
+                auto f = shp->lines[eid];
+                return line_bbox(shp->pos[f.x], shp->pos[f.y],
+                    shp->radius[f.x], shp->radius[f.y]);
+            },
+            pool);
+    } else if (!shp->triangles.empty()) {
+        shp->bvh = _impl_bvh::build_bvh_parallel((int)shp->triangles.size(), params,
+            [shp](int eid) {
+                auto f = shp->triangles[eid];
+                return triangle_bbox(shp->pos[f.x], shp->pos[f.y], shp->pos[f.z]);
+            },
+            pool);
+    } else if (!shp->quads.empty()) {
+        shp->bvh = _impl_bvh::build_bvh_parallel((int)shp->quads.size(), params,
+            [shp](int eid) {
+                auto f = shp->quads[eid];
+                return quad_bbox(
+                    shp->pos[f.x], shp->pos[f.y], shp->pos[f.z], shp->pos[f.w]);
+            },
+            pool);
+    } else {
+        shp->bvh = _impl_bvh::build_bvh_parallel((int)shp->pos.size(), params,
+            [shp](int eid) {
+                auto r = (shp->radius.empty()) ? 0.00001f : shp->radius[eid];
+                return point_bbox(shp->pos[eid], r);
+            },
+            pool);
+    }
+    shp->bbox = shp->bvh->nodes[0].bbox;
+}
+
+// Build a scene BVH dispatching shape builds across the pool.
+void build_bvh_parallel(scene* scn, const bvh_build_params& params,
+    bool do_shapes, thread_pool* pool) {
+    // grab the global pool if none was given
+    if (!pool) pool = get_global_pool();
+
+    // do shapes
+    if (do_shapes) {
+        // dispatch small shapes as independent tasks; large ones are
+        // built one at a time with parallel subtree splitting, since the
+        // pool does not support nested parallelism
+        auto small_shapes = vector<shape*>();
+        for (auto shp : scn->shapes) {
+            auto nprims = max((int)shp->points.size(),
+                max((int)shp->lines.size(),
+                    max((int)shp->triangles.size(),
+                        max((int)shp->quads.size(), (int)shp->pos.size()))));
+            if (nprims >= parallel_shape_cutoff) {
+                _impl_bvh::build_bvh_parallel(shp, params, pool);
+            } else {
+                small_shapes.push_back(shp);
+            }
+        }
+        parallel_for(pool, (int)small_shapes.size(),
+            [&](int i) { build_bvh(small_shapes[i], params); });
+    }
+
+    // update instance bbox
+    for (auto ist : scn->instances)
+        ist->bbox = transform_bbox(ist->frame, ist->shp->bbox);
+
+    // tree bvh
+    scn->bvh = build_bvh((int)scn->instances.size(), params,
+        [scn](int eid) { return scn->instances[eid]->bbox; });
+}
+
+// magic string and version for the bvh cache format
+const char* bvh_cache_magic = "YBVH";
+const int bvh_cache_version = 1;
+
+// FNV-1a hash over a block of bytes, chainable through the seed.
+inline uint64_t hash_bvh_data(
+    const void* data, size_t size, uint64_t h = 14695981039346656037ull) {
+    auto bytes = (const unsigned char*)data;
+    for (auto i = (size_t)0; i < size; i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Hashes the data a shape bvh is built from.
+inline uint64_t hash_bvh_key(const shape* shp, uint64_t h) {
+    auto sizes = array<size_t, 6>{{shp->points.size(), shp->lines.size(),
+        shp->triangles.size(), shp->quads.size(), shp->pos.size(),
+        shp->radius.size()}};
+    h = hash_bvh_data(sizes.data(), sizeof(sizes), h);
+    h = hash_bvh_data(
+        shp->points.data(), shp->points.size() * sizeof(int), h);
+    h = hash_bvh_data(shp->lines.data(), shp->lines.size() * sizeof(vec2i), h);
+    h = hash_bvh_data(
+        shp->triangles.data(), shp->triangles.size() * sizeof(vec3i), h);
+    h = hash_bvh_data(shp->quads.data(), shp->quads.size() * sizeof(vec4i), h);
+    h = hash_bvh_data(shp->pos.data(), shp->pos.size() * sizeof(vec3f), h);
+    h = hash_bvh_data(
+        shp->radius.data(), shp->radius.size() * sizeof(float), h);
+    return h;
+}
+
+// Hashes the data the scene bvh is built from.
+inline uint64_t hash_bvh_key(const scene* scn) {
+    auto h = hash_bvh_data(nullptr, 0);
+    for (auto shp : scn->shapes) h = hash_bvh_key(shp, h);
+    for (auto ist : scn->instances) {
+        h = hash_bvh_data(&ist->frame, sizeof(ist->frame), h);
+        auto sid = -1;
+        for (auto i = 0; i < (int)scn->shapes.size() && sid < 0; i++)
+            if (scn->shapes[i] == ist->shp) sid = i;
+        h = hash_bvh_data(&sid, sizeof(sid), h);
+    }
+    return h;
+}
+
+// Writes one bvh as raw index-based arrays.
+inline void write_bvh(FILE* f, const bvh_tree* bvh) {
+    auto nnodes = (int)bvh->nodes.size();
+    auto nprims = (int)bvh->sorted_prim.size();
+    auto nwide = (int)bvh->wide_nodes.size();
+    fwrite(&nnodes, sizeof(int), 1, f);
+    fwrite(&nprims, sizeof(int), 1, f);
+    fwrite(&nwide, sizeof(int), 1, f);
+    fwrite(bvh->nodes.data(), sizeof(bvh_node), nnodes, f);
+    fwrite(bvh->sorted_prim.data(), sizeof(int), nprims, f);
+    fwrite(bvh->wide_nodes.data(), sizeof(bvh_wide_node), nwide, f);
+}
+
+// Reads one bvh written by write_bvh. Returns null on malformed data.
+inline bvh_tree* read_bvh(FILE* f) {
+    auto nnodes = 0, nprims = 0, nwide = 0;
+    if (fread(&nnodes, sizeof(int), 1, f) != 1) return nullptr;
+    if (fread(&nprims, sizeof(int), 1, f) != 1) return nullptr;
+    if (fread(&nwide, sizeof(int), 1, f) != 1) return nullptr;
+    if (nnodes < 0 || nprims < 0 || nwide < 0) return nullptr;
+    auto bvh = unique_ptr<bvh_tree>(new bvh_tree());
+    bvh->nodes.resize(nnodes);
+    bvh->sorted_prim.resize(nprims);
+    bvh->wide_nodes.resize(nwide);
+    if (fread(bvh->nodes.data(), sizeof(bvh_node), nnodes, f) !=
+        (size_t)nnodes)
+        return nullptr;
+    if (fread(bvh->sorted_prim.data(), sizeof(int), nprims, f) !=
+        (size_t)nprims)
+        return nullptr;
+    if (fread(bvh->wide_nodes.data(), sizeof(bvh_wide_node), nwide, f) !=
+        (size_t)nwide)
+        return nullptr;
+    return bvh.release();
+}
+
+// Saves the scene bvhs to a binary cache file.
+bool save_bvh(const scene* scn, const string& filename) {
+    if (!scn->bvh) return false;
+    for (auto shp : scn->shapes)
+        if (!shp->bvh) return false;
+    auto f = fopen(filename.c_str(), "wb");
+    if (!f) return false;
+    fwrite(bvh_cache_magic, 1, 4, f);
+    fwrite(&bvh_cache_version, sizeof(int), 1, f);
+    auto key = hash_bvh_key(scn);
+    fwrite(&key, sizeof(key), 1, f);
+    auto nshapes = (int)scn->shapes.size();
+    fwrite(&nshapes, sizeof(int), 1, f);
+    for (auto shp : scn->shapes) write_bvh(f, shp->bvh);
+    write_bvh(f, scn->bvh);
+    fclose(f);
+    return true;
+}
+
+// Loads the scene bvhs from a binary cache file.
+bool load_bvh(scene* scn, const string& filename) {
+    auto f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+
+    // validate header and key against the current scene data
+    char magic[4];
+    auto version = 0;
+    auto key = (uint64_t)0;
+    auto nshapes = 0;
+    auto ok = fread(magic, 1, 4, f) == 4 && !memcmp(magic, bvh_cache_magic, 4);
+    ok = ok && fread(&version, sizeof(int), 1, f) == 1 &&
+         version == bvh_cache_version;
+    ok = ok && fread(&key, sizeof(key), 1, f) == 1 && key == hash_bvh_key(scn);
+    ok = ok && fread(&nshapes, sizeof(int), 1, f) == 1 &&
+         nshapes == (int)scn->shapes.size();
+    if (!ok) {
+        fclose(f);
+        return false;
+    }
+
+    // read all bvhs before touching the scene
+    auto shape_bvhs = vector<bvh_tree*>();
+    auto scene_bvh = (bvh_tree*)nullptr;
+    for (auto i = 0; i < nshapes && ok; i++) {
+        shape_bvhs.push_back(read_bvh(f));
+        ok = ok && shape_bvhs.back();
+    }
+    if (ok) {
+        scene_bvh = read_bvh(f);
+        ok = ok && scene_bvh;
+    }
+    fclose(f);
+    if (!ok) {
+        for (auto bvh : shape_bvhs) delete bvh;
+        delete scene_bvh;
+        return false;
+    }
+
+    // install the loaded bvhs and refresh the cached bounds
+    for (auto i = 0; i < nshapes; i++) {
+        delete scn->shapes[i]->bvh;
+        scn->shapes[i]->bvh = shape_bvhs[i];
+        scn->shapes[i]->bbox = shape_bvhs[i]->nodes[0].bbox;
+    }
+    for (auto ist : scn->instances)
+        ist->bbox = transform_bbox(ist->frame, ist->shp->bbox);
+    delete scn->bvh;
+    scn->bvh = scene_bvh;
+    return true;
+}
+
+}  // namespace _impl_bvh
+
+bvh_tree* build_bvh_parallel(int nprims, const bvh_build_params& params,
+    const function<bbox3f(int)>& elem_bbox, thread_pool* pool) {
+    return _impl_bvh::build_bvh_parallel(nprims, params, elem_bbox, pool);
+}
+
+void build_bvh_parallel(
+    shape* shp, const bvh_build_params& params, thread_pool* pool) {
+    _impl_bvh::build_bvh_parallel(shp, params, pool);
+}
+
+void build_bvh_parallel(scene* scn, const bvh_build_params& params,
+    bool do_shapes, thread_pool* pool) {
+    _impl_bvh::build_bvh_parallel(scn, params, do_shapes, pool);
+}
+
+bool save_bvh(const scene* scn, const string& filename) {
+    return _impl_bvh::save_bvh(scn, filename);
+}
+
+bool load_bvh(scene* scn, const string& filename) {
+    return _impl_bvh::load_bvh(scn, filename);
+}
+
+}  // namespace ygl
+
 // -----------------------------------------------------------------------------
 // IMPLEMENTATION FOR PATH TRACE
 // -----------------------------------------------------------------------------
@@ -715,6 +1599,7 @@ inline void specular_fresnel_from_ks(const vec3f& ks, vec3f& es, vec3f& esk) {
 struct sampler {
     rng_pcg32& rng;        // random number state
     uint32_t pixel_hash;   // pixel hash
+    int i, j;              // pixel coordinates
     int s, d;              // sample and dimension indices
     int ns, ns2;           // number of samples and its square root
     trace_rng_type rtype;  // random number type
@@ -729,17 +1614,48 @@ struct sampler {
 inline sampler make_sampler(
     rng_pcg32& rng, int i, int j, int s, int ns, trace_rng_type rtype) {
     // we use various hashes to scramble the pixel values
-    return {rng, hash_uint32((uint32_t)(j + 1) << 16 | (uint32_t)(i + 1)), s, 0,
-        ns, (int)round(sqrt((float)ns)), rtype};
+    return {rng, hash_uint32((uint32_t)(j + 1) << 16 | (uint32_t)(i + 1)), i, j,
+        s, 0, ns, (int)round(sqrt((float)ns)), rtype};
+}
+
+// Van der Corput radical inverse in base 2, xor-scrambled. Together with
+// sobol_snd() below it forms a scrambled (0,2)-sequence.
+inline float sobol_vdc(uint32_t i, uint32_t scramble) {
+    i = (i << 16) | (i >> 16);
+    i = ((i & 0x00ff00ffu) << 8) | ((i & 0xff00ff00u) >> 8);
+    i = ((i & 0x0f0f0f0fu) << 4) | ((i & 0xf0f0f0f0u) >> 4);
+    i = ((i & 0x33333333u) << 2) | ((i & 0xccccccccu) >> 2);
+    i = ((i & 0x55555555u) << 1) | ((i & 0xaaaaaaaau) >> 1);
+    return ((i ^ scramble) >> 8) * (1.0f / (1 << 24));
 }
 
-// Generates a 1-dimensional sample.
+// Second dimension of the Sobol sequence, xor-scrambled.
+inline float sobol_snd(uint32_t i, uint32_t scramble) {
+    for (auto v = 1u << 31; i; i >>= 1, v ^= v >> 1)
+        if (i & 1) scramble ^= v;
+    return (scramble >> 8) * (1.0f / (1 << 24));
+}
+
+// Fractional part, used by the low-discrepancy additive sequences.
+inline float sample_fract(float x) { return x - (int)x; }
+
+// Interleaved gradient noise, a cheap blue-noise-like dither pattern used
+// to rotate the low-discrepancy sequence per pixel so error distributes as
+// high-frequency noise across the image.
+inline float blue_noise_dither(int i, int j) {
+    return sample_fract(
+        52.9829189f * sample_fract(0.06711056f * i + 0.00583715f * j));
+}
+
+// Generates a 1-dimensional sample, with the generator resolved at
+// compile time so the inner shading loops carry no per-draw dispatch.
 //
 // Implementation Notes: For deterministic sampling (stratified and cmjs) we
 // compute a 64bit sample and use hashing to avoid correlation. Then permutation
 // are computed with CMJS procedures.
+template <trace_rng_type Rtype>
 inline float sample_next1f(sampler& smp) {
-    switch (smp.rtype) {
+    switch (Rtype) {
         case trace_rng_type::uniform: {
             return clamp(next_rand1f(smp.rng), 0.0f, 1 - flt_eps);
         } break;
@@ -751,6 +1667,20 @@ inline float sample_next1f(sampler& smp) {
             return clamp(
                 (s + next_rand1f(smp.rng)) / smp.ns, 0.0f, 1 - flt_eps);
         } break;
+        case trace_rng_type::sobol: {
+            smp.d += 1;
+            auto p = hash_uint64_32(
+                (uint64_t)smp.pixel_hash | (uint64_t)smp.d << 32);
+            auto s = hash_permute(smp.s, smp.ns, p);
+            return clamp(sobol_vdc(s, hash_uint32(p)), 0.0f, 1 - flt_eps);
+        } break;
+        case trace_rng_type::bluenoise: {
+            smp.d += 1;
+            auto shift = sample_fract(blue_noise_dither(smp.i, smp.j) +
+                                      hash_uint32(smp.d) * 2.3283064365e-10f);
+            return clamp(sample_fract(smp.s * 0.6180339887f + shift), 0.0f,
+                1 - flt_eps);
+        } break;
         default: {
             assert(false);
             return 0;
@@ -758,12 +1688,32 @@ inline float sample_next1f(sampler& smp) {
     }
 }
 
-// Generates a 2-dimensional sample.
+// Generates a 1-dimensional sample, dispatching on the generator type.
+inline float sample_next1f(sampler& smp) {
+    switch (smp.rtype) {
+        case trace_rng_type::uniform:
+            return sample_next1f<trace_rng_type::uniform>(smp);
+        case trace_rng_type::stratified:
+            return sample_next1f<trace_rng_type::stratified>(smp);
+        case trace_rng_type::sobol:
+            return sample_next1f<trace_rng_type::sobol>(smp);
+        case trace_rng_type::bluenoise:
+            return sample_next1f<trace_rng_type::bluenoise>(smp);
+        default: {
+            assert(false);
+            return 0;
+        }
+    }
+}
+
+// Generates a 2-dimensional sample, with the generator resolved at
+// compile time.
 //
 // Implementation notes: see above. Note that using deterministic keyed
 // permutaton we can use stratified sampling without preallocating samples.
+template <trace_rng_type Rtype>
 inline vec2f sample_next2f(sampler& smp) {
-    switch (smp.rtype) {
+    switch (Rtype) {
         case trace_rng_type::uniform: {
             return {next_rand1f(smp.rng), next_rand1f(smp.rng)};
         } break;
@@ -777,6 +1727,43 @@ inline vec2f sample_next2f(sampler& smp) {
                 clamp((s / smp.ns2 + next_rand1f(smp.rng)) / smp.ns2, 0.0f,
                     1 - flt_eps)};
         } break;
+        case trace_rng_type::sobol: {
+            smp.d += 2;
+            auto p = hash_uint64_32(
+                (uint64_t)smp.pixel_hash | (uint64_t)smp.d << 32);
+            auto s = hash_permute(smp.s, smp.ns, p);
+            return {clamp(sobol_vdc(s, hash_uint32(p)), 0.0f, 1 - flt_eps),
+                clamp(sobol_snd(s, hash_uint32(p + 1)), 0.0f, 1 - flt_eps)};
+        } break;
+        case trace_rng_type::bluenoise: {
+            smp.d += 2;
+            // R2 additive sequence, rotated per pixel with the dither
+            auto shift = sample_fract(blue_noise_dither(smp.i, smp.j) +
+                                      hash_uint32(smp.d) * 2.3283064365e-10f);
+            return {clamp(sample_fract(smp.s * 0.7548776662f + shift), 0.0f,
+                        1 - flt_eps),
+                clamp(sample_fract(smp.s * 0.5698402909f +
+                                   sample_fract(shift + 0.6180339887f)),
+                    0.0f, 1 - flt_eps)};
+        } break;
+        default: {
+            assert(false);
+            return {0, 0};
+        }
+    }
+}
+
+// Generates a 2-dimensional sample, dispatching on the generator type.
+inline vec2f sample_next2f(sampler& smp) {
+    switch (smp.rtype) {
+        case trace_rng_type::uniform:
+            return sample_next2f<trace_rng_type::uniform>(smp);
+        case trace_rng_type::stratified:
+            return sample_next2f<trace_rng_type::stratified>(smp);
+        case trace_rng_type::sobol:
+            return sample_next2f<trace_rng_type::sobol>(smp);
+        case trace_rng_type::bluenoise:
+            return sample_next2f<trace_rng_type::bluenoise>(smp);
         default: {
             assert(false);
             return {0, 0};
@@ -828,6 +1815,7 @@ struct point {
     vec3f wo = zero3f;                 // outgoing direction
     emission em = {};                  // emission
     brdf fr = {};                      // brdf
+    float footprint = 0;               // ray cone width at the hit
 };
 
 // Generates a ray ray_o, ray_d from a camera cam for image plane coordinate
@@ -1264,9 +2252,9 @@ inline point eval_envpoint(const environment* env, const vec3f& wo) {
     auto ke = env->ke;
     if (env->ke_txt) {
         auto w = transform_direction_inverse(env->frame, -wo);
-        auto theta = clamp(w.y, (float)-1, (float)1);
+        auto theta = acos(clamp(w.y, (float)-1, (float)1));
         auto phi = atan2(w.z, w.x);
-        auto texcoord = vec2f{0.5f + phi / (2 * pif), 1 + 0.5f * theta / pif};
+        auto texcoord = vec2f{0.5f + phi / (2 * pif), theta / pif};
         ke *= eval_texture(env->ke_txt, texcoord).xyz();
     }
 
@@ -1278,8 +2266,9 @@ inline point eval_envpoint(const environment* env, const vec3f& wo) {
 }
 
 // Create a point for a shape. Resolves geometry and material with textures.
-inline point eval_shapepoint(
-    const instance* ist, int eid, const vec4f& euv, const vec3f& wo) {
+// The footprint is the ray cone width at the hit, used for texture mips.
+inline point eval_shapepoint(const instance* ist, int eid, const vec4f& euv,
+    const vec3f& wo, float footprint = 0) {
     // set shape data
     auto pt = point();
 
@@ -1289,21 +2278,41 @@ inline point eval_shapepoint(
     // direction
     pt.wo = wo;
 
-    // shortcuts
-    auto shp = ist->shp;
+    // footprint
+    pt.footprint = footprint;
+
+    // shortcuts, at the instance level of detail
+    auto shp = lod_shape(ist);
     auto mat = ist->shp->mat;
 
     // compute points and weights
-    auto pos = eval_pos(ist->shp, eid, euv);
-    auto norm = eval_norm(ist->shp, eid, euv);
-    auto texcoord = eval_texcoord(ist->shp, eid, euv);
-    auto color = eval_color(ist->shp, eid, euv);
+    auto pos = eval_pos(shp, eid, euv);
+    auto norm = eval_norm(shp, eid, euv);
+    auto texcoord = eval_texcoord(shp, eid, euv);
+    auto color = eval_color(shp, eid, euv);
+
+    // convert the footprint to texture coordinates from the texel density
+    // of the hit element, for mip level selection
+    auto uvfp = 0.0f;
+    if (footprint > 0 && !shp->triangles.empty() && !shp->texcoord.empty()) {
+        auto t = shp->triangles[eid];
+        auto p0 = transform_point(ist->frame, shp->pos[t.x]),
+             p1 = transform_point(ist->frame, shp->pos[t.y]),
+             p2 = transform_point(ist->frame, shp->pos[t.z]);
+        auto uv0 = shp->texcoord[t.x], uv1 = shp->texcoord[t.y],
+             uv2 = shp->texcoord[t.z];
+        auto parea = length(cross(p1 - p0, p2 - p0));
+        auto tarea = fabs((uv1.x - uv0.x) * (uv2.y - uv0.y) -
+                          (uv2.x - uv0.x) * (uv1.y - uv0.y));
+        if (parea > 0 && tarea > 0) uvfp = footprint * sqrt(tarea / parea);
+    }
 
     // handle normal map
     if (mat->norm_txt) {
-        auto tangsp = eval_tangsp(ist->shp, eid, euv);
-        auto txt = eval_texture(mat->norm_txt, texcoord, false).xyz() * 2.0f -
-                   vec3f{1, 1, 1};
+        auto tangsp = eval_tangsp(shp, eid, euv);
+        auto txt =
+            eval_texture(mat->norm_txt, texcoord, false, uvfp).xyz() * 2.0f -
+            vec3f{1, 1, 1};
         auto ntxt = normalize(vec3f{txt.x, -txt.y, txt.z});
         auto frame =
             make_frame3_fromzx({0, 0, 0}, norm, {tangsp.x, tangsp.y, tangsp.z});
@@ -1324,7 +2333,7 @@ inline point eval_shapepoint(
 
     // handle occlusion
     if (mat->occ_txt)
-        kx_scale.xyz() *= eval_texture(mat->occ_txt, texcoord).xyz();
+        kx_scale.xyz() *= eval_texture(mat->occ_txt, texcoord, true, uvfp).xyz();
 
     // sample emission
     auto ke = mat->ke * kx_scale.xyz();
@@ -1334,18 +2343,18 @@ inline point eval_shapepoint(
     switch (mat->mtype) {
         case material_type::specular_roughness: {
             kd = vec4f{mat->kd, mat->op} * kx_scale *
-                 eval_texture(mat->kd_txt, texcoord);
+                 eval_texture(mat->kd_txt, texcoord, true, uvfp);
             ks = vec4f{mat->ks, mat->rs} * vec4f{kx_scale.xyz(), 1} *
-                 eval_texture(mat->ks_txt, texcoord);
+                 eval_texture(mat->ks_txt, texcoord, true, uvfp);
             kt = vec4f{mat->kt, mat->rs} * vec4f{kx_scale.xyz(), 1} *
-                 eval_texture(mat->kt_txt, texcoord);
+                 eval_texture(mat->kt_txt, texcoord, true, uvfp);
         } break;
         case material_type::metallic_roughness: {
             auto kb = vec4f{mat->kd, mat->op} * kx_scale *
-                      eval_texture(mat->kd_txt, texcoord);
+                      eval_texture(mat->kd_txt, texcoord, true, uvfp);
             auto km = vec2f{mat->ks.x, mat->rs};
             if (mat->ks_txt) {
-                auto ks_txt = eval_texture(mat->ks_txt, texcoord);
+                auto ks_txt = eval_texture(mat->ks_txt, texcoord, true, uvfp);
                 km.x *= ks_txt.y;
                 km.y *= ks_txt.z;
             }
@@ -1356,9 +2365,9 @@ inline point eval_shapepoint(
         } break;
         case material_type::specular_glossiness: {
             kd = vec4f{mat->kd, mat->op} * kx_scale *
-                 eval_texture(mat->kd_txt, texcoord);
+                 eval_texture(mat->kd_txt, texcoord, true, uvfp);
             ks = vec4f{mat->ks, mat->rs} * vec4f{kx_scale.xyz(), 1} *
-                 eval_texture(mat->ks_txt, texcoord);
+                 eval_texture(mat->ks_txt, texcoord, true, uvfp);
             ks.w = 1 - ks.w;  // glossiness -> roughness
         } break;
     }
@@ -1391,13 +2400,56 @@ inline point eval_shapepoint(
     return pt;
 }
 
+// Picks a direction towards an environment, importance sampling the texel
+// cdf precomputed by update_lights() when present and falling back to a
+// uniform sphere otherwise. Returns the direction from the environment
+// towards the scene, like sample_light() uses.
+inline vec3f sample_environment(
+    const environment* env, float rne, const vec2f& rn) {
+    if (!env->elem_cdf.empty() && env->ke_txt.txt) {
+        auto txt = env->ke_txt.txt;
+        auto eid = sample_points(env->elem_cdf, rne);
+        auto i = eid % txt->width(), j = eid / txt->width();
+        auto u = (i + rn.x) / txt->width(), v = (j + rn.y) / txt->height();
+        auto theta = v * pif, phi = (u - 0.5f) * 2 * pif;
+        auto w = vec3f{
+            cos(phi) * sin(theta), cos(theta), sin(phi) * sin(theta)};
+        return -transform_direction(env->frame, w);
+    } else {
+        auto z = -1 + 2 * rn.y;
+        auto rr = sqrt(clamp(1 - z * z, (float)0, (float)1));
+        auto phi = 2 * pif * rn.x;
+        return vec3f{cos(phi) * rr, z, sin(phi) * rr};
+    }
+}
+
+// Pdf, in solid angle, with which sample_environment() picks the direction
+// of an environment point. Uses the same direction-to-texel mapping as
+// eval_envpoint() so the two stay consistent.
+inline float sample_environment_pdf(const environment* env, const vec3f& wo) {
+    if (env->elem_cdf.empty() || !env->ke_txt.txt) return 1 / (4 * pif);
+    auto txt = env->ke_txt.txt;
+    auto w = transform_direction_inverse(env->frame, -wo);
+    auto theta = acos(clamp(w.y, (float)-1, (float)1));
+    auto phi = atan2(w.z, w.x);
+    auto i = clamp(
+        (int)((0.5f + phi / (2 * pif)) * txt->width()), 0, txt->width() - 1);
+    auto j = clamp((int)(theta / pif * txt->height()), 0, txt->height() - 1);
+    auto eid = j * txt->width() + i;
+    auto pe = (env->elem_cdf[eid] - ((eid) ? env->elem_cdf[eid - 1] : 0)) /
+              env->elem_cdf.back();
+    auto texel_angle = (2 * pif / txt->width()) * (pif / txt->height()) *
+                       sin(pif * (j + 0.5f) / txt->height());
+    return pe / texel_angle;
+}
+
 // Sample weight for a light point.
 inline float weight_light(const point& lpt, const point& pt) {
     if (!lpt.em) return 0;
     // support only one lobe for now
     switch (lpt.em.type) {
         case emission_type::env: {
-            return 4 * pif;
+            return 1 / sample_environment_pdf(lpt.env, lpt.wo);
         } break;
         case emission_type::point: {
             auto d = length(lpt.frame.o - pt.frame.o);
@@ -1443,10 +2495,7 @@ inline point sample_light(
         lpt.wo = normalize(pt.frame.o - lpt.frame.o);
         return lpt;
     } else if (lgt->env) {
-        auto z = -1 + 2 * rn.y;
-        auto rr = sqrt(clamp(1 - z * z, (float)0, (float)1));
-        auto phi = 2 * pif * rn.x;
-        auto wo = vec3f{cos(phi) * rr, z, sin(phi) * rr};
+        auto wo = sample_environment(lgt->env, rne, rn);
         auto lpt = eval_envpoint(lgt->env, wo);
         return lpt;
     } else {
@@ -1455,6 +2504,89 @@ inline point sample_light(
     }
 }
 
+// Importance of a light hierarchy node as seen from the shading point:
+// aggregate power over squared distance to the node center, clamped to the
+// node radius so clusters containing the point do not blow up.
+inline float weight_light_node(const light_tree_node& node, const point& pt) {
+    auto c = (node.bbox.min + node.bbox.max) / 2.0f;
+    auto r = length(node.bbox.max - node.bbox.min) / 2;
+    auto d = c - pt.frame.o;
+    return node.power / max(dot(d, d), max(r * r, flt_eps));
+}
+
+// Picks a light by descending the light hierarchy from the root, choosing
+// each child with probability proportional to its importance from pt, and
+// rescaling rnl so a single random number drives the whole descent.
+// Returns the light id and its selection probability.
+inline pair<int, float> sample_light_tree(
+    const light_tree* ltree, const point& pt, float rnl) {
+    if (!ltree || ltree->nodes.empty()) return {0, 1};
+    auto nid = 0;
+    auto pdf = 1.0f;
+    while (!ltree->nodes[nid].count) {
+        auto& node = ltree->nodes[nid];
+        auto w0 = weight_light_node(ltree->nodes[node.start], pt);
+        auto w1 = weight_light_node(ltree->nodes[node.start + 1], pt);
+        if (w0 + w1 <= 0) w0 = w1 = 1;
+        auto p0 = w0 / (w0 + w1);
+        if (rnl < p0) {
+            rnl = min(rnl / p0, 1 - flt_eps);
+            pdf *= p0;
+            nid = node.start;
+        } else {
+            rnl = min((rnl - p0) / (1 - p0), 1 - flt_eps);
+            pdf *= 1 - p0;
+            nid = node.start + 1;
+        }
+    }
+    // pick within the leaf proportionally to light power
+    auto& leaf = ltree->nodes[nid];
+    auto total = 0.0f;
+    for (auto i = 0; i < leaf.count; i++)
+        total += max(
+            ltree->light_power[ltree->sorted_lights[leaf.start + i]], flt_eps);
+    auto cdf = 0.0f;
+    for (auto i = 0; i < leaf.count; i++) {
+        auto lid = ltree->sorted_lights[leaf.start + i];
+        auto p = max(ltree->light_power[lid], flt_eps) / total;
+        if (rnl < cdf + p || i == leaf.count - 1) return {lid, pdf * p};
+        cdf += p;
+    }
+    return {ltree->sorted_lights[leaf.start], pdf};
+}
+
+// Selection probability with which sample_light_tree() picks light lid from
+// pt; used to weight bsdf samples that hit a light in the MIS weights.
+inline float pdf_light_tree(const light_tree* ltree, const point& pt, int lid) {
+    if (!ltree || ltree->nodes.empty() || lid < 0) return 1;
+    // within-leaf probability
+    auto& leaf = ltree->nodes[ltree->light_leaf[lid]];
+    auto total = 0.0f;
+    for (auto i = 0; i < leaf.count; i++)
+        total += max(
+            ltree->light_power[ltree->sorted_lights[leaf.start + i]], flt_eps);
+    auto pdf = max(ltree->light_power[lid], flt_eps) / total;
+    // probabilities of the descent from the root
+    auto nid = ltree->light_leaf[lid];
+    while (ltree->nodes[nid].parent >= 0) {
+        auto& par = ltree->nodes[ltree->nodes[nid].parent];
+        auto w0 = weight_light_node(ltree->nodes[par.start], pt);
+        auto w1 = weight_light_node(ltree->nodes[par.start + 1], pt);
+        if (w0 + w1 <= 0) w0 = w1 = 1;
+        pdf *= (nid == par.start) ? w0 / (w0 + w1) : w1 / (w0 + w1);
+        nid = ltree->nodes[nid].parent;
+    }
+    return pdf;
+}
+
+// Light id of a point hit by a bsdf sample, or -1 if it is not a light.
+inline int light_tree_id(const light_tree* ltree, const point& pt) {
+    if (!ltree) return -1;
+    auto key = (pt.ist) ? (const void*)pt.ist : (const void*)pt.env;
+    auto it = ltree->light_id.find(key);
+    return (it == ltree->light_id.end()) ? -1 : it->second;
+}
+
 // Offsets a ray origin to avoid self-intersection.
 inline ray3f offset_ray(
     const point& pt, const vec3f& w, const trace_params& params) {
@@ -1480,28 +2612,48 @@ inline ray3f offset_ray(
     }
 }
 
-// Intersects a ray with the scn and return the point (or env
-// point).
-inline point intersect_scene(const scene* scn, const ray3f& ray) {
-    auto iid = 0, eid = 0;
-    auto euv = zero4f;
-    auto ray_t = 0.0f;
-    if (intersect_ray(scn, ray, false, ray_t, iid, eid, euv)) {
-        return eval_shapepoint(scn->instances[iid], eid, euv, -ray.d);
+// Resolves an intersection record into a shading point (or env point).
+inline point eval_point(const scene* scn, const intersection_point& isec,
+    const vec3f& wo, float footprint = 0) {
+    if (isec) {
+        return eval_shapepoint(
+            scn->instances[isec.iid], isec.eid, isec.euv, wo, footprint);
     } else if (!scn->environments.empty()) {
-        return eval_envpoint(scn->environments[0], -ray.d);
+        return eval_envpoint(scn->environments[0], wo);
     } else {
         return {};
     }
 }
 
+// Angular spread of a camera pixel, used to grow ray cone footprints for
+// texture mip selection.
+inline float eval_camera_spread(const scene* scn, const trace_params& params) {
+    auto cam = scn->cameras[params.camera_id];
+    return 2 * tan(cam->yfov / 2) / params.height;
+}
+
+// Intersects a ray with the scn and return the point (or env
+// point).
+inline point intersect_scene(const scene* scn, const ray3f& ray) {
+    return eval_point(scn, intersect_ray(scn, ray, false), -ray.d);
+}
+
+// Intersects a ray with the scn and return the point (or env point),
+// growing the ray cone footprint with the distance travelled.
+inline point intersect_scene(
+    const scene* scn, const ray3f& ray, float spread, float footprint) {
+    auto isec = intersect_ray(scn, ray, false);
+    return eval_point(
+        scn, isec, -ray.d, (isec) ? footprint + spread * isec.dist : 0.0f);
+}
+
 // Test occlusion
 inline vec3f eval_transmission(const scene* scn, const point& pt,
     const point& lpt, const trace_params& params) {
     if (params.shadow_notransmission) {
         auto shadow_ray = offset_ray(pt, lpt, params);
         // auto shadow_ray = ray3f{pt.frame.o, -lpt.wo, 0.01f, flt_max};
-        return (intersect_ray(scn, shadow_ray, true)) ? zero3f : vec3f{1, 1, 1};
+        return (intersect_occluded(scn, shadow_ray)) ? zero3f : vec3f{1, 1, 1};
     } else {
         auto cpt = pt;
         auto weight = vec3f{1, 1, 1};
@@ -1521,11 +2673,15 @@ inline float weight_mis(float w0, float w1) {
     return (1 / w0) / (1 / w0 + 1 / w1);
 }
 
-// Recursive path tracing.
-inline vec3f eval_li_pathtrace(const scene* scn, const ray3f& ray, sampler& smp,
-    const trace_params& params, bool& hit) {
-    // intersection
-    auto pt = intersect_scene(scn, ray);
+// Recursive path tracing, with the sampler draws resolved at compile
+// time for the given generator.
+template <trace_rng_type Rtype>
+inline vec3f eval_li_pathtrace(const scene* scn, const ray3f& ray,
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit) {
+    // resolve the primary intersection computed by the caller
+    auto spread = eval_camera_spread(scn, params);
+    auto pt = eval_point(scn, isec, -ray.d, spread * isec.dist);
     hit = pt.ist;
 
     // emission
@@ -1540,10 +2696,12 @@ inline vec3f eval_li_pathtrace(const scene* scn, const ray3f& ray, sampler& smp,
         if (emission) l += weight * eval_emission(pt);
 
         // direct – light
-        auto lgt = scn->lights[sample_next1i(smp, (int)scn->lights.size())];
-        auto lpt =
-            sample_light(lgt, pt, sample_next1f(smp), sample_next2f(smp));
-        auto lw = weight_light(lpt, pt) * (float)scn->lights.size();
+        auto lsel = sample_light_tree(
+            scn->ltree, pt, sample_next1f<Rtype>(smp));
+        auto lgt = scn->lights[lsel.first];
+        auto lpt = sample_light(lgt, pt, sample_next1f<Rtype>(smp),
+            sample_next2f<Rtype>(smp));
+        auto lw = weight_light(lpt, pt) / lsel.second;
         auto lke = eval_emission(lpt);
         auto lbc = eval_brdfcos(pt, -lpt.wo);
         auto lld = lke * lbc * lw;
@@ -1555,14 +2713,19 @@ inline vec3f eval_li_pathtrace(const scene* scn, const ray3f& ray, sampler& smp,
         // direct – brdf
         auto bpt = intersect_scene(
             scn, offset_ray(pt,
-                     sample_brdfcos(pt, sample_next1f(smp), sample_next2f(smp)),
-                     params));
+                     sample_brdfcos(pt, sample_next1f<Rtype>(smp),
+                         sample_next2f<Rtype>(smp)),
+                     params),
+            spread, pt.footprint);
         auto bw = weight_brdfcos(pt, -bpt.wo);
         auto bke = eval_emission(bpt);
         auto bbc = eval_brdfcos(pt, -bpt.wo);
         auto bld = bke * bbc * bw;
         if (bld != zero3f) {
-            l += weight * bld * weight_mis(bw, weight_light(bpt, pt));
+            l += weight * bld *
+                 weight_mis(bw, weight_light(bpt, pt) /
+                                    pdf_light_tree(scn->ltree, pt,
+                                        light_tree_id(scn->ltree, bpt)));
         }
 
         // skip recursion if path ends
@@ -1576,7 +2739,7 @@ inline vec3f eval_li_pathtrace(const scene* scn, const ray3f& ray, sampler& smp,
         // roussian roulette
         if (bounce > 2) {
             auto rrprob = 1.0f - min(max_element(pt.fr.rho()).second, 0.95f);
-            if (sample_next1f(smp) < rrprob) break;
+            if (sample_next1f<Rtype>(smp) < rrprob) break;
             weight *= 1 / (1 - rrprob);
         }
 
@@ -1588,11 +2751,15 @@ inline vec3f eval_li_pathtrace(const scene* scn, const ray3f& ray, sampler& smp,
     return l;
 }
 
-// Recursive path tracing.
+// Recursive path tracing, with the sampler draws resolved at compile
+// time for the given generator.
+template <trace_rng_type Rtype>
 inline vec3f eval_li_pathtrace_nomis(const scene* scn, const ray3f& ray,
-    sampler& smp, const trace_params& params, bool& hit) {
-    // intersection
-    auto pt = intersect_scene(scn, ray);
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit) {
+    // resolve the primary intersection computed by the caller
+    auto spread = eval_camera_spread(scn, params);
+    auto pt = eval_point(scn, isec, -ray.d, spread * isec.dist);
     hit = pt.ist;
 
     // emission
@@ -1607,11 +2774,13 @@ inline vec3f eval_li_pathtrace_nomis(const scene* scn, const ray3f& ray,
         if (emission) l += weight * eval_emission(pt);
 
         // direct
-        auto lgt = scn->lights[sample_next1i(smp, (int)scn->lights.size())];
-        auto lpt =
-            sample_light(lgt, pt, sample_next1f(smp), sample_next2f(smp));
+        auto lsel = sample_light_tree(
+            scn->ltree, pt, sample_next1f<Rtype>(smp));
+        auto lgt = scn->lights[lsel.first];
+        auto lpt = sample_light(lgt, pt, sample_next1f<Rtype>(smp),
+            sample_next2f<Rtype>(smp));
         auto ld = eval_emission(lpt) * eval_brdfcos(pt, -lpt.wo) *
-                  weight_light(lpt, pt) * (float)scn->lights.size();
+                  weight_light(lpt, pt) / lsel.second;
         if (ld != zero3f) {
             l += weight * ld * eval_transmission(scn, pt, lpt, params);
         }
@@ -1622,16 +2791,18 @@ inline vec3f eval_li_pathtrace_nomis(const scene* scn, const ray3f& ray,
         // roussian roulette
         if (bounce > 2) {
             auto rrprob = 1.0f - min(max_element(pt.fr.rho()).second, 0.95f);
-            if (sample_next1f(smp) < rrprob) break;
+            if (sample_next1f<Rtype>(smp) < rrprob) break;
             weight *= 1 / (1 - rrprob);
         }
 
         // continue path
-        auto bwi = sample_brdfcos(pt, sample_next1f(smp), sample_next2f(smp));
+        auto bwi = sample_brdfcos(
+            pt, sample_next1f<Rtype>(smp), sample_next2f<Rtype>(smp));
         weight *= eval_brdfcos(pt, bwi) * weight_brdfcos(pt, bwi);
         if (weight == zero3f) break;
 
-        auto bpt = intersect_scene(scn, offset_ray(pt, bwi, params));
+        auto bpt =
+            intersect_scene(scn, offset_ray(pt, bwi, params), spread, pt.footprint);
         emission = false;
         if (!bpt.fr) break;
 
@@ -1642,11 +2813,15 @@ inline vec3f eval_li_pathtrace_nomis(const scene* scn, const ray3f& ray,
     return l;
 }
 
-// Recursive path tracing.
+// Recursive path tracing, with the sampler draws resolved at compile
+// time for the given generator.
+template <trace_rng_type Rtype>
 inline vec3f eval_li_pathtrace_hack(const scene* scn, const ray3f& ray,
-    sampler& smp, const trace_params& params, bool& hit) {
-    // intersection
-    auto pt = intersect_scene(scn, ray);
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit) {
+    // resolve the primary intersection computed by the caller
+    auto spread = eval_camera_spread(scn, params);
+    auto pt = eval_point(scn, isec, -ray.d, spread * isec.dist);
     hit = pt.ist;
 
     // emission
@@ -1657,11 +2832,13 @@ inline vec3f eval_li_pathtrace_hack(const scene* scn, const ray3f& ray,
     auto weight = vec3f{1, 1, 1};
     for (auto bounce = 0; bounce < params.max_depth; bounce++) {
         // direct
-        auto lgt = scn->lights[sample_next1i(smp, (int)scn->lights.size())];
-        auto lpt =
-            sample_light(lgt, pt, sample_next1f(smp), sample_next2f(smp));
+        auto lsel = sample_light_tree(
+            scn->ltree, pt, sample_next1f<Rtype>(smp));
+        auto lgt = scn->lights[lsel.first];
+        auto lpt = sample_light(lgt, pt, sample_next1f<Rtype>(smp),
+            sample_next2f<Rtype>(smp));
         auto ld = eval_emission(lpt) * eval_brdfcos(pt, -lpt.wo) *
-                  weight_light(lpt, pt) * (float)scn->lights.size();
+                  weight_light(lpt, pt) / lsel.second;
         if (ld != zero3f) {
             l += weight * ld * eval_transmission(scn, pt, lpt, params);
         }
@@ -1672,16 +2849,18 @@ inline vec3f eval_li_pathtrace_hack(const scene* scn, const ray3f& ray,
         // roussian roulette
         if (bounce > 2) {
             auto rrprob = 1.0f - min(max_element(pt.fr.rho()).second, 0.95f);
-            if (sample_next1f(smp) < rrprob) break;
+            if (sample_next1f<Rtype>(smp) < rrprob) break;
             weight *= 1 / (1 - rrprob);
         }
 
         // continue path
-        auto bwi = sample_brdfcos(pt, sample_next1f(smp), sample_next2f(smp));
+        auto bwi = sample_brdfcos(
+            pt, sample_next1f<Rtype>(smp), sample_next2f<Rtype>(smp));
         weight *= eval_brdfcos(pt, bwi) * weight_brdfcos(pt, bwi);
         if (weight == zero3f) break;
 
-        auto bpt = intersect_scene(scn, offset_ray(pt, bwi, params));
+        auto bpt =
+            intersect_scene(scn, offset_ray(pt, bwi, params), spread, pt.footprint);
         if (!bpt.fr) break;
 
         // continue path
@@ -1691,11 +2870,15 @@ inline vec3f eval_li_pathtrace_hack(const scene* scn, const ray3f& ray,
     return l;
 }
 
-// Direct illumination.
-inline vec3f eval_li_direct(const scene* scn, const ray3f& ray, int bounce,
-    sampler& smp, const trace_params& params, bool& hit) {
-    // intersection
-    auto pt = intersect_scene(scn, ray);
+// Direct illumination, with the sampler draws resolved at compile time
+// for the given generator.
+template <trace_rng_type Rtype>
+inline vec3f eval_li_direct(const scene* scn, const ray3f& ray,
+    const intersection_point& isec, int bounce, sampler& smp,
+    const trace_params& params, bool& hit) {
+    // resolve the primary intersection computed by the caller
+    auto spread = eval_camera_spread(scn, params);
+    auto pt = eval_point(scn, isec, -ray.d, spread * isec.dist);
     if (!bounce) hit = pt.ist;
 
     // emission
@@ -1705,15 +2888,16 @@ inline vec3f eval_li_direct(const scene* scn, const ray3f& ray, int bounce,
     // ambient
     l += params.amb * pt.fr.rho();
 
-    // direct
-    for (auto& lgt : scn->lights) {
-        auto lpt =
-            sample_light(lgt, pt, sample_next1f(smp), sample_next2f(smp));
-        auto ld = eval_emission(lpt) * eval_brdfcos(pt, -lpt.wo) *
-                  weight_light(lpt, pt);
-        if (ld == zero3f) continue;
-        l += ld * eval_transmission(scn, pt, lpt, params);
-    }
+    // direct – a single light picked from the light hierarchy, so cost
+    // stays constant on scenes with many lights
+    auto lsel = sample_light_tree(
+        scn->ltree, pt, sample_next1f<Rtype>(smp));
+    auto lgt = scn->lights[lsel.first];
+    auto lpt = sample_light(
+        lgt, pt, sample_next1f<Rtype>(smp), sample_next2f<Rtype>(smp));
+    auto ld = eval_emission(lpt) * eval_brdfcos(pt, -lpt.wo) *
+              weight_light(lpt, pt) / lsel.second;
+    if (ld != zero3f) l += ld * eval_transmission(scn, pt, lpt, params);
 
     // exit if needed
     if (bounce >= params.max_depth) return l;
@@ -1721,7 +2905,9 @@ inline vec3f eval_li_direct(const scene* scn, const ray3f& ray, int bounce,
     // opacity
     if (pt.fr.kt != zero3f) {
         auto ray = offset_ray(pt, -pt.wo, params);
-        l += pt.fr.kt * eval_li_direct(scn, ray, bounce + 1, smp, params, hit);
+        l += pt.fr.kt * eval_li_direct<Rtype>(scn, ray,
+                            intersect_ray(scn, ray, false), bounce + 1, smp,
+                            params, hit);
     }
 
     // done
@@ -1729,16 +2915,20 @@ inline vec3f eval_li_direct(const scene* scn, const ray3f& ray, int bounce,
 }
 
 // Direct illumination.
-inline vec3f eval_li_direct(const scene* scn, const ray3f& ray, sampler& smp,
-    const trace_params& params, bool& hit) {
-    return eval_li_direct(scn, ray, 0, smp, params, hit);
+template <trace_rng_type Rtype>
+inline vec3f eval_li_direct(const scene* scn, const ray3f& ray,
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit) {
+    return eval_li_direct<Rtype>(scn, ray, isec, 0, smp, params, hit);
 }
 
 // Eyelight for quick previewing.
-inline vec3f eval_li_eyelight(const scene* scn, const ray3f& ray, int bounce,
-    sampler& smp, const trace_params& params, bool& hit) {
-    // intersection
-    auto pt = intersect_scene(scn, ray);
+inline vec3f eval_li_eyelight(const scene* scn, const ray3f& ray,
+    const intersection_point& isec, int bounce, sampler& smp,
+    const trace_params& params, bool& hit) {
+    // resolve the primary intersection computed by the caller
+    auto spread = eval_camera_spread(scn, params);
+    auto pt = eval_point(scn, isec, -ray.d, spread * isec.dist);
     if (!bounce) hit = pt.ist;
 
     // emission
@@ -1752,8 +2942,9 @@ inline vec3f eval_li_eyelight(const scene* scn, const ray3f& ray, int bounce,
     if (bounce >= params.max_depth) return l;
     if (pt.fr.kt != zero3f) {
         auto ray = offset_ray(pt, -pt.wo, params);
-        l +=
-            pt.fr.kt * eval_li_eyelight(scn, ray, bounce + 1, smp, params, hit);
+        l += pt.fr.kt * eval_li_eyelight(scn, ray,
+                            intersect_ray(scn, ray, false), bounce + 1, smp,
+                            params, hit);
     }
 
     // done
@@ -1761,16 +2952,17 @@ inline vec3f eval_li_eyelight(const scene* scn, const ray3f& ray, int bounce,
 }
 
 // Eyelight for quick previewing.
-inline vec3f eval_li_eyelight(const scene* scn, const ray3f& ray, sampler& smp,
-    const trace_params& params, bool& hit) {
-    return eval_li_eyelight(scn, ray, 0, smp, params, hit);
+inline vec3f eval_li_eyelight(const scene* scn, const ray3f& ray,
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit) {
+    return eval_li_eyelight(scn, ray, isec, 0, smp, params, hit);
 }
 
 // Debug previewing.
 inline vec3f eval_li_debug_normal(const scene* scn, const ray3f& ray,
-    sampler& smp, const trace_params& params, bool& hit) {
-    // intersection
-    auto isec = intersect_ray(scn, ray, false);
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit) {
+    // primary intersection computed by the caller
     hit = (bool)isec;
     if (!hit) return {0, 0, 0};
 
@@ -1781,9 +2973,10 @@ inline vec3f eval_li_debug_normal(const scene* scn, const ray3f& ray,
 
 // Debug previewing.
 inline vec3f eval_li_debug_albedo(const scene* scn, const ray3f& ray,
-    sampler& smp, const trace_params& params, bool& hit) {
-    // intersection
-    auto pt = intersect_scene(scn, ray);
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit) {
+    // resolve the primary intersection computed by the caller
+    auto pt = eval_point(scn, isec, -ray.d);
     hit = pt.ist;
 
     return pt.fr.rho();
@@ -1791,29 +2984,35 @@ inline vec3f eval_li_debug_albedo(const scene* scn, const ray3f& ray,
 
 // Debug previewing.
 inline vec3f eval_li_debug_texcoord(const scene* scn, const ray3f& ray,
-    sampler& smp, const trace_params& params, bool& hit) {
-    // intersection
-    auto isec = intersect_ray(scn, ray, false);
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit) {
+    // primary intersection computed by the caller
     hit = (bool)isec;
     if (!hit) return {0, 0, 0};
 
     // texcoord
     auto texcoord =
-        eval_texcoord(scn->instances[isec.iid]->shp, isec.eid, isec.euv);
+        eval_texcoord(lod_shape(scn->instances[isec.iid]), isec.eid, isec.euv);
     return {texcoord.x, texcoord.y, 0};
 }
 
-// Shader function callback.
-using eval_li_fn = vec3f (*)(const scene* scn, const ray3f& ray, sampler& smp,
-    const trace_params& params, bool& hit);
+// Shader function callback. Shaders receive the primary intersection
+// precomputed by the caller, so primary rays can be traced as streams.
+using eval_li_fn = vec3f (*)(const scene* scn, const ray3f& ray,
+    const intersection_point& isec, sampler& smp, const trace_params& params,
+    bool& hit);
 
-// Get a shader function
+// Get a shader function specialized for the given generator, so the
+// sampling shaders carry no per-draw rng dispatch. The eyelight and
+// debug shaders draw no samples and have a single instantiation.
+template <trace_rng_type Rtype>
 inline eval_li_fn get_shader(const trace_params& params) {
     switch (params.stype) {
         case trace_shader_type::eyelight: return eval_li_eyelight;
-        case trace_shader_type::direct: return eval_li_direct;
-        case trace_shader_type::pathtrace: return eval_li_pathtrace;
-        case trace_shader_type::pathtrace_nomis: return eval_li_pathtrace_nomis;
+        case trace_shader_type::direct: return eval_li_direct<Rtype>;
+        case trace_shader_type::pathtrace: return eval_li_pathtrace<Rtype>;
+        case trace_shader_type::pathtrace_nomis:
+            return eval_li_pathtrace_nomis<Rtype>;
         case trace_shader_type::debug_albedo: return eval_li_debug_albedo;
         case trace_shader_type::debug_normal: return eval_li_debug_normal;
         case trace_shader_type::debug_texcoord: return eval_li_debug_texcoord;
@@ -1821,6 +3020,21 @@ inline eval_li_fn get_shader(const trace_params& params) {
     }
 }
 
+// Get a shader function
+inline eval_li_fn get_shader(const trace_params& params) {
+    switch (params.rtype) {
+        case trace_rng_type::uniform:
+            return get_shader<trace_rng_type::uniform>(params);
+        case trace_rng_type::stratified:
+            return get_shader<trace_rng_type::stratified>(params);
+        case trace_rng_type::sobol:
+            return get_shader<trace_rng_type::sobol>(params);
+        case trace_rng_type::bluenoise:
+            return get_shader<trace_rng_type::bluenoise>(params);
+        default: return nullptr;
+    }
+}
+
 // triangle filter (public domain from stb_image_resize)
 inline float filter_triangle(float x) {
     x = (float)fabs(x);
@@ -1897,6 +3111,8 @@ inline void trace_block(const scene* scn, image4f& img, int block_x,
     int samples_max, vector<rng_pcg32>& rngs, const trace_params& params) {
     auto cam = scn->cameras[params.camera_id];
     auto shade = get_shader(params);
+    YGL_STAT(samples,
+        (uint64_t)block_width * block_height * (samples_max - samples_min));
     for (auto j = block_y; j < block_y + block_height; j++) {
         for (auto i = block_x; i < block_x + block_width; i++) {
             auto lp = zero4f;
@@ -1908,7 +3124,8 @@ inline void trace_block(const scene* scn, image4f& img, int block_x,
                     (i + rn.x) / params.width, 1 - (j + rn.y) / params.height};
                 auto ray = eval_camera(cam, uv, sample_next2f(smp));
                 auto hit = false;
-                auto l = shade(scn, ray, smp, params, hit);
+                auto l = shade(
+                    scn, ray, intersect_ray(scn, ray, false), smp, params, hit);
                 if (!hit && params.envmap_invisible) continue;
                 if (!isfinite(l.x) || !isfinite(l.y) || !isfinite(l.z)) {
                     log_error("NaN detected");
@@ -1927,24 +3144,69 @@ inline void trace_block(const scene* scn, image4f& img, int block_x,
     }
 }
 
-// Trace a block of samples
-inline void trace_block(const scene* scn, image4f& img, const vec2i& block_min,
-    const vec2i& block_max, int samples_min, int samples_max,
-    vector<rng_pcg32>& rngs, const trace_params& params) {
-    auto shade = get_shader(params);
+// Trace a block of samples with the shader call and the sampler draws
+// resolved at compile time, optionally filling the feature images at the
+// primary hit. Feature values reuse the primary intersections of the
+// beauty pass, so no extra rays are traced. A null Shade falls back to
+// the runtime shader table, for shaders outside the hot set.
+template <eval_li_fn Shade, trace_rng_type Rtype>
+inline void trace_block_t(const scene* scn, image4f& img, trace_aovs* aovs,
+    const vec2i& block_min, const vec2i& block_max, int samples_min,
+    int samples_max, vector<rng_pcg32>& rngs, const trace_params& params) {
+    auto shade = (Shade) ? Shade : get_shader<Rtype>(params);
     auto cam = scn->cameras[params.camera_id];
+    YGL_STAT(samples, (uint64_t)(block_max.x - block_min.x) *
+                          (block_max.y - block_min.y) *
+                          (samples_max - samples_min));
+
+    // generate all the primary rays for the block up front, so they can
+    // be intersected as one coherent stream
+    auto rays = vector<ray3f>();
+    auto smps = vector<sampler>();
+    rays.reserve((block_max.x - block_min.x) * (block_max.y - block_min.y) *
+                 (samples_max - samples_min));
+    smps.reserve(rays.capacity());
     for (auto j = block_min.y; j < block_max.y; j++) {
         for (auto i = block_min.x; i < block_max.x; i++) {
-            auto lp = zero4f;
             for (auto s = samples_min; s < samples_max; s++) {
                 auto smp = make_sampler(rngs[j * params.width + i], i, j, s,
                     params.nsamples, params.rtype);
-                auto rn = sample_next2f(smp);
+                auto rn = sample_next2f<Rtype>(smp);
                 auto uv = vec2f{
                     (i + rn.x) / params.width, 1 - (j + rn.y) / params.height};
-                auto ray = eval_camera(cam, uv, sample_next2f(smp));
+                rays.push_back(eval_camera(cam, uv, sample_next2f<Rtype>(smp)));
+                smps.push_back(smp);
+            }
+        }
+    }
+
+    // intersect the primary rays as a stream
+    auto isecs = intersect_ray_stream(scn, rays, false);
+
+    // shade
+    auto rid = 0;
+    for (auto j = block_min.y; j < block_max.y; j++) {
+        for (auto i = block_min.x; i < block_max.x; i++) {
+            auto lp = zero4f;
+            auto ap = zero4f, np = zero4f, dp = zero4f;
+            auto iid = -1.0f;
+            for (auto s = samples_min; s < samples_max; s++, rid++) {
+                auto& smp = smps[rid];
+                auto& ray = rays[rid];
+                if (aovs) {
+                    if (isecs[rid]) {
+                        auto pt = eval_point(scn, isecs[rid], -ray.d);
+                        ap += {pt.fr.rho(), 1};
+                        np += {pt.frame.z, 1};
+                        dp += {isecs[rid].dist, isecs[rid].dist,
+                            isecs[rid].dist, 1};
+                        iid = (float)isecs[rid].iid;
+                    } else {
+                        iid = -1;
+                    }
+                }
                 bool hit = false;
-                auto l = shade(scn, ray, smp, params, hit);
+                auto l = shade(scn, ray, isecs[rid], smp, params, hit);
                 if (!hit && params.envmap_invisible) continue;
                 if (!isfinite(l.x) || !isfinite(l.y) || !isfinite(l.z)) {
                     log_error("NaN detected");
@@ -1959,6 +3221,295 @@ inline void trace_block(const scene* scn, image4f& img, const vec2i& block_min,
             } else {
                 img[{i, j}] = lp / (float)samples_max;
             }
+            if (aovs) {
+                if (samples_min) {
+                    auto w = (float)samples_min;
+                    aovs->albedo[{i, j}] =
+                        (aovs->albedo[{i, j}] * w + ap) / (float)samples_max;
+                    aovs->norm[{i, j}] =
+                        (aovs->norm[{i, j}] * w + np) / (float)samples_max;
+                    aovs->depth[{i, j}] =
+                        (aovs->depth[{i, j}] * w + dp) / (float)samples_max;
+                } else {
+                    aovs->albedo[{i, j}] = ap / (float)samples_max;
+                    aovs->norm[{i, j}] = np / (float)samples_max;
+                    aovs->depth[{i, j}] = dp / (float)samples_max;
+                }
+                aovs->id[{i, j}] = {iid, iid, iid, 1};
+            }
+        }
+    }
+}
+
+// Trace a block of samples with a given generator, specializing the
+// kernel for the shaders that draw samples in their inner loop.
+template <trace_rng_type Rtype>
+inline void trace_block_r(const scene* scn, image4f& img, trace_aovs* aovs,
+    const vec2i& block_min, const vec2i& block_max, int samples_min,
+    int samples_max, vector<rng_pcg32>& rngs, const trace_params& params) {
+    switch (params.stype) {
+        case trace_shader_type::pathtrace:
+            return trace_block_t<eval_li_pathtrace<Rtype>, Rtype>(scn, img,
+                aovs, block_min, block_max, samples_min, samples_max, rngs,
+                params);
+        case trace_shader_type::direct:
+            return trace_block_t<eval_li_direct<Rtype>, Rtype>(scn, img, aovs,
+                block_min, block_max, samples_min, samples_max, rngs, params);
+        case trace_shader_type::eyelight:
+            return trace_block_t<eval_li_eyelight, Rtype>(scn, img, aovs,
+                block_min, block_max, samples_min, samples_max, rngs, params);
+        default:
+            return trace_block_t<nullptr, Rtype>(scn, img, aovs, block_min,
+                block_max, samples_min, samples_max, rngs, params);
+    }
+}
+
+// Trace a block of samples, selecting the specialized kernel once per
+// block. Public API, see above.
+inline void trace_block(const scene* scn, image4f& img, trace_aovs* aovs,
+    const vec2i& block_min, const vec2i& block_max, int samples_min,
+    int samples_max, vector<rng_pcg32>& rngs, const trace_params& params) {
+    switch (params.rtype) {
+        case trace_rng_type::uniform:
+            return trace_block_r<trace_rng_type::uniform>(scn, img, aovs,
+                block_min, block_max, samples_min, samples_max, rngs, params);
+        case trace_rng_type::stratified:
+            return trace_block_r<trace_rng_type::stratified>(scn, img, aovs,
+                block_min, block_max, samples_min, samples_max, rngs, params);
+        case trace_rng_type::sobol:
+            return trace_block_r<trace_rng_type::sobol>(scn, img, aovs,
+                block_min, block_max, samples_min, samples_max, rngs, params);
+        case trace_rng_type::bluenoise:
+            return trace_block_r<trace_rng_type::bluenoise>(scn, img, aovs,
+                block_min, block_max, samples_min, samples_max, rngs, params);
+        default: assert(false);
+    }
+}
+
+// Renders a block of samples with wavefront (breadth-first) path tracing.
+// Instead of following each sample depth-first through its whole bounce
+// chain, the entire batch of paths advances one bounce at a time, with
+// intersection, light sampling and bsdf evaluation run as separate bulk
+// stages over per-path state arrays. Rays of a stage are intersected as
+// one stream, so coherence survives past the first bounce. Per-path
+// sample draws happen in the same order as eval_li_pathtrace(); only the
+// interleaving of the shared per-pixel rng across samples differs, so
+// images match the recursive tracer statistically but not bit-for-bit.
+inline void trace_wavefront_block(const scene* scn, image4f& img,
+    trace_aovs* aovs, const vec2i& block_min, const vec2i& block_max,
+    int samples_min, int samples_max, vector<rng_pcg32>& rngs,
+    const trace_params& params) {
+    auto cam = scn->cameras[params.camera_id];
+    auto npaths = (block_max.x - block_min.x) * (block_max.y - block_min.y) *
+                  (samples_max - samples_min);
+    YGL_STAT(samples, npaths);
+
+    // per-path state, kept as parallel arrays so each stage runs as a
+    // bulk loop over the batch
+    auto smps = vector<sampler>();
+    auto pts = vector<point>(npaths);
+    auto weights = vector<vec3f>(npaths, {1, 1, 1});
+    auto radiance = vector<vec3f>(npaths, zero3f);
+    auto hits = vector<char>(npaths, 0);
+    auto alive = vector<int>();
+    smps.reserve(npaths);
+    alive.reserve(npaths);
+
+    // stage: generate all camera rays for the batch
+    auto rays = vector<ray3f>();
+    rays.reserve(npaths);
+    for (auto j = block_min.y; j < block_max.y; j++) {
+        for (auto i = block_min.x; i < block_max.x; i++) {
+            for (auto s = samples_min; s < samples_max; s++) {
+                auto smp = make_sampler(rngs[j * params.width + i], i, j, s,
+                    params.nsamples, params.rtype);
+                auto rn = sample_next2f(smp);
+                auto uv = vec2f{
+                    (i + rn.x) / params.width, 1 - (j + rn.y) / params.height};
+                rays.push_back(eval_camera(cam, uv, sample_next2f(smp)));
+                smps.push_back(smp);
+            }
+        }
+    }
+
+    // stage: intersect the camera rays as one stream and resolve points,
+    // capturing the feature values before the paths advance
+    auto spread = eval_camera_spread(scn, params);
+    auto isecs = intersect_ray_stream(scn, rays, false);
+    auto aalbedo = vector<vec4f>();
+    auto anorm = vector<vec4f>();
+    auto adepth = vector<vec4f>();
+    auto aid = vector<float>();
+    if (aovs) {
+        aalbedo.resize(npaths, zero4f);
+        anorm.resize(npaths, zero4f);
+        adepth.resize(npaths, zero4f);
+        aid.resize(npaths, -1);
+    }
+    for (auto id = 0; id < npaths; id++) {
+        pts[id] = eval_point(
+            scn, isecs[id], -rays[id].d, spread * isecs[id].dist);
+        hits[id] = (bool)pts[id].ist;
+        radiance[id] = eval_emission(pts[id]);
+        if (pts[id].fr && !scn->lights.empty()) alive.push_back(id);
+        if (aovs && isecs[id]) {
+            aalbedo[id] = {pts[id].fr.rho(), 1};
+            anorm[id] = {pts[id].frame.z, 1};
+            adepth[id] = {
+                isecs[id].dist, isecs[id].dist, isecs[id].dist, 1};
+            aid[id] = (float)isecs[id].iid;
+        }
+    }
+
+    // advance all paths one bounce at a time
+    auto lpts = vector<point>();
+    auto llds = vector<vec3f>();
+    auto shadow_rays = vector<ray3f>();
+    auto shadow_ids = vector<int>();
+    auto next_alive = vector<int>();
+    for (auto bounce = 0; bounce < params.max_depth && !alive.empty();
+         bounce++) {
+        // stage: sample a light on every active path
+        lpts.clear();
+        llds.clear();
+        for (auto id : alive) {
+            auto& pt = pts[id];
+            auto& smp = smps[id];
+            auto lsel = sample_light_tree(scn->ltree, pt, sample_next1f(smp));
+            auto lgt = scn->lights[lsel.first];
+            auto lpt =
+                sample_light(lgt, pt, sample_next1f(smp), sample_next2f(smp));
+            auto lw = weight_light(lpt, pt) / lsel.second;
+            auto lld = eval_emission(lpt) * eval_brdfcos(pt, -lpt.wo) * lw;
+            if (lld != zero3f)
+                lld *= weight_mis(lw, weight_brdfcos(pt, -lpt.wo));
+            lpts.push_back(lpt);
+            llds.push_back(lld);
+        }
+
+        // stage: resolve shadows in bulk when transmission is off, else
+        // walk the transmission chain per path
+        if (params.shadow_notransmission) {
+            shadow_rays.clear();
+            shadow_ids.clear();
+            for (auto k = 0; k < (int)alive.size(); k++) {
+                if (llds[k] == zero3f) continue;
+                shadow_rays.push_back(
+                    offset_ray(pts[alive[k]], lpts[k], params));
+                shadow_ids.push_back(k);
+            }
+            auto occluded = intersect_shadow_rays(scn, shadow_rays);
+            for (auto o = 0; o < (int)shadow_ids.size(); o++) {
+                if (occluded[o]) continue;
+                auto k = shadow_ids[o];
+                radiance[alive[k]] += weights[alive[k]] * llds[k];
+            }
+        } else {
+            for (auto k = 0; k < (int)alive.size(); k++) {
+                if (llds[k] == zero3f) continue;
+                auto id = alive[k];
+                radiance[id] += weights[id] * llds[k] *
+                                eval_transmission(scn, pts[id], lpts[k], params);
+            }
+        }
+
+        // stage: sample the bsdf on every active path
+        rays.clear();
+        for (auto id : alive) {
+            auto& smp = smps[id];
+            rays.push_back(offset_ray(pts[id],
+                sample_brdfcos(pts[id], sample_next1f(smp), sample_next2f(smp)),
+                params));
+        }
+
+        // stage: intersect the bounce rays as one stream
+        isecs = intersect_ray_stream(scn, rays, false);
+
+        // stage: accumulate the bsdf-sampled direct term and continue or
+        // terminate each path
+        next_alive.clear();
+        for (auto k = 0; k < (int)alive.size(); k++) {
+            auto id = alive[k];
+            auto& pt = pts[id];
+            auto bpt = eval_point(scn, isecs[k], -rays[k].d,
+                pt.footprint + spread * isecs[k].dist);
+            auto bw = weight_brdfcos(pt, -bpt.wo);
+            auto bld = eval_emission(bpt) * eval_brdfcos(pt, -bpt.wo) * bw;
+            if (bld != zero3f) {
+                radiance[id] +=
+                    weights[id] * bld *
+                    weight_mis(bw, weight_light(bpt, pt) /
+                                       pdf_light_tree(scn->ltree, pt,
+                                           light_tree_id(scn->ltree, bpt)));
+            }
+
+            // skip recursion if path ends
+            if (bounce == params.max_depth - 1) continue;
+            if (!bpt.fr) continue;
+
+            // continue path
+            weights[id] *= eval_brdfcos(pt, -bpt.wo) * weight_brdfcos(pt, -bpt.wo);
+            if (weights[id] == zero3f) continue;
+
+            // roussian roulette
+            if (bounce > 2) {
+                auto rrprob =
+                    1.0f - min(max_element(pt.fr.rho()).second, 0.95f);
+                if (sample_next1f(smps[id]) < rrprob) continue;
+                weights[id] *= 1 / (1 - rrprob);
+            }
+
+            pts[id] = bpt;
+            next_alive.push_back(id);
+        }
+        alive.swap(next_alive);
+    }
+
+    // accumulate into the image exactly as trace_block() does
+    auto rid = 0;
+    for (auto j = block_min.y; j < block_max.y; j++) {
+        for (auto i = block_min.x; i < block_max.x; i++) {
+            auto lp = zero4f;
+            auto ap = zero4f, np = zero4f, dp = zero4f;
+            auto iid = -1.0f;
+            for (auto s = samples_min; s < samples_max; s++, rid++) {
+                auto l = radiance[rid];
+                if (aovs) {
+                    ap += aalbedo[rid];
+                    np += anorm[rid];
+                    dp += adepth[rid];
+                    iid = aid[rid];
+                }
+                if (!hits[rid] && params.envmap_invisible) continue;
+                if (!isfinite(l.x) || !isfinite(l.y) || !isfinite(l.z)) {
+                    log_error("NaN detected");
+                    continue;
+                }
+                if (params.pixel_clamp > 0) l = clamplen(l, params.pixel_clamp);
+                lp += {l, 1};
+            }
+            if (samples_min) {
+                img[{i, j}] = (img[{i, j}] * (float)samples_min + lp) /
+                              (float)samples_max;
+            } else {
+                img[{i, j}] = lp / (float)samples_max;
+            }
+            if (aovs) {
+                if (samples_min) {
+                    auto w = (float)samples_min;
+                    aovs->albedo[{i, j}] =
+                        (aovs->albedo[{i, j}] * w + ap) / (float)samples_max;
+                    aovs->norm[{i, j}] =
+                        (aovs->norm[{i, j}] * w + np) / (float)samples_max;
+                    aovs->depth[{i, j}] =
+                        (aovs->depth[{i, j}] * w + dp) / (float)samples_max;
+                } else {
+                    aovs->albedo[{i, j}] = ap / (float)samples_max;
+                    aovs->norm[{i, j}] = np / (float)samples_max;
+                    aovs->depth[{i, j}] = dp / (float)samples_max;
+                }
+                aovs->id[{i, j}] = {iid, iid, iid, 1};
+            }
         }
     }
 }
@@ -1970,6 +3521,9 @@ inline void trace_block_filtered(const scene* scn, image4f& img, image4f& acc,
     std::mutex& image_mutex, const trace_params& params) {
     auto shade = get_shader(params);
     auto cam = scn->cameras[params.camera_id];
+    YGL_STAT(samples, (uint64_t)(block_max.x - block_min.x) *
+                          (block_max.y - block_min.y) *
+                          (samples_max - samples_min));
     auto filter = get_filter(params);
     auto filter_size = get_filter_size(params);
     static constexpr const int pad = 2;
@@ -1988,7 +3542,8 @@ inline void trace_block_filtered(const scene* scn, image4f& img, image4f& acc,
                     (i + rn.x) / params.width, 1 - (j + rn.y) / params.height};
                 auto ray = eval_camera(cam, uv, sample_next2f(smp));
                 auto hit = false;
-                auto l = shade(scn, ray, smp, params, hit);
+                auto l = shade(
+                    scn, ray, intersect_ray(scn, ray, false), smp, params, hit);
                 if (!hit && params.envmap_invisible) continue;
                 if (!isfinite(l.x) || !isfinite(l.y) || !isfinite(l.z)) {
                     log_error("NaN detected");
@@ -2040,14 +3595,283 @@ inline void trace_block_filtered(const scene* scn, image4f& img, image4f& acc,
     }
 }
 
+// Convergence test for adaptive sampling: a pixel is converged once the
+// 95% confidence half-width of its mean luminance falls under the
+// threshold, taken relative to the pixel brightness so dark pixels do not
+// stop prematurely in absolute terms.
+inline bool pixel_converged(
+    const vec4f& acc, const vec4f& var, const trace_params& params) {
+    auto n = (int)var.y;
+    if (n < params.adaptive_min_samples) return false;
+    auto mean_lum = (acc.x + acc.y + acc.z) / (3 * n);
+    auto var_lum = max(0.0f, var.x / n - mean_lum * mean_lum) * n / (n - 1);
+    auto ci = 1.96f * sqrt(var_lum / n);
+    return ci <= params.adaptive_threshold * max(mean_lum, 0.01f);
+}
+
+// Renders a block of adaptive samples. The block budget is the number of
+// block pixels times the batch size; it is split evenly among the pixels
+// that have not converged yet, capped at params.nsamples per pixel so the
+// stratified sampler stays well defined.
+inline void trace_adaptive_block(const scene* scn, image4f& img, image4f& acc,
+    image4f& var, const vec2i& block_min, const vec2i& block_max,
+    int samples_min, int samples_max, vector<rng_pcg32>& rngs,
+    const trace_params& params) {
+    auto shade = get_shader(params);
+    auto cam = scn->cameras[params.camera_id];
+
+    // find the pixels that still need samples
+    auto pixels = vector<vec2i>();
+    for (auto j = block_min.y; j < block_max.y; j++) {
+        for (auto i = block_min.x; i < block_max.x; i++) {
+            if ((int)var[{i, j}].y >= params.nsamples) continue;
+            if (pixel_converged(acc[{i, j}], var[{i, j}], params)) continue;
+            pixels.push_back({i, j});
+        }
+    }
+    if (pixels.empty()) return;
+
+    // reallocate the block budget to the unconverged pixels
+    auto npixels = (block_max.x - block_min.x) * (block_max.y - block_min.y);
+    auto budget = npixels * (samples_max - samples_min);
+    auto share = max(budget / (int)pixels.size(), 1);
+
+    // generate the primary rays for the batch up front, so they can be
+    // intersected as one coherent stream
+    auto rays = vector<ray3f>();
+    auto smps = vector<sampler>();
+    auto counts = vector<int>(pixels.size());
+    for (auto p = 0; p < (int)pixels.size(); p++) {
+        auto i = pixels[p].x, j = pixels[p].y;
+        auto taken = (int)var[{i, j}].y;
+        counts[p] = min(share, params.nsamples - taken);
+        for (auto s = taken; s < taken + counts[p]; s++) {
+            auto smp = make_sampler(rngs[j * params.width + i], i, j, s,
+                params.nsamples, params.rtype);
+            auto rn = sample_next2f(smp);
+            auto uv = vec2f{
+                (i + rn.x) / params.width, 1 - (j + rn.y) / params.height};
+            rays.push_back(eval_camera(cam, uv, sample_next2f(smp)));
+            smps.push_back(smp);
+        }
+    }
+
+    YGL_STAT(samples, rays.size());
+
+    // intersect the primary rays as a stream
+    auto isecs = intersect_ray_stream(scn, rays, false);
+
+    // shade and update the per-pixel statistics
+    auto rid = 0;
+    for (auto p = 0; p < (int)pixels.size(); p++) {
+        auto i = pixels[p].x, j = pixels[p].y;
+        auto lp = zero4f;
+        auto lum2 = 0.0f;
+        for (auto s = 0; s < counts[p]; s++, rid++) {
+            auto& smp = smps[rid];
+            auto& ray = rays[rid];
+            bool hit = false;
+            auto l = shade(scn, ray, isecs[rid], smp, params, hit);
+            if (!hit && params.envmap_invisible) continue;
+            if (!isfinite(l.x) || !isfinite(l.y) || !isfinite(l.z)) {
+                log_error("NaN detected");
+                continue;
+            }
+            if (params.pixel_clamp > 0) l = clamplen(l, params.pixel_clamp);
+            lp += {l, 1};
+            auto lum = (l.x + l.y + l.z) / 3;
+            lum2 += lum * lum;
+        }
+        acc[{i, j}] += lp;
+        var[{i, j}].x += lum2;
+        var[{i, j}].y += counts[p];
+        img[{i, j}] = acc[{i, j}] / var[{i, j}].y;
+    }
+}
+
+// Minimum tile edge the scheduler will split down to.
+const int trace_min_tile_size = 8;
+
+// Shared tile queue for dynamic scheduling. Static block assignment makes
+// cores idle at the end of each sample batch while the last worker
+// finishes a heavy tile (light fixtures, glass), so workers instead pull
+// tiles from this queue; when it runs low, the next tile is split along
+// its longest axis before being claimed, sharing the remaining heavy
+// regions among the idle workers. Since rngs are per-pixel, tracing a
+// tile in pieces is identical to tracing it whole.
+struct trace_tile_queue {
+    std::mutex lock;
+    std::deque<pair<vec2i, vec2i>> tiles;
+    // tiles queued or being traced; used to fire per-sample callbacks
+    std::atomic<int> pending;
+    // remaining split budget, which bounds the number of extra tiles
+    std::atomic<int> splits_left;
+
+    trace_tile_queue(const vector<pair<vec2i, vec2i>>& blocks, int max_splits)
+        : tiles(blocks.begin(), blocks.end())
+        , pending((int)blocks.size())
+        , splits_left(max_splits) {}
+};
+
+// Claims the next tile from the queue, subdividing when work is scarce.
+// Returns whether a tile was claimed.
+bool next_trace_tile(
+    trace_tile_queue& queue, int nworkers, vec2i& tile_min, vec2i& tile_max) {
+    std::unique_lock<std::mutex> lock_guard(queue.lock);
+    if (queue.tiles.empty()) return false;
+    while ((int)queue.tiles.size() < nworkers && queue.splits_left > 0) {
+        auto tile = queue.tiles.front();
+        auto size = tile.second - tile.first;
+        if (max(size.x, size.y) < trace_min_tile_size * 2) break;
+        queue.tiles.pop_front();
+        auto mid = tile.first;
+        if (size.x >= size.y) {
+            mid.x += size.x / 2;
+            queue.tiles.push_front({{mid.x, tile.first.y}, tile.second});
+            queue.tiles.push_front({tile.first, {mid.x, tile.second.y}});
+        } else {
+            mid.y += size.y / 2;
+            queue.tiles.push_front({{tile.first.x, mid.y}, tile.second});
+            queue.tiles.push_front({tile.first, {tile.second.x, mid.y}});
+        }
+        queue.pending++;
+        queue.splits_left--;
+    }
+    tile_min = queue.tiles.front().first;
+    tile_max = queue.tiles.front().second;
+    queue.tiles.pop_front();
+    return true;
+}
+
+// Checkpoint file tag and layout version.
+const char* trace_checkpoint_magic = "YCKP";
+const int trace_checkpoint_version = 1;
+
+// Writes one image as raw pixels.
+inline void write_checkpoint_image(FILE* f, const image4f& img) {
+    fwrite(img.data(), sizeof(vec4f), img.width() * img.height(), f);
+}
+
+// Reads raw pixels into an image sized by the caller.
+inline bool read_checkpoint_image(FILE* f, image4f& img) {
+    return fread(img.data(), sizeof(vec4f), img.width() * img.height(), f) ==
+           (size_t)(img.width() * img.height());
+}
+
+// Saves the render state to a checkpoint file. See the public docs.
+bool save_trace_checkpoint(const string& filename, const image4f& img,
+    const trace_aovs* aovs, const vector<rng_pcg32>& rngs, int nsamples,
+    const trace_params& params) {
+    // write a sidecar and rename it over the checkpoint, so a preemption
+    // mid-write cannot clobber the previous checkpoint
+    auto tmpname = filename + ".tmp";
+    auto f = fopen(tmpname.c_str(), "wb");
+    if (!f) return false;
+    fwrite(trace_checkpoint_magic, 1, 4, f);
+    fwrite(&trace_checkpoint_version, sizeof(int), 1, f);
+    fwrite(&params.width, sizeof(int), 1, f);
+    fwrite(&params.height, sizeof(int), 1, f);
+    fwrite(&params.seed, sizeof(uint32_t), 1, f);
+    fwrite(&nsamples, sizeof(int), 1, f);
+    auto naovs = (aovs) ? 4 : 0;
+    fwrite(&naovs, sizeof(int), 1, f);
+    write_checkpoint_image(f, img);
+    if (aovs) {
+        write_checkpoint_image(f, aovs->albedo);
+        write_checkpoint_image(f, aovs->norm);
+        write_checkpoint_image(f, aovs->depth);
+        write_checkpoint_image(f, aovs->id);
+    }
+    auto nrngs = (int)rngs.size();
+    fwrite(&nrngs, sizeof(int), 1, f);
+    fwrite(rngs.data(), sizeof(rng_pcg32), nrngs, f);
+    fclose(f);
+    return rename(tmpname.c_str(), filename.c_str()) == 0;
+}
+
+// Loads the render state from a checkpoint file. See the public docs.
+bool load_trace_checkpoint(const string& filename, image4f& img,
+    trace_aovs* aovs, vector<rng_pcg32>& rngs, int& nsamples,
+    const trace_params& params) {
+    auto f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+
+    // validate the header against the current render settings
+    char magic[4];
+    auto version = 0, width = 0, height = 0, saved = 0, naovs = 0;
+    auto seed = (uint32_t)0;
+    auto ok = fread(magic, 1, 4, f) == 4 &&
+              !memcmp(magic, trace_checkpoint_magic, 4);
+    ok = ok && fread(&version, sizeof(int), 1, f) == 1 &&
+         version == trace_checkpoint_version;
+    ok = ok && fread(&width, sizeof(int), 1, f) == 1 && width == params.width;
+    ok = ok && fread(&height, sizeof(int), 1, f) == 1 &&
+         height == params.height;
+    ok = ok && fread(&seed, sizeof(uint32_t), 1, f) == 1 &&
+         seed == params.seed;
+    ok = ok && fread(&saved, sizeof(int), 1, f) == 1 && saved > 0;
+    ok = ok && fread(&naovs, sizeof(int), 1, f) == 1 &&
+         naovs == ((aovs) ? 4 : 0);
+    if (!ok) {
+        fclose(f);
+        return false;
+    }
+
+    // read the whole state before touching the outputs
+    auto timg = image4f(width, height);
+    auto taovs = trace_aovs();
+    ok = read_checkpoint_image(f, timg);
+    if (ok && aovs) {
+        taovs.albedo = image4f(width, height);
+        taovs.norm = image4f(width, height);
+        taovs.depth = image4f(width, height);
+        taovs.id = image4f(width, height);
+        ok = ok && read_checkpoint_image(f, taovs.albedo);
+        ok = ok && read_checkpoint_image(f, taovs.norm);
+        ok = ok && read_checkpoint_image(f, taovs.depth);
+        ok = ok && read_checkpoint_image(f, taovs.id);
+    }
+    auto nrngs = 0;
+    ok = ok && fread(&nrngs, sizeof(int), 1, f) == 1 && nrngs == width * height;
+    auto trngs = vector<rng_pcg32>(max(nrngs, 0));
+    ok = ok && fread(trngs.data(), sizeof(rng_pcg32), nrngs, f) ==
+                   (size_t)nrngs;
+    fclose(f);
+    if (!ok) return false;
+
+    img = timg;
+    if (aovs) *aovs = taovs;
+    rngs = trngs;
+    nsamples = saved;
+    return true;
+}
+
 }  // namespace _impl_trace
 
 // Renders a block of samples
 void trace_block(const scene* scn, image4f& img, const vec2i& block_min,
     const vec2i& block_max, int samples_min, int samples_max,
     vector<rng_pcg32>& rngs, const trace_params& params) {
-    _impl_trace::trace_block(
-        scn, img, block_min, block_max, samples_min, samples_max, rngs, params);
+    if (params.wavefront && params.stype == trace_shader_type::pathtrace) {
+        _impl_trace::trace_wavefront_block(scn, img, nullptr, block_min,
+            block_max, samples_min, samples_max, rngs, params);
+    } else {
+        _impl_trace::trace_block(scn, img, nullptr, block_min, block_max,
+            samples_min, samples_max, rngs, params);
+    }
+}
+
+// Renders a block of samples with feature images
+void trace_block(const scene* scn, image4f& img, trace_aovs& aovs,
+    const vec2i& block_min, const vec2i& block_max, int samples_min,
+    int samples_max, vector<rng_pcg32>& rngs, const trace_params& params) {
+    if (params.wavefront && params.stype == trace_shader_type::pathtrace) {
+        _impl_trace::trace_wavefront_block(scn, img, &aovs, block_min,
+            block_max, samples_min, samples_max, rngs, params);
+    } else {
+        _impl_trace::trace_block(scn, img, &aovs, block_min, block_max,
+            samples_min, samples_max, rngs, params);
+    }
 }
 
 // Renders a filtered block of samples
@@ -2065,14 +3889,50 @@ void trace_samples(const scene* scn, image4f& img, int samples_min,
     int samples_max, vector<rng_pcg32>& rngs, const trace_params& params) {
     auto blocks = trace_blocks(params);
     if (params.parallel) {
-        parallel_for((int)blocks.size(), [&img, scn, samples_min, samples_max,
-                                             &blocks, &params, &rngs](int idx) {
+        // dynamic scheduling: workers pull and subdivide tiles from a
+        // shared queue instead of being statically assigned blocks
+        auto nworkers = (int)std::thread::hardware_concurrency();
+        _impl_trace::trace_tile_queue queue(blocks, int_max);
+        parallel_for(nworkers, [&img, scn, samples_min, samples_max, &queue,
+                                   nworkers, &params, &rngs](int) {
+            auto tile_min = zero2i, tile_max = zero2i;
+            while (_impl_trace::next_trace_tile(
+                queue, nworkers, tile_min, tile_max)) {
+                trace_block(scn, img, tile_min, tile_max, samples_min,
+                    samples_max, rngs, params);
+            }
+        });
+    } else {
+        for (auto idx = 0; idx < (int)blocks.size(); idx++) {
             trace_block(scn, img, blocks[idx].first, blocks[idx].second,
                 samples_min, samples_max, rngs, params);
+        }
+    }
+}
+
+// Trace the next samples in [samples_min, samples_max) range, filling
+// the feature images in the same pass.
+void trace_samples(const scene* scn, image4f& img, trace_aovs& aovs,
+    int samples_min, int samples_max, vector<rng_pcg32>& rngs,
+    const trace_params& params) {
+    auto blocks = trace_blocks(params);
+    if (params.parallel) {
+        // dynamic scheduling: workers pull and subdivide tiles from a
+        // shared queue instead of being statically assigned blocks
+        auto nworkers = (int)std::thread::hardware_concurrency();
+        _impl_trace::trace_tile_queue queue(blocks, int_max);
+        parallel_for(nworkers, [&img, &aovs, scn, samples_min, samples_max,
+                                   &queue, nworkers, &params, &rngs](int) {
+            auto tile_min = zero2i, tile_max = zero2i;
+            while (_impl_trace::next_trace_tile(
+                queue, nworkers, tile_min, tile_max)) {
+                trace_block(scn, img, aovs, tile_min, tile_max, samples_min,
+                    samples_max, rngs, params);
+            }
         });
     } else {
         for (auto idx = 0; idx < (int)blocks.size(); idx++) {
-            trace_block(scn, img, blocks[idx].first, blocks[idx].second,
+            trace_block(scn, img, aovs, blocks[idx].first, blocks[idx].second,
                 samples_min, samples_max, rngs, params);
         }
     }
@@ -2102,19 +3962,87 @@ void trace_filtered_samples(const scene* scn, image4f& img, image4f& acc,
     }
 }
 
+// Trace the next samples adaptively. Public API, see above.
+void trace_adaptive_samples(const scene* scn, image4f& img, image4f& acc,
+    image4f& var, int samples_min, int samples_max, vector<rng_pcg32>& rngs,
+    const trace_params& params) {
+    auto blocks = trace_blocks(params);
+    if (params.parallel) {
+        auto nworkers = (int)std::thread::hardware_concurrency();
+        _impl_trace::trace_tile_queue queue(blocks, int_max);
+        parallel_for(nworkers, [&img, &acc, &var, scn, samples_min,
+                                   samples_max, &queue, nworkers, &params,
+                                   &rngs](int) {
+            auto tile_min = zero2i, tile_max = zero2i;
+            while (_impl_trace::next_trace_tile(
+                queue, nworkers, tile_min, tile_max)) {
+                _impl_trace::trace_adaptive_block(scn, img, acc, var, tile_min,
+                    tile_max, samples_min, samples_max, rngs, params);
+            }
+        });
+    } else {
+        for (auto idx = 0; idx < (int)blocks.size(); idx++) {
+            _impl_trace::trace_adaptive_block(scn, img, acc, var,
+                blocks[idx].first, blocks[idx].second, samples_min, samples_max,
+                rngs, params);
+        }
+    }
+}
+
+// Saves the render state to a checkpoint file. Public API, see above.
+bool save_trace_checkpoint(const string& filename, const image4f& img,
+    const vector<rng_pcg32>& rngs, int nsamples, const trace_params& params) {
+    return _impl_trace::save_trace_checkpoint(
+        filename, img, nullptr, rngs, nsamples, params);
+}
+
+// Saves the render state with feature images. Public API, see above.
+bool save_trace_checkpoint(const string& filename, const image4f& img,
+    const trace_aovs& aovs, const vector<rng_pcg32>& rngs, int nsamples,
+    const trace_params& params) {
+    return _impl_trace::save_trace_checkpoint(
+        filename, img, &aovs, rngs, nsamples, params);
+}
+
+// Loads the render state from a checkpoint file. Public API, see above.
+bool load_trace_checkpoint(const string& filename, image4f& img,
+    vector<rng_pcg32>& rngs, int& nsamples, const trace_params& params) {
+    return _impl_trace::load_trace_checkpoint(
+        filename, img, nullptr, rngs, nsamples, params);
+}
+
+// Loads the render state with feature images. Public API, see above.
+bool load_trace_checkpoint(const string& filename, image4f& img,
+    trace_aovs& aovs, vector<rng_pcg32>& rngs, int& nsamples,
+    const trace_params& params) {
+    return _impl_trace::load_trace_checkpoint(
+        filename, img, &aovs, rngs, nsamples, params);
+}
+
 // Starts an anyncrhounous renderer with a maximum of 256 samples.
 void trace_async_start(const scene* scn, image4f& img, vector<rng_pcg32>& rngs,
     const trace_params& params, thread_pool* pool,
     const function<void(int)>& callback) {
     auto blocks = trace_blocks(params);
+    auto nworkers = max(1, (int)pool->_threads.size());
     for (auto sample = 0; sample < params.nsamples; sample++) {
-        for (auto& block : blocks) {
-            auto is_last = (block == blocks.back());
-            run_async(pool, [&img, scn, sample, block, &params, callback, &rngs,
-                                is_last]() {
-                trace_block(scn, img, block.first, block.second, sample,
-                    sample + 1, rngs, params);
-                if (is_last) callback(sample);
+        // per-sample tile queue with a bounded split budget; tasks are
+        // tickets that each claim at most one tile, so clear_pool() keeps
+        // cancelling at tile granularity. Enough tickets are queued to
+        // cover every tile the splits can produce; the spares no-op.
+        auto max_splits = nworkers * 4;
+        auto queue = std::make_shared<_impl_trace::trace_tile_queue>(
+            blocks, max_splits);
+        for (auto t = 0; t < (int)blocks.size() + max_splits; t++) {
+            run_async(pool, [&img, scn, sample, queue, nworkers, &params,
+                                callback, &rngs]() {
+                auto tile_min = zero2i, tile_max = zero2i;
+                if (!_impl_trace::next_trace_tile(
+                        *queue, nworkers, tile_min, tile_max))
+                    return;
+                trace_block(scn, img, tile_min, tile_max, sample, sample + 1,
+                    rngs, params);
+                if (--queue->pending == 0) callback(sample);
             });
         }
     }
@@ -2339,6 +4267,7 @@ inline vector<obj_material*> load_mtl(
     }
 
     // remove first fake material
+    delete materials.front();
     materials.erase(materials.begin());
 
     // done
@@ -2390,150 +4319,409 @@ inline void parse_vertlist(
     }
 }
 
-// Loads an OBJ
-inline obj_scene* load_obj(const string& filename, bool load_txt,
-    bool skip_missing, bool flip_texcoord, bool flip_tr) {
-    // clear obj
-    auto asset = unique_ptr<obj_scene>(new obj_scene());
-
-    // open file
-    auto fs = fstream(filename, ios_base::in);
-    if (!fs) throw runtime_error("cannot open filename " + filename);
-    // fs.exceptions(ios_base::failbit);
-
-    // initializing obj
-    asset->objects.push_back(new obj_object());
-    asset->objects.back()->groups.push_back({});
-
-    // allocate buffers to avoid re-allocing
-    auto cur_elems = vector<obj_vertex>();
-    auto cur_matname = string();
-    auto cur_mtllibs = vector<string>();
-
-    // keep track of array lengths
-    auto vert_size = obj_vertex{0, 0, 0, 0, 0};
-
-    // read the file line by line
-    string line;
-    auto linenum = 0;
-    while (getline(fs, line)) {
-        // prepare to parse
-        linenum += 1;
-        auto ss = stringstream(line);
-        auto cmd = string();
-        ss >> cmd;
+// Skips spaces, tabs and carriage returns.
+inline const char* skip_ws_fast(const char* s, const char* end) {
+    while (s != end && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+    return s;
+}
+
+// Parses a whitespace-delimited token.
+inline const char* parse_token_fast(
+    const char* s, const char* end, string& tok) {
+    s = skip_ws_fast(s, end);
+    auto start = s;
+    while (s != end && *s != ' ' && *s != '\t' && *s != '\r') s++;
+    tok.assign(start, s);
+    return s;
+}
+
+// Parses an int with plain digit scanning.
+inline const char* parse_int_fast(const char* s, const char* end, int& val) {
+    s = skip_ws_fast(s, end);
+    auto sign = 1;
+    if (s != end && (*s == '-' || *s == '+')) {
+        if (*s == '-') sign = -1;
+        s++;
+    }
+    auto v = 0;
+    while (s != end && *s >= '0' && *s <= '9') v = v * 10 + (*s++ - '0');
+    val = sign * v;
+    return s;
+}
+
+// Parses a float with plain digit scanning. Sign, fraction and exponent
+// are all obj files ever contain, so the iostream machinery is skipped.
+inline const char* parse_float_fast(const char* s, const char* end, float& val) {
+    s = skip_ws_fast(s, end);
+    auto sign = 1.0;
+    if (s != end && (*s == '-' || *s == '+')) {
+        if (*s == '-') sign = -1;
+        s++;
+    }
+    auto v = 0.0;
+    while (s != end && *s >= '0' && *s <= '9') v = v * 10 + (*s++ - '0');
+    if (s != end && *s == '.') {
+        s++;
+        auto scale = 0.1;
+        while (s != end && *s >= '0' && *s <= '9') {
+            v += (*s++ - '0') * scale;
+            scale *= 0.1;
+        }
+    }
+    if (s != end && (*s == 'e' || *s == 'E')) {
+        s++;
+        auto esign = 1;
+        if (s != end && (*s == '-' || *s == '+')) {
+            if (*s == '-') esign = -1;
+            s++;
+        }
+        auto e = 0;
+        while (s != end && *s >= '0' && *s <= '9') e = e * 10 + (*s++ - '0');
+        v *= std::pow(10.0, (double)(esign * e));
+    }
+    val = (float)(sign * v);
+    return s;
+}
+
+// Parses a frame as 12 floats.
+inline const char* parse_frame_fast(
+    const char* s, const char* end, frame3f& val) {
+    for (auto i = 0; i < 3; i++) s = parse_float_fast(s, end, val.x[i]);
+    for (auto i = 0; i < 3; i++) s = parse_float_fast(s, end, val.y[i]);
+    for (auto i = 0; i < 3; i++) s = parse_float_fast(s, end, val.z[i]);
+    for (auto i = 0; i < 3; i++) s = parse_float_fast(s, end, val.o[i]);
+    return s;
+}
+
+// One chunk's worth of parsed OBJ data. Vertex data lands in chunk-local
+// arrays and elements keep their vertex lists in chunk-local order, with
+// the grouping commands recorded alongside so the merge can replay them
+// in file order.
+struct obj_chunk {
+    // vertex data
+    vector<vec3f> pos;
+    vector<vec3f> norm;
+    vector<vec2f> texcoord;
+    vector<vec4f> color;
+    vector<float> radius;
+    // elements, with start indexing into verts
+    vector<obj_element> elems;
+    vector<obj_vertex> verts;
+    // grouping command applied before the elem_pos-th element
+    struct directive {
+        int elem_pos;
+        char cmd;
+        string name;
+    };
+    vector<directive> directives;
+    // rare commands
+    vector<string> mtllibs;
+    vector<obj_camera*> cameras;
+    vector<obj_environment*> environments;
+    vector<obj_instance*> instances;
+};
 
-        // skip empty and comments
-        if (cmd.empty() || cmd[0] == '#') continue;
+// Relative obj indices are encoded as this base plus the chunk-local
+// index, which may itself be negative when a reference reaches back
+// before the chunk start. The band sits far below the -1 used for
+// missing attributes, so encoded values can never collide with absolute
+// indices (>= 0) or missing ones.
+const int obj_rel_index_base = -(1 << 30);
+
+// Parses one chunk of an OBJ file delimited at line boundaries. File
+// indices are made 0-based: positive indices are absolute and stored as
+// is, while relative (negative) ones depend on how many vertices precede
+// the chunk, so they are encoded against obj_rel_index_base and shifted
+// by the chunk bases during the merge.
+inline void parse_obj_chunk(
+    const char* s, const char* end, bool flip_texcoord, obj_chunk& chunk) {
+    auto name = string();
+    while (s != end) {
+        // grab a line
+        auto le = (const char*)memchr(s, '\n', end - s);
+        if (!le) le = end;
+        auto ls = s;
+        s = (le != end) ? le + 1 : end;
+
+        // command token
+        ls = skip_ws_fast(ls, le);
+        auto cs = ls;
+        while (ls != le && *ls != ' ' && *ls != '\t' && *ls != '\r') ls++;
+        auto cn = (size_t)(ls - cs);
+        if (!cn || *cs == '#') continue;
+        auto cmd_is = [cs, cn](const char* cmd) {
+            return strlen(cmd) == cn && !memcmp(cs, cmd, cn);
+        };
 
         // possible token values
-        if (cmd == "v") {
-            vert_size.pos += 1;
-            asset->pos.push_back({});
-            parse_val(ss, asset->pos.back());
-        } else if (cmd == "vn") {
-            vert_size.norm += 1;
-            asset->norm.push_back({});
-            parse_val(ss, asset->norm.back());
-        } else if (cmd == "vt") {
-            vert_size.texcoord += 1;
-            asset->texcoord.push_back({});
-            parse_val(ss, asset->texcoord.back());
-            if (flip_texcoord)
-                asset->texcoord.back().y = 1 - asset->texcoord.back().y;
-        } else if (cmd == "vc") {
-            vert_size.color += 1;
-            asset->color.push_back({});
-            parse_val(ss, asset->color.back());
-        } else if (cmd == "vr") {
-            vert_size.radius += 1;
-            asset->radius.push_back({});
-            parse_val(ss, asset->radius.back());
-        } else if (cmd == "f") {
-            parse_vertlist(ss, cur_elems, vert_size);
-            auto& g = asset->objects.back()->groups.back();
-            g.elems.push_back({(uint32_t)g.verts.size(), obj_element_type::face,
-                (uint16_t)cur_elems.size()});
-            g.verts.insert(g.verts.end(), cur_elems.begin(), cur_elems.end());
-        } else if (cmd == "l") {
-            parse_vertlist(ss, cur_elems, vert_size);
-            auto& g = asset->objects.back()->groups.back();
-            g.elems.push_back({(uint32_t)g.verts.size(), obj_element_type::line,
-                (uint16_t)cur_elems.size()});
-            g.verts.insert(g.verts.end(), cur_elems.begin(), cur_elems.end());
-        } else if (cmd == "p") {
-            parse_vertlist(ss, cur_elems, vert_size);
-            auto& g = asset->objects.back()->groups.back();
-            g.elems.push_back({(uint32_t)g.verts.size(),
-                obj_element_type::point, (uint16_t)cur_elems.size()});
-            g.verts.insert(g.verts.end(), cur_elems.begin(), cur_elems.end());
-        } else if (cmd == "t") {
-            parse_vertlist(ss, cur_elems, vert_size);
-            auto& g = asset->objects.back()->groups.back();
-            g.elems.push_back({(uint32_t)g.verts.size(),
-                obj_element_type::tetra, (uint16_t)cur_elems.size()});
-            g.verts.insert(g.verts.end(), cur_elems.begin(), cur_elems.end());
-        } else if (cmd == "o") {
-            auto name = string();
-            parse_val(ss, name);
-            asset->objects.push_back(new obj_object{name, {}});
-            asset->objects.back()->groups.push_back({cur_matname, ""});
-        } else if (cmd == "usemtl") {
-            auto name = string();
-            parse_val(ss, name);
-            cur_matname = name;
-            asset->objects.back()->groups.push_back({cur_matname, ""});
-        } else if (cmd == "g") {
-            auto name = string();
-            parse_val(ss, name);
-            asset->objects.back()->groups.push_back({cur_matname, name});
-        } else if (cmd == "s") {
-            auto name = string();
-            parse_val(ss, name);
-            auto smoothing = name == string("on");
-            if (asset->objects.back()->groups.back().smoothing != smoothing) {
-                asset->objects.back()->groups.push_back(
-                    {cur_matname, name, smoothing});
-            }
-        } else if (cmd == "mtllib") {
-            auto name = string();
-            parse_val(ss, name);
-            if (name != string("")) {
-                auto found = false;
-                for (auto lib : cur_mtllibs) {
-                    if (lib == name) {
-                        found = true;
+        if (cmd_is("v")) {
+            auto v = zero3f;
+            for (auto i = 0; i < 3; i++) ls = parse_float_fast(ls, le, v[i]);
+            chunk.pos.push_back(v);
+        } else if (cmd_is("vn")) {
+            auto v = zero3f;
+            for (auto i = 0; i < 3; i++) ls = parse_float_fast(ls, le, v[i]);
+            chunk.norm.push_back(v);
+        } else if (cmd_is("vt")) {
+            auto v = zero2f;
+            for (auto i = 0; i < 2; i++) ls = parse_float_fast(ls, le, v[i]);
+            if (flip_texcoord) v.y = 1 - v.y;
+            chunk.texcoord.push_back(v);
+        } else if (cmd_is("vc")) {
+            auto v = zero4f;
+            for (auto i = 0; i < 4; i++) ls = parse_float_fast(ls, le, v[i]);
+            chunk.color.push_back(v);
+        } else if (cmd_is("vr")) {
+            auto v = 0.0f;
+            ls = parse_float_fast(ls, le, v);
+            chunk.radius.push_back(v);
+        } else if (cmd_is("f") || cmd_is("l") || cmd_is("p") || cmd_is("t")) {
+            // local counts, in obj_vertex field order, for relative indices
+            const int counts[5] = {(int)chunk.pos.size(),
+                (int)chunk.texcoord.size(), (int)chunk.norm.size(),
+                (int)chunk.color.size(), (int)chunk.radius.size()};
+            auto nverts = 0;
+            while (true) {
+                ls = skip_ws_fast(ls, le);
+                if (ls == le) break;
+                auto vert = obj_vertex{-1, -1, -1, -1, -1};
+                for (auto i = 0; i < 5; i++) {
+                    auto sign = 1;
+                    if (ls != le && *ls == '-') {
+                        sign = -1;
+                        ls++;
+                    }
+                    auto v = 0;
+                    auto digits = false;
+                    while (ls != le && *ls >= '0' && *ls <= '9') {
+                        v = v * 10 + (*ls++ - '0');
+                        digits = true;
+                    }
+                    if (digits) {
+                        v *= sign;
+                        ((int*)&vert)[i] =
+                            (v > 0) ?
+                                v - 1 :
+                                ((v < 0) ?
+                                        obj_rel_index_base + counts[i] + v :
+                                        -1);
+                    }
+                    if (ls != le && *ls == '/') {
+                        ls++;
+                    } else {
                         break;
                     }
                 }
-                if (!found) cur_mtllibs.push_back(name);
+                // skip anything left in the token
+                while (ls != le && *ls != ' ' && *ls != '\t' && *ls != '\r')
+                    ls++;
+                chunk.verts.push_back(vert);
+                nverts++;
             }
-        } else if (cmd == "c") {
+            auto type = obj_element_type::face;
+            if (*cs == 'l') type = obj_element_type::line;
+            if (*cs == 'p') type = obj_element_type::point;
+            if (*cs == 't') type = obj_element_type::tetra;
+            chunk.elems.push_back({(uint32_t)(chunk.verts.size() - nverts),
+                type, (uint16_t)nverts});
+        } else if (cmd_is("o") || cmd_is("usemtl") || cmd_is("g") ||
+                   cmd_is("s")) {
+            ls = parse_token_fast(ls, le, name);
+            chunk.directives.push_back(
+                {(int)chunk.elems.size(), (*cs == 'u') ? 'u' : *cs, name});
+        } else if (cmd_is("mtllib")) {
+            ls = parse_token_fast(ls, le, name);
+            if (name != "") chunk.mtllibs.push_back(name);
+        } else if (cmd_is("c")) {
             auto cam = new obj_camera();
-            parse_val(ss, cam->name);
-            parse_val(ss, cam->ortho);
-            parse_val(ss, cam->yfov);
-            parse_val(ss, cam->aspect);
-            parse_val(ss, cam->aperture);
-            parse_val(ss, cam->focus);
-            parse_val(ss, cam->frame);
-            asset->cameras.push_back(cam);
-        } else if (cmd == "e") {
+            ls = parse_token_fast(ls, le, cam->name);
+            auto ortho = 0;
+            ls = parse_int_fast(ls, le, ortho);
+            cam->ortho = (bool)ortho;
+            ls = parse_float_fast(ls, le, cam->yfov);
+            ls = parse_float_fast(ls, le, cam->aspect);
+            ls = parse_float_fast(ls, le, cam->aperture);
+            ls = parse_float_fast(ls, le, cam->focus);
+            ls = parse_frame_fast(ls, le, cam->frame);
+            chunk.cameras.push_back(cam);
+        } else if (cmd_is("e")) {
             auto env = new obj_environment();
-            parse_val(ss, env->name);
-            parse_val(ss, env->matname);
-            parse_val(ss, env->frame);
-            asset->environments.push_back(env);
-        } else if (cmd == "i") {
+            ls = parse_token_fast(ls, le, env->name);
+            ls = parse_token_fast(ls, le, env->matname);
+            ls = parse_frame_fast(ls, le, env->frame);
+            chunk.environments.push_back(env);
+        } else if (cmd_is("i")) {
             auto ist = new obj_instance();
-            parse_val(ss, ist->name);
-            parse_val(ss, ist->objname);
-            parse_val(ss, ist->frame);
-            asset->instances.push_back(ist);
+            ls = parse_token_fast(ls, le, ist->name);
+            ls = parse_token_fast(ls, le, ist->objname);
+            ls = parse_frame_fast(ls, le, ist->frame);
+            chunk.instances.push_back(ist);
         } else {
             // unused
         }
     }
+}
+
+// Merges the chunk results into the scene in file order, replaying the
+// grouping commands with the same state handling as a serial parse.
+inline void merge_obj_chunks(
+    obj_scene* asset, vector<obj_chunk>& chunks, vector<string>& mtllibs) {
+    auto cur_matname = string();
+    for (auto& chunk : chunks) {
+        // shift relative indices by the vertex counts seen so far
+        const int bases[5] = {(int)asset->pos.size(),
+            (int)asset->texcoord.size(), (int)asset->norm.size(),
+            (int)asset->color.size(), (int)asset->radius.size()};
+        for (auto& vert : chunk.verts) {
+            for (auto i = 0; i < 5; i++) {
+                auto& v = ((int*)&vert)[i];
+                if (v < -1) v = bases[i] + (v - obj_rel_index_base);
+            }
+        }
+        asset->pos.insert(asset->pos.end(), chunk.pos.begin(), chunk.pos.end());
+        asset->norm.insert(
+            asset->norm.end(), chunk.norm.begin(), chunk.norm.end());
+        asset->texcoord.insert(asset->texcoord.end(), chunk.texcoord.begin(),
+            chunk.texcoord.end());
+        asset->color.insert(
+            asset->color.end(), chunk.color.begin(), chunk.color.end());
+        asset->radius.insert(
+            asset->radius.end(), chunk.radius.begin(), chunk.radius.end());
+
+        // replay elements and grouping commands in order
+        auto apply = [asset, &cur_matname](const obj_chunk::directive& dir) {
+            if (dir.cmd == 'o') {
+                asset->objects.push_back(asset->arena->make<obj_object>(
+                    obj_object{dir.name, {}}));
+                asset->objects.back()->groups.push_back({cur_matname, ""});
+            } else if (dir.cmd == 'u') {
+                cur_matname = dir.name;
+                asset->objects.back()->groups.push_back({cur_matname, ""});
+            } else if (dir.cmd == 'g') {
+                asset->objects.back()->groups.push_back(
+                    {cur_matname, dir.name});
+            } else if (dir.cmd == 's') {
+                auto smoothing = dir.name == string("on");
+                if (asset->objects.back()->groups.back().smoothing !=
+                    smoothing) {
+                    asset->objects.back()->groups.push_back(
+                        {cur_matname, dir.name, smoothing});
+                }
+            }
+        };
+        auto di = 0;
+        for (auto ei = 0; ei < (int)chunk.elems.size(); ei++) {
+            while (di < (int)chunk.directives.size() &&
+                   chunk.directives[di].elem_pos <= ei)
+                apply(chunk.directives[di++]);
+            auto& elem = chunk.elems[ei];
+            auto& g = asset->objects.back()->groups.back();
+            g.elems.push_back(
+                {(uint32_t)g.verts.size(), elem.type, elem.size});
+            g.verts.insert(g.verts.end(), chunk.verts.begin() + elem.start,
+                chunk.verts.begin() + elem.start + elem.size);
+        }
+        while (di < (int)chunk.directives.size())
+            apply(chunk.directives[di++]);
+
+        // rare commands
+        for (auto& mtllib : chunk.mtllibs) {
+            auto found = false;
+            for (auto& lib : mtllibs) {
+                if (lib == mtllib) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) mtllibs.push_back(mtllib);
+        }
+        asset->cameras.insert(
+            asset->cameras.end(), chunk.cameras.begin(), chunk.cameras.end());
+        asset->environments.insert(asset->environments.end(),
+            chunk.environments.begin(), chunk.environments.end());
+        asset->instances.insert(asset->instances.end(),
+            chunk.instances.begin(), chunk.instances.end());
+    }
+}
+
+// Loads an OBJ by memory-mapping it and parsing chunks in parallel. The
+// file is split at line boundaries into roughly even chunks, one per
+// core, each parsed independently with the fast scanners above, and the
+// partial results are merged in file order.
+inline obj_scene* load_obj(const string& filename, bool load_txt,
+    bool skip_missing, bool flip_texcoord, bool flip_tr) {
+    // clear obj
+    auto asset = unique_ptr<obj_scene>(new obj_scene());
+    asset->arena = new memory_arena();
+
+    // map the file, falling back to reading it whole
+    auto data = (const char*)nullptr;
+    auto size = (size_t)0;
+    auto buffer = vector<char>();
+#ifndef _WIN32
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("cannot open filename " + filename);
+    struct stat st;
+    auto mapped = (void*)MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size) {
+        size = (size_t)st.st_size;
+        mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) data = (const char*)mapped;
+    }
+#endif
+    if (!data) {
+        auto f = fopen(filename.c_str(), "rb");
+        if (!f) throw runtime_error("cannot open filename " + filename);
+        fseek(f, 0, SEEK_END);
+        size = (size_t)ftell(f);
+        fseek(f, 0, SEEK_SET);
+        buffer.resize(size);
+        if (size && fread(buffer.data(), 1, size, f) != size) {
+            fclose(f);
+            throw runtime_error("cannot read filename " + filename);
+        }
+        fclose(f);
+        data = buffer.data();
+    }
+
+    // initializing obj
+    asset->objects.push_back(asset->arena->make<obj_object>());
+    asset->objects.back()->groups.push_back({});
+
+    // split into one chunk per core at line boundaries; small files are
+    // not worth the thread hand-off
+    const size_t chunk_min_size = 1 << 20;
+    auto nworkers = (int)std::thread::hardware_concurrency();
+    auto nchunks = (int)(size / chunk_min_size);
+    nchunks = clamp(nchunks, 1, max(nworkers, 1));
+    auto bounds = vector<const char*>{data};
+    for (auto c = 1; c < nchunks; c++) {
+        auto split = data + (size * c) / nchunks;
+        split = (const char*)memchr(split, '\n', data + size - split);
+        split = (split) ? split + 1 : data + size;
+        if (split > bounds.back()) bounds.push_back(split);
+    }
+    bounds.push_back(data + size);
+    nchunks = (int)bounds.size() - 1;
+
+    // parse the chunks in parallel and merge them in order
+    auto chunks = vector<obj_chunk>(nchunks);
+    if (nchunks > 1) {
+        parallel_for(nchunks, [&bounds, &chunks, flip_texcoord](int c) {
+            parse_obj_chunk(
+                bounds[c], bounds[c + 1], flip_texcoord, chunks[c]);
+        });
+    } else {
+        parse_obj_chunk(bounds[0], bounds[1], flip_texcoord, chunks[0]);
+    }
+    auto cur_mtllibs = vector<string>();
+    merge_obj_chunks(asset.get(), chunks, cur_mtllibs);
+
+    // release the mapping
+#ifndef _WIN32
+    if (mapped != MAP_FAILED) munmap(mapped, size);
+    close(fd);
+#endif
 
     // cleanup unused
     for (auto o : asset->objects) {
@@ -2557,7 +4745,8 @@ inline obj_scene* load_obj(const string& filename, bool load_txt,
             asset->materials.end(), materials.begin(), materials.end());
         for (auto& txt : textures) {
             if (texture_set.find(txt) != texture_set.end()) continue;
-            asset->textures.push_back(new obj_texture{txt});
+            asset->textures.push_back(
+                asset->arena->make<obj_texture>(obj_texture{txt}));
             texture_set.insert(txt);
         }
     }
@@ -4450,6 +6639,38 @@ inline string base64_decode(string const& encoded_string) {
     return ret;
 }
 
+// Decodes base64 in a single pass, writing directly into dst, which is
+// resized to the decoded length. Returns false on malformed input.
+bool base64_decode_into(
+    const char* first, const char* last, vector<unsigned char>& dst) {
+    static const auto table = []() {
+        auto t = array<int8_t, 256>();
+        for (auto& v : t) v = -1;
+        auto chars =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (auto i = 0; i < 64; i++) t[(unsigned char)chars[i]] = i;
+        return t;
+    }();
+    dst.clear();
+    dst.reserve(((size_t)(last - first) / 4) * 3 + 3);
+    auto acc = 0u;
+    auto nbits = 0;
+    for (auto s = first; s != last; s++) {
+        if (*s == '=') break;
+        if (*s == '\n' || *s == '\r') continue;
+        auto v = table[(unsigned char)*s];
+        if (v < 0) return false;
+        acc = (acc << 6) | v;
+        nbits += 6;
+        if (nbits >= 8) {
+            nbits -= 8;
+            dst.push_back((unsigned char)((acc >> nbits) & 0xff));
+        }
+    }
+    return true;
+}
+
 // Fix path
 inline string _fix_path(const string& path_) {
     auto path = path_;
@@ -4474,6 +6695,34 @@ vector<unsigned char> load_binfile(const string& filename, bool skip_missing) {
     return bytes;
 }
 
+// Maps a file read-only into memory, or returns nullptr if mapping is
+// not available, so callers can fall back to reading a copy.
+file_mapping* map_file(const string& filename) {
+#ifndef _WIN32
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size) {
+        close(fd);
+        return nullptr;
+    }
+    auto mapped =
+        mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    auto mapping = new file_mapping();
+    mapping->data = (const unsigned char*)mapped;
+    mapping->size = (size_t)st.st_size;
+    mapping->_mapped = mapped;
+    mapping->_fd = fd;
+    return mapping;
+#else
+    return nullptr;
+#endif
+}
+
 // Saves text.
 void save_textfile(const string& filename, const string& txt) {
     auto f = fopen(filename.c_str(), "wt");
@@ -4492,6 +6741,21 @@ void save_binfile(const string& filename, const vector<unsigned char>& bin,
     fclose(f);
 }
 
+// Saves binary. Writes to a temporary and renames over the target so
+// that buffers aliasing a mapping of the same file stay readable while
+// being written out.
+void save_binfile(
+    const string& filename, const buffer_data& bin, bool skip_missing) {
+    auto tmp_filename = filename + ".tmp";
+    auto f = fopen(tmp_filename.c_str(), "wb");
+    if (!f && !skip_missing)
+        throw runtime_error("cannot write file " + filename);
+    if (!f) return;
+    fwrite(bin.data(), 1, (int)bin.size(), f);
+    fclose(f);
+    rename(tmp_filename.c_str(), filename.c_str());
+}
+
 // Check if a string starts with a prefix
 static inline bool startsiwith(const string& str, const string& prefix) {
     if (str.length() < prefix.length()) return false;
@@ -4509,13 +6773,24 @@ void load_buffers(glTF* gltf, const string& dirname, bool skip_missing) {
                 if (skip_missing) continue;
                 throw runtime_error("could not decode base64 data");
             }
-            // decode
-            auto data = base64_decode(buffer->uri.substr(pos + 1));
-            buffer->data = vector<unsigned char>((unsigned char*)data.c_str(),
-                (unsigned char*)data.c_str() + data.length());
+            // decode in a single pass into the buffer bytes
+            auto decoded = vector<unsigned char>();
+            if (!base64_decode_into(buffer->uri.data() + pos + 1,
+                    buffer->uri.data() + buffer->uri.size(), decoded)) {
+                if (skip_missing) continue;
+                throw runtime_error("could not decode base64 data");
+            }
+            buffer->data = std::move(decoded);
         } else {
-            buffer->data =
-                load_binfile(_fix_path(dirname + buffer->uri), skip_missing);
+            // map the external file and alias it, falling back to a copy
+            auto mapping = map_file(_fix_path(dirname + buffer->uri));
+            if (mapping) {
+                gltf->mappings += mapping;
+                buffer->data.alias(mapping->data, mapping->size);
+            } else {
+                buffer->data = load_binfile(
+                    _fix_path(dirname + buffer->uri), skip_missing);
+            }
             if (buffer->data.empty()) {
                 if (skip_missing) continue;
                 throw runtime_error("could not load binary file " +
@@ -4529,30 +6804,33 @@ void load_buffers(glTF* gltf, const string& dirname, bool skip_missing) {
     }
 }
 
-// Loads images.
+// Loads images. Decoding runs in parallel since each image works on an
+// independent buffer; errors are collected and reported afterwards.
 void load_images(glTF* gltf, const string& dirname, bool skip_missing) {
-    for (auto image : gltf->images) {
+    auto errors = vector<string>(gltf->images.size());
+    parallel_for((int)gltf->images.size(), [&](int iid) {
+        auto image = gltf->images[iid];
         image->data = image_data();
         auto filename = string();
 #if YGL_IMAGEIO
         if (image->bufferView || startsiwith(image->uri, "data:")) {
-            auto buffer = string();
+            auto buffer = vector<unsigned char>();
             auto data = (unsigned char*)nullptr;
             auto data_size = 0;
             if (image->bufferView) {
                 auto view = gltf->get(image->bufferView);
                 auto buffer = gltf->get(view->buffer);
                 if (!view || !buffer || view->byteStride) {
-                    if (skip_missing) continue;
-                    throw runtime_error("invalid image buffer view");
+                    errors[iid] = "invalid image buffer view";
+                    return;
                 }
                 if (image->mimeType == glTFImageMimeType::ImagePng)
                     filename = "internal_data.png";
                 else if (image->mimeType == glTFImageMimeType::ImageJpeg)
                     filename = "internal_data.jpg";
                 else {
-                    if (skip_missing) continue;
-                    throw runtime_error("unsupported image format");
+                    errors[iid] = "unsupported image format";
+                    return;
                 }
                 data = buffer->data.data() + view->byteOffset;
                 data_size = view->byteLength;
@@ -4560,22 +6838,26 @@ void load_images(glTF* gltf, const string& dirname, bool skip_missing) {
                 // assume it is base64 and find ','
                 auto pos = image->uri.find(',');
                 if (pos == image->uri.npos) {
-                    if (skip_missing) continue;
-                    throw runtime_error("could not decode base64 data");
+                    errors[iid] = "could not decode base64 data";
+                    return;
                 }
                 auto header = image->uri.substr(0, pos);
                 for (auto format : {"png", "jpg", "jpeg", "tga", "ppm", "hdr"})
                     if (header.find(format) != header.npos)
                         filename = string("fake.") + format;
                 if (is_hdr_filename(filename)) {
-                    if (skip_missing) continue;
-                    throw runtime_error("unsupported embedded image format " +
-                                        header.substr(0, pos));
+                    errors[iid] = "unsupported embedded image format " +
+                                  header.substr(0, pos);
+                    return;
+                }
+                // decode in a single pass
+                if (!base64_decode_into(image->uri.data() + pos + 1,
+                        image->uri.data() + image->uri.size(), buffer)) {
+                    errors[iid] = "could not decode base64 data";
+                    return;
                 }
-                // decode
-                buffer = base64_decode(image->uri.substr(pos + 1));
                 data_size = (int)buffer.size();
-                data = (unsigned char*)buffer.data();
+                data = buffer.data();
             }
             if (is_hdr_filename(filename)) {
                 image->data.dataf = load_imagef_from_memory(filename, data,
@@ -4598,9 +6880,13 @@ void load_images(glTF* gltf, const string& dirname, bool skip_missing) {
         }
 #endif
         if (image->data.dataf.empty() && image->data.datab.empty()) {
-            if (skip_missing) continue;
-            throw runtime_error("cannot load image " + filename);
+            errors[iid] = "cannot load image " + filename;
+            return;
         }
+    });
+    if (!skip_missing) {
+        for (auto& err : errors)
+            if (err != "") throw runtime_error(err);
     }
 }
 
@@ -4714,6 +7000,10 @@ glTF* load_binary_gltf(
     // clear data
     auto gltf = unique_ptr<glTF>(new glTF());
 
+    // map the whole file so the internal buffer chunk can be aliased
+    // without copying; chunk reads fall back to the stream otherwise
+    auto mapping = unique_ptr<file_mapping>(map_file(filename));
+
     // opens binary file
     auto f = fopen(filename.c_str(), "rb");
     if (!f) throw runtime_error("could not load binary file " + filename);
@@ -4737,6 +7027,7 @@ glTF* load_binary_gltf(
     auto json_bytes = vector<char>();
     auto buffer_bytes = vector<unsigned char>();
     uint32_t buffer_length = 0;
+    auto buffer_offset = (size_t)0;
 
     if (version == 1) {
         // read content length and format
@@ -4750,9 +7041,14 @@ glTF* load_binary_gltf(
 
         // read buffer bytes
         if (load_bin) {
-            buffer_bytes.resize(length - json_length - 20);
-            read(f, buffer_bytes.data(), (int)buffer_bytes.size());
-            buffer_length = (int)buffer_bytes.size();
+            buffer_length = length - json_length - 20;
+            if (mapping) {
+                buffer_offset = (size_t)ftell(f);
+                fseek(f, (long)buffer_length, SEEK_CUR);
+            } else {
+                buffer_bytes.resize(buffer_length);
+                read(f, buffer_bytes.data(), (int)buffer_bytes.size());
+            }
         }
     }
 
@@ -4779,8 +7075,13 @@ glTF* load_binary_gltf(
 
         // read buffer bytes
         if (load_bin) {
-            buffer_bytes.resize(buffer_length);
-            read(f, buffer_bytes.data(), (int)buffer_bytes.size());
+            if (mapping) {
+                buffer_offset = (size_t)ftell(f);
+                fseek(f, (long)buffer_length, SEEK_CUR);
+            } else {
+                buffer_bytes.resize(buffer_length);
+                read(f, buffer_bytes.data(), (int)buffer_bytes.size());
+            }
         }
     }
 
@@ -4810,7 +7111,16 @@ glTF* load_binary_gltf(
     auto buffer = gltf->buffers.at(0);
     buffer->byteLength = buffer_length;
     if (version == 2) buffer->uri = "";
-    if (load_bin) { buffer->data = buffer_bytes; }
+    if (load_bin) {
+        if (mapping) {
+            if (buffer_offset + buffer_length > mapping->size)
+                throw runtime_error("corrupt binary format");
+            buffer->data.alias(mapping->data + buffer_offset, buffer_length);
+            gltf->mappings += mapping.release();
+        } else {
+            buffer->data = std::move(buffer_bytes);
+        }
+    }
 
     // load external resources
     auto dirname = _get_dirname(filename);
@@ -4827,8 +7137,10 @@ glTF* load_binary_gltf(
 // Saves a binary gltf.
 void save_binary_gltf(
     const string& filename, const glTF* gltf, bool save_bin, bool save_image) {
-    // opens binary file
-    auto f = fopen(filename.c_str(), "wb");
+    // opens binary file; written to a temporary and renamed over the
+    // target so a mapping of the same file stays readable while saving
+    auto tmp_filename = filename + ".tmp";
+    auto f = fopen(tmp_filename.c_str(), "wb");
     if (!f) throw runtime_error("could not write binary file");
 
     // dumps json
@@ -4875,6 +7187,7 @@ void save_binary_gltf(
 
     // close
     fclose(f);
+    rename(tmp_filename.c_str(), filename.c_str());
 
     // save external resources
     auto dirname = _get_dirname(filename);
@@ -4884,6 +7197,14 @@ void save_binary_gltf(
 
 }  // namespace _impl_gltf
 
+// Releases a file mapping
+file_mapping::~file_mapping() {
+#ifndef _WIN32
+    if (_mapped) munmap(_mapped, size);
+    if (_fd >= 0) close(_fd);
+#endif
+}
+
 // Loads a gltf file from disk
 glTF* load_gltf(
     const string& filename, bool load_bin, bool load_img, bool skip_missing) {
@@ -5032,6 +7353,7 @@ namespace _impl_scn {
 inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
     // clear scene
     auto scn = new scene();
+    scn->arena = new memory_arena();
 
     struct obj_vertex_hash {
         std::hash<int> Th;
@@ -5049,7 +7371,7 @@ inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
     // convert textures
     auto tmap = unordered_map<string, texture*>{{"", nullptr}};
     for (auto otxt : obj->textures) {
-        auto txt = new texture();
+        auto txt = scn->arena->make<texture>();
         txt->name = otxt->path;
         txt->path = otxt->path;
         if (!otxt->datab.empty()) {
@@ -5112,7 +7434,7 @@ inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
     // convert materials and build textures
     auto mmap = unordered_map<string, material*>{{"", nullptr}};
     for (auto omat : obj->materials) {
-        auto mat = new material();
+        auto mat = scn->arena->make<material>();
         mat->name = omat->name;
         mat->mtype = material_type::specular_roughness;
         mat->ke = {omat->ke.x, omat->ke.y, omat->ke.z};
@@ -5171,7 +7493,7 @@ inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
             if (oshp.verts.empty()) continue;
             if (oshp.elems.empty()) continue;
 
-            auto shp = new shape();
+            auto shp = scn->arena->make<shape>();
             shp->name = omsh->name + oshp.groupname;
             shp->mat = mmap[oshp.matname];
 
@@ -5295,7 +7617,7 @@ inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
 
                 // fix smoothing
                 if (!oshp.smoothing && opts.obj_facet_non_smooth) {
-                    auto faceted = new shape();
+                    auto faceted = scn->arena->make<shape>();
                     faceted->name = shp->name;
                     auto pidx = vector<int>();
                     for (auto point : shp->points) {
@@ -5327,7 +7649,7 @@ inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
                         if (!shp->radius.empty())
                             faceted->radius.push_back(shp->radius[idx]);
                     }
-                    delete shp;
+                    // shp is reclaimed with the scene arena
                     shp = faceted;
                 }
             } else {
@@ -5418,7 +7740,7 @@ inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
 
     // convert cameras
     for (auto ocam : obj->cameras) {
-        auto cam = new camera();
+        auto cam = scn->arena->make<camera>();
         cam->name = ocam->name;
         cam->ortho = ocam->ortho;
         cam->yfov = ocam->yfov;
@@ -5432,7 +7754,7 @@ inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
     // convert envs
     unordered_set<material*> env_mat;
     for (auto oenv : obj->environments) {
-        auto env = new environment();
+        auto env = scn->arena->make<environment>();
         env->name = oenv->name;
         for (auto mat : scn->materials) {
             if (mat->name == oenv->matname) {
@@ -5451,13 +7773,13 @@ inline scene* obj_to_scene(const obj_scene* obj, const load_options& opts) {
         auto end =
             std::remove(scn->materials.begin(), scn->materials.end(), mat);
         scn->materials.erase(end, scn->materials.end());
-        delete mat;
+        // mat is reclaimed with the scene arena
     }
 
     // convert instances
     for (auto oist : obj->instances) {
         for (auto shp : omap[oist->objname]) {
-            auto ist = new instance();
+            auto ist = scn->arena->make<instance>();
             ist->name = oist->name;
             ist->shp = shp;
             ist->frame = oist->frame;
@@ -5502,6 +7824,14 @@ inline obj_scene* scene_to_obj(const scene* scn) {
                 (float*)txt->hdr.data() +
                     txt->hdr.width() * txt->hdr.height() * 4);
         }
+        if (txt->hdrh) {
+            auto hdr = half_to_float(txt->hdrh);
+            otxt->width = hdr.width();
+            otxt->height = hdr.height();
+            otxt->ncomp = 4;
+            otxt->dataf.assign((float*)hdr.data(),
+                (float*)hdr.data() + hdr.width() * hdr.height() * 4);
+        }
         if (txt->ldr) {
             otxt->width = txt->ldr.width();
             otxt->height = txt->ldr.height();
@@ -5730,13 +8060,13 @@ inline void gltf_node_to_instances(scene* scn, const vector<camera>& cameras,
     auto nde = gltf->get(nid);
     auto xform = xf * node_transform(nde);
     if (nde->camera) {
-        auto cam = new camera(cameras[(int)nde->camera]);
+        auto cam = scn->arena->make<camera>(cameras[(int)nde->camera]);
         cam->frame = to_frame3f(xform);
         scn->cameras.push_back(cam);
     }
     if (nde->mesh) {
         for (auto shp : meshes[(int)nde->mesh]) {
-            auto ist = new instance();
+            auto ist = scn->arena->make<instance>();
             ist->name = nde->name;
             ist->frame = to_frame3f(xform);
             ist->shp = shp;
@@ -5751,10 +8081,11 @@ inline void gltf_node_to_instances(scene* scn, const vector<camera>& cameras,
 inline scene* gltf_to_scene(const glTF* gltf) {
     // clear asset
     auto scn = new scene();
+    scn->arena = new memory_arena();
 
     // convert images
     for (auto gtxt : gltf->images) {
-        auto txt = new texture();
+        auto txt = scn->arena->make<texture>();
         txt->name = gtxt->name;
         txt->path =
             (startswith(gtxt->uri, "data:")) ? string("inlines") : gtxt->uri;
@@ -5835,7 +8166,7 @@ inline scene* gltf_to_scene(const glTF* gltf) {
 
     // convert materials
     for (auto gmat : gltf->materials) {
-        auto mat = new material();
+        auto mat = scn->arena->make<material>();
         mat->name = gmat->name;
         mat->ke = gmat->emissiveFactor;
         mat->ke_txt = add_texture(gmat->emissiveTexture);
@@ -5874,7 +8205,7 @@ inline scene* gltf_to_scene(const glTF* gltf) {
         meshes.push_back({});
         // primitives
         for (auto gprim : gmesh->primitives) {
-            auto shp = new shape();
+            auto shp = scn->arena->make<shape>();
             if (gprim->material) {
                 shp->mat = scn->materials[(int)gprim->material];
             }
@@ -6130,6 +8461,14 @@ inline glTF* scene_to_gltf(
                 (float*)txt->hdr.data() +
                     txt->hdr.width() * txt->hdr.height() * 4);
         }
+        if (txt->hdrh) {
+            auto hdr = half_to_float(txt->hdrh);
+            gimg->data.width = hdr.width();
+            gimg->data.height = hdr.height();
+            gimg->data.ncomp = 4;
+            gimg->data.dataf.assign((float*)hdr.data(),
+                (float*)hdr.data() + hdr.width() * hdr.height() * 4);
+        }
         if (txt->ldr) {
             gimg->data.width = txt->ldr.width();
             gimg->data.height = txt->ldr.height();
@@ -6439,16 +8778,423 @@ inline void save_gltf_scene(
 
 #endif
 
+// Magic and version for the native binary scene format.
+const char* binscene_magic = "YSCN";
+const int binscene_version = 1;
+
+// Binary writing helpers. Strings and arrays are length-prefixed raw
+// blobs; everything else is written as-is.
+template <typename T>
+inline void write_bin_value(FILE* f, const T& val) {
+    fwrite(&val, sizeof(T), 1, f);
+}
+inline void write_bin_string(FILE* f, const string& str) {
+    auto len = (int)str.size();
+    fwrite(&len, sizeof(int), 1, f);
+    fwrite(str.data(), 1, str.size(), f);
+}
+template <typename T>
+inline void write_bin_vector(FILE* f, const vector<T>& vec) {
+    auto count = (int64_t)vec.size();
+    fwrite(&count, sizeof(int64_t), 1, f);
+    fwrite(vec.data(), sizeof(T), vec.size(), f);
+}
+template <typename Image>
+inline void write_bin_image(FILE* f, const Image& img) {
+    auto w = img.width(), h = img.height();
+    fwrite(&w, sizeof(int), 1, f);
+    fwrite(&h, sizeof(int), 1, f);
+    fwrite(img.data(), sizeof(*img.data()), (size_t)w * h, f);
+}
+
+// Binary reading cursor over a memory-mapped buffer. Reads clear ok on a
+// truncated or malformed file and become no-ops; callers check ok once
+// at the end.
+struct bin_reader {
+    const char* cur = nullptr;
+    const char* end = nullptr;
+    bool ok = true;
+};
+
+template <typename T>
+inline void read_bin_value(bin_reader& br, T& val) {
+    if (!br.ok) return;
+    if (sizeof(T) > (size_t)(br.end - br.cur)) {
+        br.ok = false;
+        return;
+    }
+    memcpy(&val, br.cur, sizeof(T));
+    br.cur += sizeof(T);
+}
+inline void read_bin_string(bin_reader& br, string& str) {
+    auto len = 0;
+    read_bin_value(br, len);
+    if (!br.ok) return;
+    if (len < 0 || len > br.end - br.cur) {
+        br.ok = false;
+        return;
+    }
+    str.assign(br.cur, br.cur + len);
+    br.cur += len;
+}
+template <typename T>
+inline void read_bin_vector(bin_reader& br, vector<T>& vec) {
+    auto count = (int64_t)0;
+    read_bin_value(br, count);
+    if (!br.ok) return;
+    if (count < 0 || count > (br.end - br.cur) / (int64_t)sizeof(T)) {
+        br.ok = false;
+        return;
+    }
+    vec.resize((size_t)count);
+    if (count) memcpy(vec.data(), br.cur, (size_t)count * sizeof(T));
+    br.cur += count * sizeof(T);
+}
+template <typename Image>
+inline void read_bin_image(bin_reader& br, Image& img, bool skip) {
+    auto w = 0, h = 0;
+    read_bin_value(br, w);
+    read_bin_value(br, h);
+    if (!br.ok) return;
+    auto stride = (int64_t)sizeof(*img.data());
+    if (w < 0 || h < 0 || (int64_t)w * h > (br.end - br.cur) / stride) {
+        br.ok = false;
+        return;
+    }
+    if (!skip) img = Image(w, h, (decltype(img.data()))br.cur);
+    br.cur += (int64_t)w * h * stride;
+}
+
+// Save a scene in the native binary format. Public API, see above.
+inline void save_binscene(
+    const string& filename, const scene* scn, const save_options& opts) {
+    // index of an object
+    auto index = [](const auto& vec, auto* val) -> int {
+        auto pos = find(vec.begin(), vec.end(), val);
+        if (pos == vec.end()) return -1;
+        return (int)(pos - vec.begin());
+    };
+
+    // texture references are stored as indices into the texture array
+    auto write_texture_info = [scn, &index](FILE* f, const texture_info& info) {
+        write_bin_value(f, (info.txt) ? index(scn->textures, info.txt) : -1);
+        write_bin_value(f, info.wrap_s);
+        write_bin_value(f, info.wrap_t);
+        write_bin_value(f, info.linear);
+        write_bin_value(f, info.mipmap);
+        write_bin_value(f, info.scale);
+    };
+
+    auto f = fopen(filename.c_str(), "wb");
+    if (!f) throw runtime_error("could not save " + filename);
+    fwrite(binscene_magic, 1, 4, f);
+    write_bin_value(f, binscene_version);
+
+    // cameras
+    write_bin_value(f, (int)scn->cameras.size());
+    for (auto cam : scn->cameras) {
+        write_bin_string(f, cam->name);
+        write_bin_value(f, cam->frame);
+        write_bin_value(f, cam->ortho);
+        write_bin_value(f, cam->yfov);
+        write_bin_value(f, cam->aspect);
+        write_bin_value(f, cam->focus);
+        write_bin_value(f, cam->aperture);
+        write_bin_value(f, cam->near);
+        write_bin_value(f, cam->far);
+    }
+
+    // textures; pixel data is embedded so loading needs no decoding
+    write_bin_value(f, (int)scn->textures.size());
+    for (auto txt : scn->textures) {
+        write_bin_string(f, txt->name);
+        write_bin_string(f, txt->path);
+        if (opts.save_textures) {
+            write_bin_image(f, txt->ldr);
+            if (txt->hdrh)
+                write_bin_image(f, half_to_float(txt->hdrh));
+            else
+                write_bin_image(f, txt->hdr);
+        } else {
+            write_bin_image(f, image4b());
+            write_bin_image(f, image4f());
+        }
+    }
+
+    // materials
+    write_bin_value(f, (int)scn->materials.size());
+    for (auto mat : scn->materials) {
+        write_bin_string(f, mat->name);
+        write_bin_value(f, mat->double_sided);
+        write_bin_value(f, (int)mat->mtype);
+        write_bin_value(f, mat->ke);
+        write_bin_value(f, mat->kd);
+        write_bin_value(f, mat->ks);
+        write_bin_value(f, mat->kr);
+        write_bin_value(f, mat->kt);
+        write_bin_value(f, mat->rs);
+        write_bin_value(f, mat->op);
+        write_texture_info(f, mat->ke_txt);
+        write_texture_info(f, mat->kd_txt);
+        write_texture_info(f, mat->ks_txt);
+        write_texture_info(f, mat->kr_txt);
+        write_texture_info(f, mat->kt_txt);
+        write_texture_info(f, mat->rs_txt);
+        write_texture_info(f, mat->bump_txt);
+        write_texture_info(f, mat->disp_txt);
+        write_texture_info(f, mat->norm_txt);
+        write_texture_info(f, mat->occ_txt);
+    }
+
+    // shapes
+    write_bin_value(f, (int)scn->shapes.size());
+    for (auto shp : scn->shapes) {
+        write_bin_string(f, shp->name);
+        write_bin_string(f, shp->path);
+        write_bin_value(f, (shp->mat) ? index(scn->materials, shp->mat) : -1);
+        write_bin_vector(f, shp->points);
+        write_bin_vector(f, shp->lines);
+        write_bin_vector(f, shp->triangles);
+        write_bin_vector(f, shp->quads);
+        write_bin_vector(f, shp->quads_pos);
+        write_bin_vector(f, shp->quads_norm);
+        write_bin_vector(f, shp->quads_texcoord);
+        write_bin_vector(f, shp->pos);
+        write_bin_vector(f, shp->norm);
+        write_bin_vector(f, shp->texcoord);
+        write_bin_vector(f, shp->texcoord1);
+        write_bin_vector(f, shp->color);
+        write_bin_vector(f, shp->radius);
+        write_bin_vector(f, shp->tangsp);
+    }
+
+    // instances
+    write_bin_value(f, (int)scn->instances.size());
+    for (auto ist : scn->instances) {
+        write_bin_string(f, ist->name);
+        write_bin_value(f, ist->frame);
+        write_bin_value(f, (ist->shp) ? index(scn->shapes, ist->shp) : -1);
+    }
+
+    // environments
+    write_bin_value(f, (int)scn->environments.size());
+    for (auto env : scn->environments) {
+        write_bin_string(f, env->name);
+        write_bin_value(f, env->frame);
+        write_bin_value(f, env->ke);
+        write_texture_info(f, env->ke_txt);
+    }
+
+    fclose(f);
+}
+
+// Load a scene saved in the native binary format. Public API, see above.
+inline scene* load_binscene(const string& filename, const load_options& opts) {
+    // map the file, falling back to reading it whole
+    auto data = (const char*)nullptr;
+    auto size = (size_t)0;
+    auto buffer = vector<char>();
+#ifndef _WIN32
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("cannot open filename " + filename);
+    struct stat st;
+    auto mapped = (void*)MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size) {
+        size = (size_t)st.st_size;
+        mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) data = (const char*)mapped;
+    }
+#endif
+    if (!data) {
+        auto f = fopen(filename.c_str(), "rb");
+        if (!f) throw runtime_error("cannot open filename " + filename);
+        fseek(f, 0, SEEK_END);
+        size = (size_t)ftell(f);
+        fseek(f, 0, SEEK_SET);
+        buffer.resize(size);
+        if (size && fread(buffer.data(), 1, size, f) != size) {
+            fclose(f);
+            throw runtime_error("cannot read filename " + filename);
+        }
+        fclose(f);
+        data = buffer.data();
+    }
+
+    // texture references are stored as indices into the texture array
+    auto scn = unique_ptr<scene>(new scene());
+    scn->arena = new memory_arena();
+    auto read_texture_info = [&scn](bin_reader& br, texture_info& info) {
+        auto tid = -1;
+        read_bin_value(br, tid);
+        read_bin_value(br, info.wrap_s);
+        read_bin_value(br, info.wrap_t);
+        read_bin_value(br, info.linear);
+        read_bin_value(br, info.mipmap);
+        read_bin_value(br, info.scale);
+        if (tid < -1 || tid >= (int)scn->textures.size()) br.ok = false;
+        if (br.ok && tid >= 0) info.txt = scn->textures[tid];
+    };
+
+    // header
+    auto br = bin_reader{data, data + size};
+    char magic[4];
+    read_bin_value(br, magic);
+    br.ok = br.ok && !memcmp(magic, binscene_magic, 4);
+    auto version = -1;
+    read_bin_value(br, version);
+    br.ok = br.ok && version == binscene_version;
+
+    // cameras
+    auto ncameras = 0;
+    read_bin_value(br, ncameras);
+    for (auto i = 0; i < ncameras && br.ok; i++) {
+        auto cam = scn->arena->make<camera>();
+        scn->cameras += cam;
+        read_bin_string(br, cam->name);
+        read_bin_value(br, cam->frame);
+        read_bin_value(br, cam->ortho);
+        read_bin_value(br, cam->yfov);
+        read_bin_value(br, cam->aspect);
+        read_bin_value(br, cam->focus);
+        read_bin_value(br, cam->aperture);
+        read_bin_value(br, cam->near);
+        read_bin_value(br, cam->far);
+    }
+
+    // textures
+    auto ntextures = 0;
+    read_bin_value(br, ntextures);
+    for (auto i = 0; i < ntextures && br.ok; i++) {
+        auto txt = scn->arena->make<texture>();
+        scn->textures += txt;
+        read_bin_string(br, txt->name);
+        read_bin_string(br, txt->path);
+        read_bin_image(br, txt->ldr, !opts.load_textures);
+        read_bin_image(br, txt->hdr, !opts.load_textures);
+    }
+
+    // materials
+    auto nmaterials = 0;
+    read_bin_value(br, nmaterials);
+    for (auto i = 0; i < nmaterials && br.ok; i++) {
+        auto mat = scn->arena->make<material>();
+        scn->materials += mat;
+        read_bin_string(br, mat->name);
+        read_bin_value(br, mat->double_sided);
+        auto mtype = 0;
+        read_bin_value(br, mtype);
+        mat->mtype = (material_type)mtype;
+        read_bin_value(br, mat->ke);
+        read_bin_value(br, mat->kd);
+        read_bin_value(br, mat->ks);
+        read_bin_value(br, mat->kr);
+        read_bin_value(br, mat->kt);
+        read_bin_value(br, mat->rs);
+        read_bin_value(br, mat->op);
+        read_texture_info(br, mat->ke_txt);
+        read_texture_info(br, mat->kd_txt);
+        read_texture_info(br, mat->ks_txt);
+        read_texture_info(br, mat->kr_txt);
+        read_texture_info(br, mat->kt_txt);
+        read_texture_info(br, mat->rs_txt);
+        read_texture_info(br, mat->bump_txt);
+        read_texture_info(br, mat->disp_txt);
+        read_texture_info(br, mat->norm_txt);
+        read_texture_info(br, mat->occ_txt);
+    }
+
+    // shapes
+    auto nshapes = 0;
+    read_bin_value(br, nshapes);
+    for (auto i = 0; i < nshapes && br.ok; i++) {
+        auto shp = scn->arena->make<shape>();
+        scn->shapes += shp;
+        read_bin_string(br, shp->name);
+        read_bin_string(br, shp->path);
+        auto mid = -1;
+        read_bin_value(br, mid);
+        if (mid < -1 || mid >= (int)scn->materials.size()) br.ok = false;
+        if (br.ok && mid >= 0) shp->mat = scn->materials[mid];
+        read_bin_vector(br, shp->points);
+        read_bin_vector(br, shp->lines);
+        read_bin_vector(br, shp->triangles);
+        read_bin_vector(br, shp->quads);
+        read_bin_vector(br, shp->quads_pos);
+        read_bin_vector(br, shp->quads_norm);
+        read_bin_vector(br, shp->quads_texcoord);
+        read_bin_vector(br, shp->pos);
+        read_bin_vector(br, shp->norm);
+        read_bin_vector(br, shp->texcoord);
+        read_bin_vector(br, shp->texcoord1);
+        read_bin_vector(br, shp->color);
+        read_bin_vector(br, shp->radius);
+        read_bin_vector(br, shp->tangsp);
+    }
+
+    // instances
+    auto ninstances = 0;
+    read_bin_value(br, ninstances);
+    for (auto i = 0; i < ninstances && br.ok; i++) {
+        auto ist = scn->arena->make<instance>();
+        scn->instances += ist;
+        read_bin_string(br, ist->name);
+        read_bin_value(br, ist->frame);
+        auto sid = -1;
+        read_bin_value(br, sid);
+        if (sid < -1 || sid >= (int)scn->shapes.size()) br.ok = false;
+        if (br.ok && sid >= 0) ist->shp = scn->shapes[sid];
+    }
+
+    // environments
+    auto nenvironments = 0;
+    read_bin_value(br, nenvironments);
+    for (auto i = 0; i < nenvironments && br.ok; i++) {
+        auto env = scn->arena->make<environment>();
+        scn->environments += env;
+        read_bin_string(br, env->name);
+        read_bin_value(br, env->frame);
+        read_bin_value(br, env->ke);
+        read_texture_info(br, env->ke_txt);
+    }
+    auto ok = br.ok;
+
+    // release the mapping
+#ifndef _WIN32
+    if (mapped != MAP_FAILED) munmap(mapped, size);
+    close(fd);
+#endif
+
+    // done
+    if (!ok) throw runtime_error("error parsing binary scene " + filename);
+    return scn.release();
+}
+
+// Build mip pyramids for all loaded textures. Public API, see above.
+inline void build_mipmaps(scene* scn) {
+#if YGL_IMAGEIO
+    for (auto txt : scn->textures) ygl::build_mipmaps(txt);
+#endif
+}
+
 // Load a scene
 inline scene* load_scene(const string& filename, const load_options& opts) {
     auto ext = path_extension(filename);
-    if (ext == ".obj" || ext == ".OBJ") return load_obj_scene(filename, opts);
+    auto scn = (scene*)nullptr;
+    if (ext == ".obj" || ext == ".OBJ") {
+        scn = load_obj_scene(filename, opts);
+    }
 #if YGL_GLTF
-    if (ext == ".gltf" || ext == ".GLTF")
-        return load_gltf_scene(filename, opts);
+    else if (ext == ".gltf" || ext == ".GLTF") {
+        scn = load_gltf_scene(filename, opts);
+    }
 #endif
-    throw runtime_error("unsupported extension " + ext);
-    return nullptr;
+    else if (ext == ".ybin" || ext == ".YBIN") {
+        scn = _impl_scn::load_binscene(filename, opts);
+    } else {
+        throw runtime_error("unsupported extension " + ext);
+    }
+    if (opts.load_textures) _impl_scn::build_mipmaps(scn);
+    return scn;
 }
 
 // Save a scene
@@ -6461,6 +9207,8 @@ inline void save_scene(
     if (ext == ".gltf" || ext == ".GLTF")
         return save_gltf_scene(filename, scn, opts);
 #endif
+    if (ext == ".ybin" || ext == ".YBIN")
+        return _impl_scn::save_binscene(filename, scn, opts);
     throw runtime_error("unsupported extension " + ext);
 }
 
@@ -6472,7 +9220,7 @@ inline void add_elements(scene* scn, const add_elements_options& opts) {
             shp->norm.resize(shp->pos.size(), {0, 0, 1});
             if (!shp->lines.empty() || !shp->triangles.empty() ||
                 !shp->quads.empty()) {
-                shp->norm = compute_normals(
+                shp->norm = compute_normals_parallel(
                     shp->lines, shp->triangles, shp->quads, shp->pos);
             }
         }
@@ -6483,7 +9231,7 @@ inline void add_elements(scene* scn, const add_elements_options& opts) {
             if (!shp->tangsp.empty() || shp->triangles.empty() ||
                 shp->texcoord.empty() || (shp->mat))
                 continue;
-            shp->tangsp = compute_tangent_frames(
+            shp->tangsp = compute_tangent_frames_parallel(
                 shp->triangles, shp->pos, shp->norm, shp->texcoord);
         }
     }
@@ -6499,7 +9247,7 @@ inline void add_elements(scene* scn, const add_elements_options& opts) {
 
     if (opts.texture_data) {
         for (auto txt : scn->textures) {
-            if (!txt->hdr && !txt->ldr) {
+            if (!txt->hdr && !txt->ldr && !txt->hdrh) {
                 printf("unable to load texture %s\n", txt->path.c_str());
                 txt->ldr = image4b(1, 1, {255, 255, 255, 255});
             }
@@ -6623,6 +9371,96 @@ inline void merge_into(scene* merge_into, scene* merge_from) {
     merge_from->environments.clear();
 }
 
+// Builds the light hierarchy nodes over ltree->sorted_lights, splitting the
+// longest axis of the light bounds at the median. Nodes are processed from
+// a queue so the two children of a node always end up adjacent.
+inline void build_light_tree_nodes(
+    light_tree* ltree, const vector<bbox3f>& lbboxes) {
+    struct light_range {
+        int nodeid, start, end, parent;
+    };
+    ltree->nodes.push_back({});
+    auto queue =
+        std::deque<light_range>{{0, 0, (int)ltree->sorted_lights.size(), -1}};
+    while (!queue.empty()) {
+        auto range = queue.front();
+        queue.pop_front();
+        auto node = light_tree_node();
+        node.parent = range.parent;
+        for (auto i = range.start; i < range.end; i++) {
+            node.bbox += lbboxes[ltree->sorted_lights[i]];
+            node.power += ltree->light_power[ltree->sorted_lights[i]];
+        }
+        if (range.end - range.start <= 4) {
+            node.start = range.start;
+            node.count = range.end - range.start;
+            for (auto i = range.start; i < range.end; i++)
+                ltree->light_leaf[ltree->sorted_lights[i]] = range.nodeid;
+        } else {
+            auto size = node.bbox.max - node.bbox.min;
+            auto axis = 0;
+            if (size.y > size.x && size.y > size.z) axis = 1;
+            if (size.z > size.x && size.z > size.y) axis = 2;
+            auto mid = (range.start + range.end) / 2;
+            std::nth_element(ltree->sorted_lights.begin() + range.start,
+                ltree->sorted_lights.begin() + mid,
+                ltree->sorted_lights.begin() + range.end, [&](int a, int b) {
+                    return (lbboxes[a].min[axis] + lbboxes[a].max[axis]) / 2 <
+                           (lbboxes[b].min[axis] + lbboxes[b].max[axis]) / 2;
+                });
+            node.start = (int)ltree->nodes.size();
+            ltree->nodes.push_back({});
+            ltree->nodes.push_back({});
+            queue.push_back({node.start, range.start, mid, range.nodeid});
+            queue.push_back({node.start + 1, mid, range.end, range.nodeid});
+        }
+        ltree->nodes[range.nodeid] = node;
+    }
+}
+
+// Initialize the light hierarchy used by the tracer to importance sample
+// light selection. Environment lights take the scene bounds and a power
+// proportional to its area, so they stay competitive with nearby fixtures.
+inline void update_light_tree(scene* scn) {
+    if (scn->ltree) delete scn->ltree;
+    scn->ltree = nullptr;
+    if (scn->lights.empty()) return;
+    auto ltree = new light_tree();
+    update_bounds(scn);
+    auto sbbox = scn->bbox;
+    if (sbbox.min.x > sbbox.max.x) sbbox = {{-1, -1, -1}, {1, 1, 1}};
+    auto lbboxes = vector<bbox3f>(scn->lights.size());
+    ltree->light_power.resize(scn->lights.size());
+    for (auto lid = 0; lid < (int)scn->lights.size(); lid++) {
+        auto lgt = scn->lights[lid];
+        if (lgt->ist) {
+            auto bbox = invalid_bbox3f;
+            for (auto& p : lgt->ist->shp->pos)
+                bbox += transform_point(lgt->ist->frame, p);
+            lbboxes[lid] = bbox;
+            auto ke = lgt->ist->shp->mat->ke;
+            auto area = (lgt->ist->shp->elem_cdf.empty()) ?
+                            1.0f :
+                            lgt->ist->shp->elem_cdf.back();
+            ltree->light_power[lid] = (ke.x + ke.y + ke.z) / 3 * area;
+            ltree->light_id[lgt->ist] = lid;
+        } else if (lgt->env) {
+            lbboxes[lid] = sbbox;
+            auto r = length(sbbox.max - sbbox.min) / 2;
+            auto ke = lgt->env->ke;
+            ltree->light_power[lid] =
+                (ke.x + ke.y + ke.z) / 3 * 4 * pif * r * r;
+            ltree->light_id[lgt->env] = lid;
+        }
+    }
+    ltree->sorted_lights.resize(scn->lights.size());
+    for (auto lid = 0; lid < (int)scn->lights.size(); lid++)
+        ltree->sorted_lights[lid] = lid;
+    ltree->light_leaf.resize(scn->lights.size(), 0);
+    build_light_tree_nodes(ltree, lbboxes);
+    scn->ltree = ltree;
+}
+
 // Initialize the lights
 inline void update_lights(scene* scn, bool point_only) {
     for (auto lgt : scn->lights) delete lgt;
@@ -6653,8 +9491,33 @@ inline void update_lights(scene* scn, bool point_only) {
         if (env->ke == zero3f) continue;
         auto lgt = new light();
         lgt->env = env;
+        // precompute the texel cdf used to importance sample the envmap:
+        // texel luminance weighted by the texel solid angle, with a small
+        // floor so bilinear lookups never see a zero pdf
+        if (env->ke_txt.txt && env->elem_cdf.empty()) {
+            auto txt = env->ke_txt.txt;
+            env->elem_cdf.resize(txt->width() * txt->height());
+            for (auto j = 0; j < txt->height(); j++) {
+                auto sa = sin(pif * (j + 0.5f) / txt->height());
+                for (auto i = 0; i < txt->width(); i++) {
+                    auto ke = (txt->hdr) ?
+                                  txt->hdr[{i, j}].xyz() :
+                                  ((txt->hdrh) ?
+                                      half_to_float(txt->hdrh[{i, j}]).xyz() :
+                                      srgb_to_linear(txt->ldr[{i, j}]).xyz());
+                    auto lum = (ke.x + ke.y + ke.z) / 3;
+                    if (!isfinite(lum)) lum = 0;
+                    env->elem_cdf[j * txt->width() + i] =
+                        (lum + flt_eps) * sa;
+                }
+            }
+            for (auto i = 1; i < (int)env->elem_cdf.size(); i++)
+                env->elem_cdf[i] += env->elem_cdf[i - 1];
+        }
         scn->lights.push_back(lgt);
     }
+
+    update_light_tree(scn);
 }
 
 // Print scene info (call update bounds bes before)
@@ -6705,6 +9568,20 @@ scene* load_scene(const string& filename, const load_options& opts) {
     return _impl_scn::load_scene(filename, opts);
 }
 
+// Load a binary scene
+scene* load_binscene(const string& filename, const load_options& opts) {
+    return _impl_scn::load_binscene(filename, opts);
+}
+
+// Save a binary scene
+void save_binscene(
+    const string& filename, const scene* scn, const save_options& opts) {
+    _impl_scn::save_binscene(filename, scn, opts);
+}
+
+// Build texture mip pyramids
+void build_mipmaps(scene* scn) { _impl_scn::build_mipmaps(scn); }
+
 // Save a scene
 void save_scene(
     const string& filename, const scene* scn, const save_options& opts) {
@@ -6731,6 +9608,703 @@ void print_info(const scene* scn) { _impl_scn::print_info(scn); }
 
 }  // namespace ygl
 
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION FOR SHAPE UTILITIES
+// -----------------------------------------------------------------------------
+namespace ygl {
+
+// Vertex-to-element adjacency by counting sort, with entries in element
+// order so parallel gathers accumulate in the same order as the serial
+// loops. The two counting passes are cheap integer scans; the expensive
+// per-element and per-vertex math runs on the pool.
+template <typename T>
+static void vertex_adjacency(const vector<T>& elems, int nverts,
+    vector<int>& offsets, vector<int>& adj, int elem_offset = 0) {
+    offsets.assign(nverts + 1, 0);
+    for (auto& e : elems)
+        for (auto vid : e) offsets[vid + 1]++;
+    for (auto i = 0; i < nverts; i++) offsets[i + 1] += offsets[i];
+    auto cur = offsets;
+    adj.resize(offsets[nverts]);
+    for (auto i = 0; i < (int)elems.size(); i++)
+        for (auto vid : elems[i]) adj[cur[vid]++] = i + elem_offset;
+}
+
+// Parallel compute_normals. Per-element normals are computed in parallel
+// chunks, then gathered per vertex through a counting-sort adjacency, so
+// no atomics are needed and the per-vertex addition order matches the
+// serial version.
+vector<vec3f> compute_normals_parallel(const vector<vec2i>& lines,
+    const vector<vec3i>& triangles, const vector<vec4i>& quads,
+    const vector<vec3f>& pos, bool weighted) {
+    // the serial version wins below this size
+    if (pos.size() < (1 << 16))
+        return compute_normals(lines, triangles, quads, pos, weighted);
+
+    auto pool = get_global_pool();
+    auto nchunks = (int)pool->_threads.size() * 4;
+
+    // per-element values in one unified array, lines first then
+    // triangles then quads to mirror the serial accumulation order
+    auto toff = (int)lines.size();
+    auto qoff = toff + (int)triangles.size();
+    auto enorm = vector<vec3f>(qoff + quads.size());
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto chunk = [c, nchunks](size_t count, int& start, int& end) {
+            start = (int)(((int64_t)count * c) / nchunks);
+            end = (int)(((int64_t)count * (c + 1)) / nchunks);
+        };
+        auto start = 0, end = 0;
+        chunk(lines.size(), start, end);
+        for (auto i = start; i < end; i++) {
+            auto& l = lines[i];
+            auto n = pos[l.y] - pos[l.x];
+            enorm[i] = (weighted) ? n : normalize(n);
+        }
+        chunk(triangles.size(), start, end);
+        for (auto i = start; i < end; i++) {
+            auto& t = triangles[i];
+            auto n = cross(pos[t.y] - pos[t.x], pos[t.z] - pos[t.x]);
+            enorm[toff + i] = (weighted) ? n : normalize(n);
+        }
+        chunk(quads.size(), start, end);
+        for (auto i = start; i < end; i++) {
+            auto& q = quads[i];
+            auto n = cross(pos[q.y] - pos[q.x], pos[q.w] - pos[q.x]) +
+                     cross(pos[q.w] - pos[q.z], pos[q.x] - pos[q.z]);
+            enorm[qoff + i] = (weighted) ? n : normalize(n);
+        }
+    });
+
+    // adjacency per element type, merged in serial accumulation order
+    auto nverts = (int)pos.size();
+    auto loffsets = vector<int>(), ladj = vector<int>();
+    auto toffsets = vector<int>(), tadj = vector<int>();
+    auto qoffsets = vector<int>(), qadj = vector<int>();
+    vertex_adjacency(lines, nverts, loffsets, ladj, 0);
+    vertex_adjacency(triangles, nverts, toffsets, tadj, toff);
+    vertex_adjacency(quads, nverts, qoffsets, qadj, qoff);
+
+    // gather per vertex in parallel chunks
+    auto norm = vector<vec3f>(pos.size(), zero3f);
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto vmin = (int)(((int64_t)nverts * c) / nchunks);
+        auto vmax = (int)(((int64_t)nverts * (c + 1)) / nchunks);
+        for (auto i = vmin; i < vmax; i++) {
+            auto n = zero3f;
+            for (auto k = loffsets[i]; k < loffsets[i + 1]; k++)
+                n += enorm[ladj[k]];
+            for (auto k = toffsets[i]; k < toffsets[i + 1]; k++)
+                n += enorm[tadj[k]];
+            for (auto k = qoffsets[i]; k < qoffsets[i + 1]; k++)
+                n += enorm[qadj[k]];
+            norm[i] = normalize(n);
+        }
+    });
+    return norm;
+}
+
+// Parallel compute_tangent_frames with the same adjacency scheme as
+// compute_normals_parallel.
+vector<vec4f> compute_tangent_frames_parallel(const vector<vec3i>& triangles,
+    const vector<vec3f>& pos, const vector<vec3f>& norm,
+    const vector<vec2f>& texcoord, bool weighted) {
+    // the serial version wins below this size
+    if (pos.size() < (1 << 16))
+        return compute_tangent_frames(triangles, pos, norm, texcoord, weighted);
+
+    auto pool = get_global_pool();
+    auto nchunks = (int)pool->_threads.size() * 4;
+
+    // per-triangle tangents in parallel chunks
+    auto ttangu = vector<vec3f>(triangles.size());
+    auto ttangv = vector<vec3f>(triangles.size());
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto start = (int)(((int64_t)triangles.size() * c) / nchunks);
+        auto end = (int)(((int64_t)triangles.size() * (c + 1)) / nchunks);
+        for (auto i = start; i < end; i++) {
+            auto& t = triangles[i];
+            auto tutv = triangle_tangents_fromuv(pos[t.x], pos[t.y], pos[t.z],
+                texcoord[t.x], texcoord[t.y], texcoord[t.z]);
+            if (!weighted)
+                tutv = {normalize(tutv.first), normalize(tutv.second)};
+            ttangu[i] = tutv.first;
+            ttangv[i] = tutv.second;
+        }
+    });
+
+    // gather per vertex and orthonormalize in parallel chunks
+    auto nverts = (int)pos.size();
+    auto offsets = vector<int>(), adj = vector<int>();
+    vertex_adjacency(triangles, nverts, offsets, adj);
+    auto tangsp = vector<vec4f>(pos.size(), zero4f);
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto vmin = (int)(((int64_t)nverts * c) / nchunks);
+        auto vmax = (int)(((int64_t)nverts * (c + 1)) / nchunks);
+        for (auto i = vmin; i < vmax; i++) {
+            auto tangu = zero3f, tangv = zero3f;
+            for (auto k = offsets[i]; k < offsets[i + 1]; k++) {
+                tangu += ttangu[adj[k]];
+                tangv += ttangv[adj[k]];
+            }
+            auto tu = orthonormalize(normalize(tangu), norm[i]);
+            auto s = (dot(cross(norm[i], tu), normalize(tangv)) < 0) ? -1.0f :
+                                                                       1.0f;
+            tangsp[i] = {tu.x, tu.y, tu.z, s};
+        }
+    });
+    return tangsp;
+}
+
+// Fused skinning kernel over a vertex range, shared by the parallel
+// drivers below. Positions and normals are transformed in the same pass
+// so joints and weights are read once per vertex; per-vertex math is
+// unchanged from the serial versions.
+template <typename Xform>
+static void skin_vertex_range(int start, int end, const vec3f* pos,
+    const vec3f* norm, const vec4f* weights, const vec4i* joints,
+    const Xform* xforms, vec3f* skinned_pos, vec3f* skinned_norm) {
+    for (auto i = start; i < end; i++) {
+        auto& w = weights[i];
+        auto& j = joints[i];
+        skinned_pos[i] = transform_point(xforms[j.x], pos[i]) * w.x +
+                         transform_point(xforms[j.y], pos[i]) * w.y +
+                         transform_point(xforms[j.z], pos[i]) * w.z +
+                         transform_point(xforms[j.w], pos[i]) * w.w;
+        skinned_norm[i] =
+            normalize(transform_direction(xforms[j.x], norm[i]) * w.x +
+                      transform_direction(xforms[j.y], norm[i]) * w.y +
+                      transform_direction(xforms[j.z], norm[i]) * w.z +
+                      transform_direction(xforms[j.w], norm[i]) * w.w);
+    }
+}
+
+// Fused glTF matrix skinning over a vertex range. The blended matrix is
+// built once per vertex and applied to both position and normal. With
+// SSE the blend runs as sixteen column multiply-adds per vertex, loading
+// the four-wide weights directly as one simd lane; the operation order
+// matches the scalar path, so results are bit-identical.
+static void skin_matrix_vertex_range(int start, int end, const vec3f* pos,
+    const vec3f* norm, const vec4f* weights, const vec4i* joints,
+    const mat4f* xforms, vec3f* skinned_pos, vec3f* skinned_norm) {
+#if YGL_SSE
+    for (auto i = start; i < end; i++) {
+        auto& j = joints[i];
+        auto w = _mm_loadu_ps(&weights[i].x);
+        auto wx = _mm_shuffle_ps(w, w, _MM_SHUFFLE(0, 0, 0, 0));
+        auto wy = _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 1, 1, 1));
+        auto wz = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 2, 2));
+        auto ww = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128 cols[4];
+        for (auto c = 0; c < 4; c++) {
+            cols[c] = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_add_ps(
+                        _mm_mul_ps(_mm_loadu_ps(&xforms[j.x][c].x), wx),
+                        _mm_mul_ps(_mm_loadu_ps(&xforms[j.y][c].x), wy)),
+                    _mm_mul_ps(_mm_loadu_ps(&xforms[j.z][c].x), wz)),
+                _mm_mul_ps(_mm_loadu_ps(&xforms[j.w][c].x), ww));
+        }
+        // position: m * [p, 1], then the homogeneous divide
+        auto tp = _mm_add_ps(
+            _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(cols[0], _mm_set1_ps(pos[i].x)),
+                    _mm_mul_ps(cols[1], _mm_set1_ps(pos[i].y))),
+                _mm_mul_ps(cols[2], _mm_set1_ps(pos[i].z))),
+            cols[3]);
+        tp = _mm_div_ps(
+            tp, _mm_shuffle_ps(tp, tp, _MM_SHUFFLE(3, 3, 3, 3)));
+        float tpv[4];
+        _mm_storeu_ps(tpv, tp);
+        skinned_pos[i] = {tpv[0], tpv[1], tpv[2]};
+        // normal: m * [n, 0], normalized as in the scalar path
+        auto tn = _mm_add_ps(
+            _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(cols[0], _mm_set1_ps(norm[i].x)),
+                    _mm_mul_ps(cols[1], _mm_set1_ps(norm[i].y))),
+                _mm_mul_ps(cols[2], _mm_set1_ps(norm[i].z))),
+            _mm_mul_ps(cols[3], _mm_setzero_ps()));
+        float tnv[4];
+        _mm_storeu_ps(tnv, tn);
+        skinned_norm[i] = normalize(vec3f{tnv[0], tnv[1], tnv[2]});
+    }
+#else
+    for (auto i = start; i < end; i++) {
+        auto xform = xforms[joints[i].x] * weights[i].x +
+                     xforms[joints[i].y] * weights[i].y +
+                     xforms[joints[i].z] * weights[i].z +
+                     xforms[joints[i].w] * weights[i].w;
+        skinned_pos[i] = transform_point(xform, pos[i]);
+        skinned_norm[i] = transform_direction(xform, norm[i]);
+    }
+#endif
+}
+
+// Parallel driver shared by the skinning variants: resizes the output
+// buffers (a no-op when callers reuse them across frames) and dispatches
+// vertex ranges on the pool above a size threshold.
+template <typename Kernel>
+static void skin_parallel(size_t nverts, vector<vec3f>& skinned_pos,
+    vector<vec3f>& skinned_norm, const Kernel& kernel) {
+    skinned_pos.resize(nverts);
+    skinned_norm.resize(nverts);
+    // the serial version wins below this size
+    if (nverts < (1 << 14)) {
+        kernel(0, (int)nverts);
+        return;
+    }
+    auto pool = get_global_pool();
+    auto nchunks = (int)pool->_threads.size() * 4;
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto start = (int)(((int64_t)nverts * c) / nchunks);
+        auto end = (int)(((int64_t)nverts * (c + 1)) / nchunks);
+        kernel(start, end);
+    });
+}
+
+// Parallel compute_skinning for matrix transforms.
+void compute_skinning_parallel(const vector<vec3f>& pos,
+    const vector<vec3f>& norm, const vector<vec4f>& weights,
+    const vector<vec4i>& joints, const vector<mat4f>& xforms,
+    vector<vec3f>& skinned_pos, vector<vec3f>& skinned_norm) {
+    skin_parallel(pos.size(), skinned_pos, skinned_norm,
+        [&](int start, int end) {
+            skin_vertex_range(start, end, pos.data(), norm.data(),
+                weights.data(), joints.data(), xforms.data(),
+                skinned_pos.data(), skinned_norm.data());
+        });
+}
+
+// Parallel compute_skinning for frame transforms.
+void compute_skinning_parallel(const vector<vec3f>& pos,
+    const vector<vec3f>& norm, const vector<vec4f>& weights,
+    const vector<vec4i>& joints, const vector<frame3f>& xforms,
+    vector<vec3f>& skinned_pos, vector<vec3f>& skinned_norm) {
+    skin_parallel(pos.size(), skinned_pos, skinned_norm,
+        [&](int start, int end) {
+            skin_vertex_range(start, end, pos.data(), norm.data(),
+                weights.data(), joints.data(), xforms.data(),
+                skinned_pos.data(), skinned_norm.data());
+        });
+}
+
+// Parallel compute_matrix_skinning.
+void compute_matrix_skinning_parallel(const vector<vec3f>& pos,
+    const vector<vec3f>& norm, const vector<vec4f>& weights,
+    const vector<vec4i>& joints, const vector<mat4f>& xforms,
+    vector<vec3f>& skinned_pos, vector<vec3f>& skinned_norm) {
+    skin_parallel(pos.size(), skinned_pos, skinned_norm,
+        [&](int start, int end) {
+            skin_matrix_vertex_range(start, end, pos.data(), norm.data(),
+                weights.data(), joints.data(), xforms.data(),
+                skinned_pos.data(), skinned_norm.data());
+        });
+}
+
+// Parallel subdivide_vert through cached level maps.
+template <typename T>
+static vector<T> subdivide_vert_cached(thread_pool* pool, const vector<T>& vert,
+    const subdivision_cache::level& lvl) {
+    if (vert.empty()) return {};
+    auto eoff = (int)vert.size();
+    auto foff = eoff + (int)lvl.edges.size();
+    auto tvert = vector<T>(foff + lvl.faces.size());
+    auto nchunks = (int)pool->_threads.size() * 4;
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto chunk = [c, nchunks](size_t count, int& start, int& end) {
+            start = (int)(((int64_t)count * c) / nchunks);
+            end = (int)(((int64_t)count * (c + 1)) / nchunks);
+        };
+        auto start = 0, end = 0;
+        chunk(vert.size(), start, end);
+        for (auto i = start; i < end; i++) tvert[i] = vert[i];
+        chunk(lvl.edges.size(), start, end);
+        for (auto i = start; i < end; i++) {
+            auto& e = lvl.edges[i];
+            tvert[eoff + i] = (vert[e.x] + vert[e.y]) / 2;
+        }
+        chunk(lvl.faces.size(), start, end);
+        for (auto i = start; i < end; i++) {
+            auto& f = lvl.faces[i];
+            tvert[foff + i] =
+                (f.z != f.w) ?
+                    (vert[f.x] + vert[f.y] + vert[f.z] + vert[f.w]) / 4 :
+                    (vert[f.x] + vert[f.y] + vert[f.z]) / 3;
+        }
+    });
+    return tvert;
+}
+
+// Parallel Catmull-Clark smoothing through the cached gather maps.
+// Contributions are accumulated in element order, so results match
+// subdivide_catmullclark() exactly.
+template <typename T>
+static vector<T> smooth_vert_cached(thread_pool* pool, const vector<T>& vert,
+    const subdivision_cache::level& lvl) {
+    if (lvl.quads.empty() || vert.empty()) return vert;
+    auto nchunks = (int)pool->_threads.size() * 4;
+
+    // face centers and crease midpoints
+    auto fc = vector<T>(lvl.quads.size());
+    auto lc = vector<T>(lvl.boundary.size());
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto chunk = [c, nchunks](size_t count, int& start, int& end) {
+            start = (int)(((int64_t)count * c) / nchunks);
+            end = (int)(((int64_t)count * (c + 1)) / nchunks);
+        };
+        auto start = 0, end = 0;
+        chunk(lvl.quads.size(), start, end);
+        for (auto i = start; i < end; i++) {
+            auto& f = lvl.quads[i];
+            fc[i] = (vert[f.x] + vert[f.y] + vert[f.z] + vert[f.w]) / 4.0f;
+        }
+        chunk(lvl.boundary.size(), start, end);
+        for (auto i = start; i < end; i++) {
+            auto& e = lvl.boundary[i];
+            lc[i] = (vert[e.x] + vert[e.y]) / 2.0f;
+        }
+    });
+
+    // averaging and correction gathered per vertex
+    auto nverts = (int)vert.size();
+    auto tvert = vector<T>(vert.size());
+    parallel_for_nested(pool, nchunks, [&](int c) {
+        auto vmin = (int)(((int64_t)nverts * c) / nchunks);
+        auto vmax = (int)(((int64_t)nverts * (c + 1)) / nchunks);
+        for (auto i = vmin; i < vmax; i++) {
+            auto sum = T();
+            auto count = 0;
+            if (lvl.val[i] == 1) {
+                for (auto k = lvl.line_offsets[i]; k < lvl.line_offsets[i + 1];
+                     k++)
+                    sum += lc[lvl.line_adj[k]];
+                count = lvl.line_offsets[i + 1] - lvl.line_offsets[i];
+                tvert[i] = sum / (float)count;
+            } else {
+                for (auto k = lvl.quad_offsets[i]; k < lvl.quad_offsets[i + 1];
+                     k++)
+                    sum += fc[lvl.quad_adj[k]];
+                count = lvl.quad_offsets[i + 1] - lvl.quad_offsets[i];
+                tvert[i] = sum / (float)count;
+                tvert[i] = vert[i] + (tvert[i] - vert[i]) * (4.0f / count);
+            }
+        }
+    });
+    return tvert;
+}
+
+// Builds the cached subdivision topology by running the serial element
+// split once per level; construction order matches subdivide_shape() so
+// cached results are identical.
+subdivision_cache* make_subdivision_cache(
+    const shape* shp, int nlevels, bool subdiv) {
+    if (!shp->quads_pos.empty()) return nullptr;
+    if (shp->lines.empty() && shp->triangles.empty() && shp->quads.empty())
+        return nullptr;
+    auto cache = new subdivision_cache();
+    cache->subdiv = subdiv;
+    auto lines = shp->lines;
+    auto triangles = shp->triangles;
+    auto quads = shp->quads;
+    auto nverts = (int)shp->pos.size();
+    for (auto l = 0; l < nlevels; l++) {
+        auto lvl = subdivision_cache::level();
+        tie(lvl.lines, lvl.triangles, lvl.quads, lvl.edges, lvl.faces) =
+            subdivide_elems(lines, triangles, quads, nverts);
+        lvl.nverts = nverts + (int)lvl.edges.size() + (int)lvl.faces.size();
+        if (subdiv && !lvl.quads.empty()) {
+            lvl.boundary = get_boundary_edges({}, {}, lvl.quads);
+            lvl.val.assign(lvl.nverts, 2);
+            for (auto e : lvl.boundary)
+                for (auto vid : e) lvl.val[vid] = 1;
+            vertex_adjacency(
+                lvl.quads, lvl.nverts, lvl.quad_offsets, lvl.quad_adj);
+            vertex_adjacency(
+                lvl.boundary, lvl.nverts, lvl.line_offsets, lvl.line_adj);
+        }
+        lines = lvl.lines;
+        triangles = lvl.triangles;
+        quads = lvl.quads;
+        nverts = lvl.nverts;
+        cache->levels.push_back(std::move(lvl));
+    }
+    return cache;
+}
+
+// Re-subdivides vertex data through the cached topology.
+void subdivide_shape_cached(const shape* ctrl, shape* tess,
+    const subdivision_cache* cache, int nlevels) {
+    if (nlevels < 0 || nlevels > (int)cache->levels.size())
+        nlevels = (int)cache->levels.size();
+    if (!nlevels) return;
+    auto pool = get_global_pool();
+
+    auto pos = ctrl->pos;
+    auto norm = ctrl->norm;
+    auto texcoord = ctrl->texcoord;
+    auto color = ctrl->color;
+    auto radius = ctrl->radius;
+    for (auto l = 0; l < nlevels; l++) {
+        auto& lvl = cache->levels[l];
+        pos = subdivide_vert_cached(pool, pos, lvl);
+        texcoord = subdivide_vert_cached(pool, texcoord, lvl);
+        color = subdivide_vert_cached(pool, color, lvl);
+        radius = subdivide_vert_cached(pool, radius, lvl);
+        if (cache->subdiv && !lvl.quads.empty()) {
+            // normals are recomputed below, so skip their averaging
+            pos = smooth_vert_cached(pool, pos, lvl);
+            texcoord = smooth_vert_cached(pool, texcoord, lvl);
+            color = smooth_vert_cached(pool, color, lvl);
+            radius = smooth_vert_cached(pool, radius, lvl);
+        } else {
+            norm = subdivide_vert_cached(pool, norm, lvl);
+        }
+    }
+
+    auto& last = cache->levels[nlevels - 1];
+    tess->lines = last.lines;
+    tess->triangles = last.triangles;
+    tess->quads = last.quads;
+    tess->pos = pos;
+    tess->texcoord = texcoord;
+    tess->color = color;
+    tess->radius = radius;
+    if (cache->subdiv && !last.quads.empty()) {
+        tess->norm = compute_normals_parallel({}, {}, tess->quads, tess->pos);
+    } else {
+        tess->norm = norm;
+    }
+}
+
+// Symmetric 4x4 quadric for edge-collapse simplification, stored as the
+// ten unique coefficients of the plane error matrix.
+struct quadric {
+    double m[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+};
+
+// Accumulates a quadric.
+static quadric& operator+=(quadric& a, const quadric& b) {
+    for (auto i = 0; i < 10; i++) a.m[i] += b.m[i];
+    return a;
+}
+
+// Quadric of the plane with unit normal (a,b,c) and offset d.
+static quadric plane_quadric(double a, double b, double c, double d) {
+    return {{a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d,
+        d * d}};
+}
+
+// Quadric error of a point, i.e. its summed squared plane distances.
+static double quadric_error(const quadric& q, const vec3f& p) {
+    double x = p.x, y = p.y, z = p.z;
+    return q.m[0] * x * x + 2 * q.m[1] * x * y + 2 * q.m[2] * x * z +
+           2 * q.m[3] * x + q.m[4] * y * y + 2 * q.m[5] * y * z +
+           2 * q.m[6] * y + q.m[7] * z * z + 2 * q.m[8] * z + q.m[9];
+}
+
+// Edge-collapse simplification with quadric error metrics. Edges are
+// collapsed in passes under a growing error threshold rather than
+// through a mutable heap; each pass recomputes the vertex quadrics and
+// the vertex-to-triangle adjacency with the counting sort above, and
+// vertices touched by a collapse are left for the next pass. Collapses
+// that would flip a neighboring triangle or move the mesh boundary are
+// rejected.
+shape* simplify_shape(const shape* shp, int ntriangles) {
+    if (shp->triangles.empty() || !shp->points.empty() ||
+        !shp->lines.empty() || !shp->quads.empty() || !shp->quads_pos.empty())
+        return nullptr;
+
+    auto triangles = shp->triangles;
+    auto pos = shp->pos;
+    auto norm = shp->norm;
+    auto texcoord = shp->texcoord;
+    auto color = shp->color;
+    auto radius = shp->radius;
+    auto nverts = (int)pos.size();
+
+    // boundary vertices are kept in place
+    auto boundary = vector<bool>(nverts, false);
+    for (auto& e : get_boundary_edges({}, triangles, {})) {
+        boundary[e.x] = true;
+        boundary[e.y] = true;
+    }
+
+    // error thresholds are relative to the shape size
+    auto bbox = invalid_bbox3f;
+    for (auto& p : pos) bbox += p;
+    auto diag = bbox_diagonal(bbox);
+    auto scale = (double)dot(diag, diag);
+
+    auto ntris = (int)triangles.size();
+    auto quadrics = vector<quadric>(nverts);
+    vector<int> offsets, vrefs;
+    for (auto pass = 0; ntris > ntriangles && pass < 64; pass++) {
+        // plane quadrics accumulated per vertex
+        for (auto& q : quadrics) q = quadric();
+        for (auto& t : triangles) {
+            auto n = cross(pos[t.y] - pos[t.x], pos[t.z] - pos[t.x]);
+            if (n == zero3f) continue;
+            n = normalize(n);
+            auto q = plane_quadric(n.x, n.y, n.z, -dot(n, pos[t.x]));
+            quadrics[t.x] += q;
+            quadrics[t.y] += q;
+            quadrics[t.z] += q;
+        }
+        vertex_adjacency(triangles, nverts, offsets, vrefs);
+
+        // normal of a neighboring triangle with one vertex moved
+        auto moved_normal = [&](const vec3i& t, int vid, const vec3f& p) {
+            auto p0 = (t.x == vid) ? p : pos[t.x];
+            auto p1 = (t.y == vid) ? p : pos[t.y];
+            auto p2 = (t.z == vid) ? p : pos[t.z];
+            return cross(p1 - p0, p2 - p0);
+        };
+
+        auto threshold = 1e-9 * scale * pow((double)pass + 3, 5.0);
+        auto deleted = vector<bool>(triangles.size(), false);
+        auto dirty = vector<bool>(nverts, false);
+        for (auto tid = 0;
+             tid < (int)triangles.size() && ntris > ntriangles; tid++) {
+            if (deleted[tid]) continue;
+            for (auto j = 0; j < 3 && ntris > ntriangles; j++) {
+                auto v0 = triangles[tid][j];
+                auto v1 = triangles[tid][(j + 1) % 3];
+                if (v0 == v1 || dirty[v0] || dirty[v1]) continue;
+                if (boundary[v0] || boundary[v1]) continue;
+
+                // cheapest placement among the endpoints and the
+                // midpoint, which keeps the mesh inside its hull
+                auto q = quadrics[v0];
+                q += quadrics[v1];
+                auto tbest = 0.0f;
+                auto err = quadric_error(q, pos[v0]);
+                if (quadric_error(q, pos[v1]) < err) {
+                    err = quadric_error(q, pos[v1]);
+                    tbest = 1;
+                }
+                auto mid = (pos[v0] + pos[v1]) / 2.0f;
+                if (quadric_error(q, mid) < err) {
+                    err = quadric_error(q, mid);
+                    tbest = 0.5f;
+                }
+                if (err > threshold) continue;
+                auto p = pos[v0] + (pos[v1] - pos[v0]) * tbest;
+
+                // reject collapses that flip a neighboring triangle
+                auto flips = false;
+                for (auto vid : {v0, v1}) {
+                    for (auto k = offsets[vid];
+                         k < offsets[vid + 1] && !flips; k++) {
+                        auto& ot = triangles[vrefs[k]];
+                        if (deleted[vrefs[k]]) continue;
+                        auto nv0 = (ot.x == v0) + (ot.y == v0) + (ot.z == v0);
+                        auto nv1 = (ot.x == v1) + (ot.y == v1) + (ot.z == v1);
+                        if (nv0 && nv1) continue;  // collapses away
+                        auto n0 = moved_normal(ot, vid, pos[vid]);
+                        auto n1 = moved_normal(ot, vid, p);
+                        if (n1 == zero3f ||
+                            dot(normalize(n0), normalize(n1)) < 0.1f)
+                            flips = true;
+                    }
+                }
+                if (flips) continue;
+
+                // collapse v1 into v0 at the chosen placement
+                pos[v0] = p;
+                if (!norm.empty())
+                    norm[v0] = normalize(
+                        norm[v0] + (norm[v1] - norm[v0]) * tbest);
+                if (!texcoord.empty())
+                    texcoord[v0] =
+                        texcoord[v0] + (texcoord[v1] - texcoord[v0]) * tbest;
+                if (!color.empty())
+                    color[v0] = color[v0] + (color[v1] - color[v0]) * tbest;
+                if (!radius.empty())
+                    radius[v0] = radius[v0] + (radius[v1] - radius[v0]) * tbest;
+
+                // remap and drop degenerate triangles; touched vertices
+                // wait for the next pass, when the adjacency is rebuilt
+                for (auto vid : {v0, v1}) {
+                    for (auto k = offsets[vid]; k < offsets[vid + 1]; k++) {
+                        auto& ot = triangles[vrefs[k]];
+                        if (deleted[vrefs[k]]) continue;
+                        if (ot.x == v1) ot.x = v0;
+                        if (ot.y == v1) ot.y = v0;
+                        if (ot.z == v1) ot.z = v0;
+                        if (ot.x == ot.y || ot.y == ot.z || ot.z == ot.x) {
+                            deleted[vrefs[k]] = true;
+                            ntris--;
+                        } else {
+                            dirty[ot.x] = true;
+                            dirty[ot.y] = true;
+                            dirty[ot.z] = true;
+                        }
+                    }
+                }
+                dirty[v0] = true;
+                dirty[v1] = true;
+            }
+        }
+
+        // compact the triangles deleted this pass; early passes may
+        // collapse nothing until the threshold grows
+        auto kept = vector<vec3i>();
+        kept.reserve(ntris);
+        for (auto tid = 0; tid < (int)triangles.size(); tid++)
+            if (!deleted[tid]) kept.push_back(triangles[tid]);
+        triangles = kept;
+    }
+
+    // compact the vertices into the simplified shape
+    auto nshp = new shape();
+    nshp->name = shp->name;
+    nshp->path = shp->path;
+    nshp->mat = shp->mat;
+    auto vmap = vector<int>(nverts, -1);
+    for (auto& t : triangles) {
+        for (auto k = 0; k < 3; k++) {
+            auto vid = t[k];
+            if (vmap[vid] < 0) {
+                vmap[vid] = (int)nshp->pos.size();
+                nshp->pos += pos[vid];
+                if (!norm.empty()) nshp->norm += norm[vid];
+                if (!texcoord.empty()) nshp->texcoord += texcoord[vid];
+                if (!color.empty()) nshp->color += color[vid];
+                if (!radius.empty()) nshp->radius += radius[vid];
+            }
+            t[k] = vmap[vid];
+        }
+    }
+    nshp->triangles = triangles;
+    return nshp;
+}
+
+// Builds the lod chain by repeated halving. Each level simplifies the
+// previous one, so the whole chain costs little more than one pass over
+// the full mesh.
+void build_lods(shape* shp, int nlods, const bvh_build_params& params) {
+    for (auto lod : shp->lods) delete lod;
+    shp->lods.clear();
+    auto prev = shp;
+    for (auto l = 0; l < nlods; l++) {
+        auto target = (int)shp->triangles.size() >> (l + 1);
+        if (target < 32) break;
+        auto lod = simplify_shape(prev, target);
+        if (!lod) break;
+        if (lod->triangles.size() >= prev->triangles.size()) {
+            delete lod;
+            break;
+        }
+        build_bvh(lod, params);
+        shp->lods.push_back(lod);
+        prev = lod;
+    }
+}
+
+}  // namespace ygl
+
 // -----------------------------------------------------------------------------
 // IMPLEMENTATION FOR SHAPE EXAMPLES
 // -----------------------------------------------------------------------------
@@ -8346,7 +11920,8 @@ inline const vector<pair<string, test_light_type>>& test_light_names() {
 
 tuple<vector<instance*>, environment*> add_test_lights(
     scene* scn, test_light_type type) {
-    if (type == test_light_type::none) return {{}, nullptr};
+    if (type == test_light_type::none)
+        return {vector<instance*>{}, nullptr};
     switch (type) {
         case test_light_type::pointlight: {
             return {{add_test_instance(scn, test_shape_type::plight,
@@ -8379,7 +11954,8 @@ tuple<vector<instance*>, environment*> add_test_lights(
         } break;
         case test_light_type::envlight: {
             return {
-                {}, add_test_environment(scn, test_environment_type::sky1,
+                vector<instance*>{},
+                add_test_environment(scn, test_environment_type::sky1,
                         lookat_frame3f({0, 1, 0}, {0, 1, 1}, {0, 1, 0}, true))};
         } break;
         default: throw runtime_error("bad value");
@@ -8883,6 +12459,72 @@ void _update_texture(
     assert(gl_check_error());
 }
 
+// Implementation of update_texture_async. The dirty rows are copied
+// into the next pixel buffer of the pair and the texture copy is issued
+// from buffer memory, so it returns before the driver reads the pixels.
+void _update_texture_async(gl_texture& txt, gl_texture_stream& stream, int w,
+    int h, int nc, const void* pixels, bool floats, int ymin, int ymax) {
+    assert(gl_check_error());
+    auto row_bytes = (size_t)w * nc * ((floats) ? sizeof(float) : 1);
+    auto size = row_bytes * h;
+
+    // allocate the buffer pair on first use or growth
+    if (!stream._pbos[0] || stream._capacity < size) {
+        clear_texture_stream(stream);
+        glGenBuffers(2, stream._pbos);
+        for (auto b = 0; b < 2; b++) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream._pbos[b]);
+            glBufferData(
+                GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        stream._capacity = size;
+    }
+
+    // wait for the driver to release this buffer; with two buffers in
+    // flight this only blocks when uploads outpace drawing
+    auto cur = stream._next;
+    stream._next = (stream._next + 1) % 2;
+    if (stream._fences[cur]) {
+        glClientWaitSync((GLsync)stream._fences[cur],
+            GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)1000000000);
+        glDeleteSync((GLsync)stream._fences[cur]);
+        stream._fences[cur] = nullptr;
+    }
+
+    // copy the dirty rows and issue the texture update from the buffer
+    txt._width = w;
+    txt._height = h;
+    int formats[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    auto offset = row_bytes * ymin;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream._pbos[cur]);
+    glBufferSubData(GL_PIXEL_UNPACK_BUFFER, offset, row_bytes * (ymax - ymin),
+        (const char*)pixels + offset);
+    glBindTexture(GL_TEXTURE_2D, txt._tid);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, ymin, w, ymax - ymin,
+        formats[nc - 1], (floats) ? GL_FLOAT : GL_UNSIGNED_BYTE,
+        (const void*)offset);
+    if (txt._mipmap) glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    stream._fences[cur] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    assert(gl_check_error());
+}
+
+// Destroys the stream's buffers and fences.
+void clear_texture_stream(gl_texture_stream& stream) {
+    assert(gl_check_error());
+    if (stream._pbos[0]) glDeleteBuffers(2, stream._pbos);
+    stream._pbos[0] = stream._pbos[1] = 0;
+    for (auto b = 0; b < 2; b++) {
+        if (stream._fences[b]) glDeleteSync((GLsync)stream._fences[b]);
+        stream._fences[b] = nullptr;
+    }
+    stream._next = 0;
+    stream._capacity = 0;
+    assert(gl_check_error());
+}
+
 // Binds a texture to a texture unit
 void bind_texture(const gl_texture& txt, uint unit) {
     glActiveTexture(GL_TEXTURE0 + unit);
@@ -9016,6 +12658,25 @@ void draw_elems(const gl_element_buffer& buf) {
     assert(gl_check_error());
 }
 
+// Draws elements with hardware instancing.
+void draw_elems_instanced(const gl_element_buffer& buf, int ninstances) {
+    if (!buf._bid || !ninstances) return;
+    assert(gl_check_error());
+    int mode = 0;
+    switch (buf._ncomp) {
+        case 1: mode = GL_POINTS; break;
+        case 2: mode = GL_LINES; break;
+        case 3: mode = GL_TRIANGLES; break;
+        case 4: mode = GL_QUADS; break;
+        default: assert(false);
+    };
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buf._bid);
+    glDrawElementsInstanced(
+        mode, buf._ncomp * buf._num, GL_UNSIGNED_INT, 0, ninstances);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    assert(gl_check_error());
+}
+
 // Destroys the buffer
 void clear_element_buffer(gl_element_buffer& buf) {
     assert(gl_check_error());
@@ -9300,6 +12961,34 @@ bool set_program_vertattr(
     return true;
 }
 
+// Sets a per-instance mat4 vertex attribute from a buffer of packed
+// matrix columns (four vec4 per instance), advanced once per instance
+// via attribute divisors. Pass an invalid buffer to disable the
+// attribute and reset the divisors for later non-instanced draws.
+bool set_program_vertattr_instanced(
+    gl_program& prog, const string& var, const gl_vertex_buffer& buf) {
+    assert(gl_check_error());
+    int pos = glGetAttribLocation(prog._pid, var.c_str());
+    if (pos < 0) return false;
+    if (is_vertex_buffer_valid(buf)) {
+        glBindBuffer(GL_ARRAY_BUFFER, buf._bid);
+        for (auto i = 0; i < 4; i++) {
+            glEnableVertexAttribArray(pos + i);
+            glVertexAttribPointer(pos + i, 4, GL_FLOAT, false,
+                sizeof(float) * 16, (void*)(size_t)(sizeof(float) * 4 * i));
+            glVertexAttribDivisor(pos + i, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    } else {
+        for (auto i = 0; i < 4; i++) {
+            glDisableVertexAttribArray(pos + i);
+            glVertexAttribDivisor(pos + i, 0);
+        }
+    }
+    assert(gl_check_error());
+    return true;
+}
+
 // Sets a vartex attribute for program pid and variable var. The attribute
 // has nc components and either buffer bid or a single value def
 // (if bid is zero). Convenience wrapper to above functions.
@@ -9501,8 +13190,10 @@ gl_stdsurface_program make_stdsurface_program() {
         layout(location = 2) in vec2 vert_texcoord;       // vertex texcoords
         layout(location = 3) in vec4 vert_color;          // vertex color
         layout(location = 4) in vec4 vert_tangsp;         // vertex tangent space
+        layout(location = 8) in mat4 vert_ist_xform;      // per-instance transform (instanced draws)
 
         uniform mat4 shape_xform;           // shape transform
+        uniform bool shape_instanced;       // whether to use per-instance transforms
 
         struct Camera {
             mat4 xform;          // camera xform
@@ -9525,9 +13216,10 @@ gl_stdsurface_program make_stdsurface_program() {
             tangsp = vert_tangsp;
 
             // world projection
-            pos = (shape_xform * vec4(pos,1)).xyz;
-            norm = (shape_xform * vec4(norm,0)).xyz;
-            tangsp.xyz = (shape_xform * vec4(tangsp.xyz,0)).xyz;
+            mat4 xform = (shape_instanced) ? vert_ist_xform : shape_xform;
+            pos = (xform * vec4(pos,1)).xyz;
+            norm = (xform * vec4(norm,0)).xyz;
+            tangsp.xyz = (xform * vec4(tangsp.xyz,0)).xyz;
 
             // skinning
             apply_skin(pos, norm);
@@ -264,7 +264,7 @@
 /// 8. various noise images with `make_noise_image()`, `make_fbm_image()`,
 ///    `make_ridge_image()`, `make_turbulence_image()`
 /// 9. image loading and saving with `load_image4b()`, `load_image4f()`,
-///    `save_image4b()`, `save_image4f()`
+///    `load_image4h()`, `save_image4b()`, `save_image4f()`, `save_image4h()`
 /// 10. image resizing with `resize_image()`
 ///
 ///
@@ -285,6 +285,11 @@
 /// 5. to support custom elements, use `buid_bvh()`, `intersect_bvh()` and
 ///   `overlap_bvh()` and provide them with proper callbacks
 /// 6. we also experimentally support quads with the `xxx_quads_xxx()` functions
+/// 7. for dense, uniformly distributed overlap queries, a uniform hash grid
+///   is available as an alternative to the BVH: build it with
+///   `build_points_grid()`, `build_lines_grid()` or `build_triangles_grid()`,
+///   query with the `overlap_xxx_grid()` functions and rebucket deforming
+///   geometry incrementally with the `update_xxx_grid()` functions
 ///
 ///
 /// ### Simple scene
@@ -714,6 +719,11 @@
 #define YGL_GLTFJSON 0
 #endif
 
+// enable render statistics counters on the tracer hot paths
+#ifndef YGL_STATS
+#define YGL_STATS 0
+#endif
+
 // -----------------------------------------------------------------------------
 // INCLUDES
 // -----------------------------------------------------------------------------
@@ -748,6 +758,15 @@
 #define constexpr
 #endif
 
+// use SSE for ray packet traversal when available
+#if defined(__SSE2__) || (defined(_M_X64) || \
+                             (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define YGL_SSE 1
+#include <emmintrin.h>
+#else
+#define YGL_SSE 0
+#endif
+
 // Compilation option
 #define YGL_FAST_RANDFLOAT 1
 
@@ -2596,6 +2615,12 @@ inline vec3f bbox_center(const bbox3f& a) { return (a.min + a.max) / 2.0f; }
 /// computes the diagonal of a bbox
 inline vec3f bbox_diagonal(const bbox3f& a) { return a.max - a.min; }
 
+/// computes the surface area of a bbox
+inline float bbox_area(const bbox3f& a) {
+    auto d = bbox_diagonal(a);
+    return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
+}
+
 /// computes the center of a bbox
 inline vec4f bbox_center(const bbox4f& a) { return (a.min + a.max) / 2.0f; }
 /// computes the diagonal of a bbox
@@ -3944,6 +3969,64 @@ inline bool contains(const unordered_map<K, V>& v, const K& vv) {
 
 }  // namespace ygl
 
+// -----------------------------------------------------------------------------
+// MEMORY ARENA
+// -----------------------------------------------------------------------------
+namespace ygl {
+
+/// Growing memory arena for pointer-heavy object graphs. Objects are
+/// placement-constructed contiguously in large blocks with make(), so
+/// graphs built in loading order iterate cache-friendly, and the whole
+/// graph is destroyed wholesale when the arena is deleted instead of
+/// with one allocator call per object. Used by the scene and obj loaders
+/// (see the arena member of scene and obj_scene).
+struct memory_arena {
+    /// allocates raw zeroed storage from the current block
+    void* alloc(size_t size, size_t align) {
+        auto offset = (_used + align - 1) & ~(align - 1);
+        if (_blocks.empty() || offset + size > _blocks.back().second) {
+            auto nbytes = (size_t)_block_size;
+            if (size > nbytes) nbytes = size;
+            _blocks.push_back({new char[nbytes](), nbytes});
+            offset = 0;
+        }
+        _used = offset + size;
+        return _blocks.back().first + offset;
+    }
+
+    /// constructs an object inside the arena; destroyed with the arena
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        auto ptr = new (alloc(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+        _dtors += {ptr, [](void* p) { ((T*)p)->~T(); }};
+        return (T*)ptr;
+    }
+
+    /// checks whether a pointer was allocated from this arena
+    bool owns(const void* ptr) const {
+        for (auto& block : _blocks)
+            if (ptr >= block.first && ptr < block.first + block.second)
+                return true;
+        return false;
+    }
+
+    /// runs object destructors in reverse order and frees the blocks
+    ~memory_arena() {
+        for (auto i = (int)_dtors.size() - 1; i >= 0; i--)
+            _dtors[i].second(_dtors[i].first);
+        for (auto& block : _blocks) delete[] block.first;
+    }
+
+   private:
+    static const size_t _block_size = 1 << 20;
+    vector<pair<char*, size_t>> _blocks;
+    size_t _used = 0;
+    vector<pair<void*, void (*)(void*)>> _dtors;
+};
+
+}  // namespace ygl
+
 // -----------------------------------------------------------------------------
 // GEOMETRY UTILITIES
 // -----------------------------------------------------------------------------
@@ -4187,6 +4270,21 @@ inline vector<vec4f> compute_tangent_frames(const vector<vec3i>& triangles,
     return tangsp;
 }
 
+/// Parallel version of compute_normals() for large meshes. Per-element
+/// values are computed in parallel chunks, then accumulated without
+/// atomics by binning vertices into one contiguous range per thread, so
+/// results match the serial version exactly. Falls back to it below a
+/// size threshold.
+vector<vec3f> compute_normals_parallel(const vector<vec2i>& lines,
+    const vector<vec3i>& triangles, const vector<vec4i>& quads,
+    const vector<vec3f>& pos, bool weighted = true);
+
+/// Parallel version of compute_tangent_frames(); same scheme as
+/// compute_normals_parallel().
+vector<vec4f> compute_tangent_frames_parallel(const vector<vec3i>& triangles,
+    const vector<vec3f>& pos, const vector<vec3f>& norm,
+    const vector<vec2f>& texcoord, bool weighted = true);
+
 /// Apply skinning
 inline void compute_skinning(const vector<vec3f>& pos,
     const vector<vec3f>& norm, const vector<vec4f>& weights,
@@ -4246,10 +4344,37 @@ inline void compute_matrix_skinning(const vector<vec3f>& pos,
                      xforms[joints[i].z] * weights[i].z +
                      xforms[joints[i].w] * weights[i].w;
         skinned_pos[i] = transform_point(xform, pos[i]);
-        skinned_norm[i] = normalize(transform_direction(xform, norm[i]));
+        skinned_norm[i] = transform_direction(xform, norm[i]);
     }
 }
 
+/// Parallel version of compute_skinning(). Vertex ranges run on the
+/// global thread pool with positions and normals transformed in one
+/// fused pass, so joints and weights are read once per vertex. Output
+/// buffers are only resized, so callers that keep them across frames
+/// skip the per-frame allocation. Falls back to the serial version
+/// below a size threshold.
+void compute_skinning_parallel(const vector<vec3f>& pos,
+    const vector<vec3f>& norm, const vector<vec4f>& weights,
+    const vector<vec4i>& joints, const vector<mat4f>& xforms,
+    vector<vec3f>& skinned_pos, vector<vec3f>& skinned_norm);
+
+/// Parallel version of compute_skinning() for frame transforms.
+void compute_skinning_parallel(const vector<vec3f>& pos,
+    const vector<vec3f>& norm, const vector<vec4f>& weights,
+    const vector<vec4i>& joints, const vector<frame3f>& xforms,
+    vector<vec3f>& skinned_pos, vector<vec3f>& skinned_norm);
+
+/// Parallel version of compute_matrix_skinning(). The blended glTF
+/// matrix is computed once per vertex and applied to both position and
+/// normal; with SSE the blend runs as sixteen column multiply-adds,
+/// loading the four-wide weights directly as one simd lane. Results
+/// match the serial version exactly.
+void compute_matrix_skinning_parallel(const vector<vec3f>& pos,
+    const vector<vec3f>& norm, const vector<vec4f>& weights,
+    const vector<vec4i>& joints, const vector<mat4f>& xforms,
+    vector<vec3f>& skinned_pos, vector<vec3f>& skinned_norm);
+
 /// Create an array of edges.
 inline vector<vec2i> get_edges(const vector<vec2i>& lines,
     const vector<vec3i>& triangles, const vector<vec4i>& quads) {
@@ -5035,6 +5160,156 @@ struct image4b {
     vector<vec4b> _d;
 };
 
+/// Half float stored as 16 bits (ieee binary16). Storage only; convert
+/// to float to operate on values.
+struct half {
+    /// raw bits
+    uint16_t bits = 0;
+};
+
+/// Converts a float to half with round to nearest.
+inline half float_to_half(float v) {
+    auto f = (uint32_t)0;
+    memcpy(&f, &v, sizeof(f));
+    auto sign = (uint16_t)((f >> 16) & 0x8000);
+    auto em = (int)((f >> 23) & 0xff) - 112;
+    auto m = f & 0x7fffff;
+    auto h = half();
+    if (em >= 31) {
+        // overflow to infinity, preserving nans
+        h.bits = (uint16_t)(sign | 0x7c00 | ((em == 143 && m) ? 0x200 : 0));
+    } else if (em > 0) {
+        // normalized; a mantissa carry bumps the exponent correctly
+        h.bits =
+            (uint16_t)(sign | (((uint32_t)em << 10) + ((m + 0x1000) >> 13)));
+    } else if (em >= -10) {
+        // denormalized
+        auto shift = 14 - em;
+        h.bits = (uint16_t)(
+            sign | ((m | 0x800000) + (1u << (shift - 1))) >> shift);
+    } else {
+        // underflow to zero
+        h.bits = sign;
+    }
+    return h;
+}
+
+/// Converts a half to float.
+inline float half_to_float(half h) {
+    auto em = (h.bits >> 10) & 0x1f;
+    auto m = (uint32_t)(h.bits & 0x3ff);
+    if (!em) {
+        // denormals are exact in float
+        auto v = (float)m * 5.9604644775390625e-08f;
+        return (h.bits & 0x8000) ? -v : v;
+    }
+    auto f = (uint32_t)((h.bits & 0x8000) << 16) | (m << 13) |
+             ((em == 31) ? 0x7f800000 : (uint32_t)(em + 112) << 23);
+    auto v = 0.0f;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+/// Vector of 4 half elements. Storage only.
+struct vec4h {
+    /// element data
+    half x, y, z, w;
+};
+
+/// half zero vector
+const auto zero4h = vec4h();
+
+/// Converts a float color to half storage.
+inline vec4h float_to_half(const vec4f& a) {
+    return {float_to_half(a.x), float_to_half(a.y), float_to_half(a.z),
+        float_to_half(a.w)};
+}
+/// Converts a half color to float.
+inline vec4f half_to_float(const vec4h& a) {
+    return {half_to_float(a.x), half_to_float(a.y), half_to_float(a.z),
+        half_to_float(a.w)};
+}
+
+/// HDR image with half float storage, half the memory of image4f. Used
+/// for large textures and auxiliary render buffers.
+struct image4h {
+    /// empty image constructor
+    image4h() : _w{0}, _h{0}, _d{} {}
+    /// image constructor
+    image4h(int w, int h, const vec4h& v = zero4h)
+        : _w{w}, _h{h}, _d(size_t(w * h), v) {}
+    /// image constructor
+    image4h(int w, int h, const vec4h* v) : _w{w}, _h{h}, _d(v, v + w * h) {}
+
+    /// width
+    int width() const { return _w; }
+    /// height
+    int height() const { return _h; }
+    /// size
+    vec2i size() const { return {_w, _h}; }
+    /// check for empty
+    bool empty() const { return _w == 0 || _h == 0; }
+    /// check for empty
+    explicit operator bool() const { return _w != 0 && _h != 0; }
+
+    /// reallocate memory
+    void resize(int w, int h, const vec4h& v = zero4h) {
+        _w = w;
+        _h = h;
+        _d.resize(_w * _h);
+    }
+    /// reallocate memory
+    void assign(int w, int h, const vec4h& v) {
+        _w = w;
+        _h = h;
+        _d.assign(_w * _h, v);
+    }
+
+    /// set values
+    void set(const vec4h& v) { _d.assign(_w * _h, v); }
+
+    /// element access
+    vec4h& operator[](const vec2i& ij) { return _d[ij.y * _w + ij.x]; }
+    /// element access
+    const vec4h& operator[](const vec2i& ij) const {
+        return _d[ij.y * _w + ij.x];
+    }
+    /// element access
+    vec4h& at(const vec2i& ij) { return _d.at(ij.y * _w + ij.x); }
+    /// element access
+    const vec4h& at(const vec2i& ij) const { return _d.at(ij.y * _w + ij.x); }
+    /// element access
+    vec4h& at(int i, int j) { return _d.at(j * _w + i); }
+    /// element access
+    const vec4h& at(int i, int j) const { return _d.at(j * _w + i); }
+
+    /// data access
+    vec4h* data() { return _d.data(); }
+    /// data access
+    const vec4h* data() const { return _d.data(); }
+
+   private:
+    int _w, _h;
+    vector<vec4h> _d;
+};
+
+/// Converts a float image to half storage.
+inline image4h float_to_half(const image4f& img) {
+    auto ret = image4h(img.width(), img.height());
+    for (auto j = 0; j < img.height(); j++)
+        for (auto i = 0; i < img.width(); i++)
+            ret[{i, j}] = float_to_half(img[{i, j}]);
+    return ret;
+}
+/// Converts a half image to float.
+inline image4f half_to_float(const image4h& img) {
+    auto ret = image4f(img.width(), img.height());
+    for (auto j = 0; j < img.height(); j++)
+        for (auto i = 0; i < img.width(); i++)
+            ret[{i, j}] = half_to_float(img[{i, j}]);
+    return ret;
+}
+
 }  // namespace ygl
 
 // -----------------------------------------------------------------------------
@@ -5117,27 +5392,12 @@ inline float tonemap_filmic(float x) {
 }
 #endif
 
-/// Tone mapping HDR to LDR images.
-inline image4b tonemap_image(
-    const image4f& hdr, float exposure, float gamma, bool filmic = false) {
-    auto ldr = image4b(hdr.width(), hdr.height());
-    auto scale = pow(2.0f, exposure);
-    for (auto j = 0; j < hdr.height(); j++) {
-        for (auto i = 0; i < hdr.width(); i++) {
-            auto h = hdr[{i, j}];
-            h.xyz() *= scale;
-            if (filmic) {
-                h.xyz() = {tonemap_filmic(h.x), tonemap_filmic(h.y),
-                    tonemap_filmic(h.z)};
-            } else {
-                h.xyz() = {pow(h.x, 1 / gamma), pow(h.y, 1 / gamma),
-                    pow(h.z, 1 / gamma)};
-            }
-            ldr[{i, j}] = float_to_byte(h);
-        }
-    }
-    return ldr;
-}
+/// Tone mapping HDR to LDR images. Scanline ranges run in parallel on
+/// the global thread pool, with an SSE-vectorized curve when available;
+/// vectorized results may differ from the scalar ones by at most one
+/// lsb of the byte output.
+image4b tonemap_image(
+    const image4f& hdr, float exposure, float gamma, bool filmic = false);
 
 /// Image over operator
 inline void image_over(
@@ -5482,12 +5742,75 @@ image4b load_image4b(const string& filename);
 /// Loads an hdr image.
 image4f load_image4f(const string& filename);
 
+/// Loads an hdr image into half float storage.
+image4h load_image4h(const string& filename);
+
 /// Saves an ldr image.
 bool save_image4b(const string& filename, const image4b& img);
 
 /// Saves an hdr image.
 bool save_image4f(const string& filename, const image4f& img);
 
+/// Saves an hdr image stored as half floats.
+bool save_image4h(const string& filename, const image4h& img);
+
+/// Incremental image writer for progressive renders. Writes an
+/// uncompressed float RGBA OpenEXR file whose fixed-size scanline chunks
+/// can be rewritten in place, keeps the file open, and flushes only the
+/// rows marked dirty since the last update from a background thread, so
+/// the renderer never stalls on image encoding or I/O. Create with
+/// make_incremental_writer(); deleting the writer does a final flush and
+/// closes the file.
+struct incremental_image_writer {
+    /// output filename
+    string filename;
+    /// image width
+    int width = 0;
+    /// image height
+    int height = 0;
+
+    // private data ---------------------
+    /// output file, kept open for in-place updates
+    FILE* _file = nullptr;
+    /// offset of the first scanline chunk
+    size_t _data_offset = 0;
+    /// latest pixels handed to the writer
+    image4f _img;
+    /// per-row dirty flags since the last flush
+    vector<bool> _dirty;
+    /// protects _img and _dirty
+    std::mutex _mutex;
+    /// wakes the writer thread
+    std::condition_variable _condition;
+    /// set while the writer thread has rows in flight
+    bool _writing = false;
+    /// set to stop the writer thread
+    bool _stop = false;
+    /// background writer thread
+    std::thread _thread;
+
+    /// final flush, stop the writer thread and close the file
+    ~incremental_image_writer();
+};
+
+/// Creates an incremental image writer for a width x height float RGBA
+/// OpenEXR file and writes its header and an all-zero image. Returns
+/// nullptr if the file cannot be opened. The writer is owned by the
+/// caller.
+incremental_image_writer* make_incremental_writer(
+    const string& filename, int width, int height);
+
+/// Hands a region of pixels to an incremental writer, marking the
+/// covered rows dirty and waking the writer thread. Pass the default
+/// size to update the whole image. Cheap to call per tile or per sample
+/// batch; actual file writes happen on the writer thread.
+void update_incremental_writer(incremental_image_writer* wrt,
+    const image4f& img, const vec2i& origin = {0, 0},
+    const vec2i& size = {-1, -1});
+
+/// Blocks until every row marked dirty so far is on disk.
+void flush_incremental_writer(incremental_image_writer* wrt);
+
 /// Loads an image
 vector<float> load_imagef(
     const string& filename, int& width, int& height, int& ncomp);
@@ -6082,6 +6405,55 @@ inline bool overlap_bbox(const bbox3f& bbox1, const bbox3f& bbox2) {
 
 }  // namespace ygl
 
+// -----------------------------------------------------------------------------
+// RENDER STATISTICS
+// -----------------------------------------------------------------------------
+namespace ygl {
+
+#if YGL_STATS
+
+/// Counters incremented on the tracer hot paths when the library is
+/// compiled with YGL_STATS. Each thread accumulates into its own block,
+/// so counting adds no contention; `get_render_stats()` sums the blocks.
+/// When YGL_STATS is off the increments compile to nothing.
+struct render_stats {
+    /// closest-hit rays cast
+    uint64_t rays = 0;
+    /// any-hit (shadow) rays cast
+    uint64_t shadow_rays = 0;
+    /// bvh nodes visited
+    uint64_t bvh_nodes = 0;
+    /// ray-primitive tests in bvh leaves
+    uint64_t bvh_leaf_tests = 0;
+    /// texture lookups
+    uint64_t texture_fetches = 0;
+    /// camera samples traced
+    uint64_t samples = 0;
+};
+
+/// This thread's counter block, registered on first use.
+render_stats& thread_render_stats();
+
+/// Sum of the counters over all threads, including exited ones.
+render_stats get_render_stats();
+
+/// Snapshot of the per-thread counter blocks of the live threads.
+vector<render_stats> get_thread_render_stats();
+
+/// Zeroes all counters. Call with no tracing in flight.
+void clear_render_stats();
+
+#endif
+
+}  // namespace ygl
+
+// increments a counter when stats are compiled in
+#if YGL_STATS
+#define YGL_STAT(field, count) (ygl::thread_render_stats().field += (count))
+#else
+#define YGL_STAT(field, count) ((void)0)
+#endif
+
 // -----------------------------------------------------------------------------
 // BVH FOR RAY INTERSECTION AND CLOSEST ELEMENT
 // -----------------------------------------------------------------------------
@@ -6090,6 +6462,44 @@ namespace ygl {
 // number of primitives to avoid splitting on
 const int bvh_minprims = 4;
 
+// maximum number of bins used by the binned sah heuristic
+const int bvh_max_sah_bins = 64;
+
+/// Heuristic used to pick splits during BVH construction.
+enum struct bvh_heuristic_type {
+    /// binned surface area heuristic
+    binned_sah = 0,
+    /// space split in the middle along the largest axis
+    middle,
+    /// balanced tree splitting primitives in two equal sets
+    equalnum,
+};
+
+/// Parameters for BVH construction. The defaults trade a slightly slower
+/// build for the faster traces of a surface-area-heuristic tree.
+struct bvh_build_params {
+    /// split heuristic
+    bvh_heuristic_type heuristic = bvh_heuristic_type::binned_sah;
+    /// number of bins used by the binned sah heuristic
+    int sah_nbins = 16;
+    /// estimated cost of traversing an internal node (sah)
+    float sah_cost_internal = 1.0f;
+    /// estimated cost of intersecting one element (sah)
+    float sah_cost_element = 2.0f;
+    /// number of primitives to avoid splitting on
+    int min_prims = bvh_minprims;
+    /// also collapse the tree into wide nodes for vectorized traversal
+    bool wide = false;
+};
+
+// Maps the legacy equalsize flag onto build params.
+inline bvh_build_params bvh_params_from_equalsize(bool equalsize) {
+    auto params = bvh_build_params();
+    params.heuristic = (equalsize) ? bvh_heuristic_type::middle :
+                                     bvh_heuristic_type::equalnum;
+    return params;
+}
+
 /// BVH tree node containing its bounds, indices to the BVH arrays of either
 /// sorted primitives or internal nodes, whether its a leaf or an internal node,
 /// and the split axis. Leaf and internal nodes are identical, except that
@@ -6110,6 +6520,31 @@ struct bvh_node {
     uint8_t axis;
 };
 
+/// Number of children of a wide BVH node.
+const int bvh_wide_width = 4;
+
+/// Wide BVH node holding up to bvh_wide_width children with their bounds
+/// stored in structure-of-arrays form, so a single vector op tests all
+/// children against a ray. A slot is empty if its count is zero and its
+/// child index is negative; a leaf slot has a negative child index and a
+/// positive count; an internal slot stores the index of another wide node.
+/// Each slot remembers the binary node it collapsed, for refits.
+///
+/// This is an internal data structure.
+struct alignas(16) bvh_wide_node {
+    /// children bounds, one component array at a time
+    float minx[bvh_wide_width], miny[bvh_wide_width], minz[bvh_wide_width];
+    float maxx[bvh_wide_width], maxy[bvh_wide_width], maxz[bvh_wide_width];
+    /// index of the child wide node, or -1 for leaves and empty slots
+    int child[bvh_wide_width];
+    /// index to the first sorted primitive for leaf slots
+    int start[bvh_wide_width];
+    /// number of primitives for leaf slots, zero otherwise
+    uint16_t count[bvh_wide_width];
+    /// collapsed binary node, used to refresh bounds on refits
+    int nodeid[bvh_wide_width];
+};
+
 /// BVH tree, stored as a node array. The tree structure is encoded using array
 /// indices instead of pointers, both for speed but also to simplify code.
 /// BVH nodes indices refer to either the node array, for internal nodes,
@@ -6118,6 +6553,9 @@ struct bvh_node {
 /// To handle multiple primitive types and transformed primitices, build
 /// a two-level hierarchy with the outer BVH, the scene BVH, containing inner
 /// BVHs, shape BVHs, each of which of a uniform primitive type.
+/// A wide-node layout collapsing the binary tree may additionally be built
+/// with `make_wide_bvh()`; when present it is used transparently by the
+/// intersection and overlap queries.
 ///
 /// This is an internal data structure.
 struct bvh_tree {
@@ -6125,6 +6563,8 @@ struct bvh_tree {
     vector<bvh_node> nodes;
     /// sorted elements
     vector<int> sorted_prim;
+    /// wide nodes collapsed from the binary tree (empty if not built)
+    vector<bvh_wide_node> wide_nodes;
 };
 
 // Struct that pack a bounding box, its associate primitive index, and other
@@ -6157,82 +6597,265 @@ struct bvh_bound_prim_comp {
 // or initializing it as a leaf. When splitting, the heuristic heuristic is
 // used and nodes added sequentially in the preallocated nodes array and
 // the number of nodes nnodes is updated.
+// Computes the split axis and position for the primitives in the range
+// [start, end) with the chosen heuristic, partitioning sorted_prims around
+// the split point mid. Returns false if the range is better kept as a leaf.
+inline bool split_bvh_prims(bvh_bound_prim* sorted_prims, int start, int end,
+    const bvh_build_params& params, int& axis, int& mid) {
+    // initialize split to default values
+    axis = 0;
+    mid = (start + end) / 2;
+
+    // compute primintive bounds and size
+    auto centroid_bbox = invalid_bbox3f;
+    for (auto i = start; i < end; i++) centroid_bbox += sorted_prims[i].center;
+    auto centroid_size = bbox_diagonal(centroid_bbox);
+
+    // check if it is not possible to split
+    if (centroid_size == zero3f) return false;
+
+    // split along largest
+    auto largest_axis = max_element(centroid_size).first;
+
+    // check heuristic
+    switch (params.heuristic) {
+        case bvh_heuristic_type::binned_sah: {
+            // bin the primitives along the largest centroid axis
+            auto nbins = clamp(params.sah_nbins, 2, bvh_max_sah_bins);
+            bbox3f bin_bbox[bvh_max_sah_bins];
+            int bin_count[bvh_max_sah_bins];
+            for (auto b = 0; b < nbins; b++) {
+                bin_bbox[b] = invalid_bbox3f;
+                bin_count[b] = 0;
+            }
+            auto cmin = centroid_bbox.min[largest_axis];
+            auto csize = centroid_size[largest_axis];
+            for (auto i = start; i < end; i++) {
+                auto b = clamp(
+                    (int)(nbins *
+                          (sorted_prims[i].center[largest_axis] - cmin) /
+                          csize),
+                    0, nbins - 1);
+                bin_bbox[b] += sorted_prims[i].bbox;
+                bin_count[b] += 1;
+            }
+
+            // sweep from the right accumulating bounds and counts
+            bbox3f right_bbox[bvh_max_sah_bins];
+            int right_count[bvh_max_sah_bins];
+            right_bbox[nbins - 1] = bin_bbox[nbins - 1];
+            right_count[nbins - 1] = bin_count[nbins - 1];
+            for (auto b = nbins - 2; b >= 0; b--) {
+                right_bbox[b] = right_bbox[b + 1];
+                right_bbox[b] += bin_bbox[b];
+                right_count[b] = right_count[b + 1] + bin_count[b];
+            }
+
+            // sweep from the left evaluating the sah cost of the
+            // candidate split after each bin and keep the cheapest
+            auto best_bin = -1;
+            auto best_cost = flt_max;
+            auto left_bbox = invalid_bbox3f;
+            auto left_count = 0;
+            for (auto b = 0; b < nbins - 1; b++) {
+                left_bbox += bin_bbox[b];
+                left_count += bin_count[b];
+                if (!left_count || !right_count[b + 1]) continue;
+                auto cost = params.sah_cost_internal +
+                            params.sah_cost_element *
+                                (bbox_area(left_bbox) * left_count +
+                                    bbox_area(right_bbox[b + 1]) *
+                                        right_count[b + 1]) /
+                                bbox_area(right_bbox[0]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_bin = b;
+                }
+            }
+
+            // make a leaf if no split is cheaper than intersecting
+            // all the primitives directly
+            auto leaf_cost = params.sah_cost_element * (end - start);
+            if (best_bin < 0 || best_cost >= leaf_cost) return false;
+
+            // partition at the chosen bin boundary
+            axis = largest_axis;
+            auto split_pos = cmin + csize * (best_bin + 1) / (float)nbins;
+            mid = (int)(std::partition(sorted_prims + start,
+                            sorted_prims + end,
+                            bvh_bound_prim_comp(largest_axis, split_pos)) -
+                        sorted_prims);
+
+            // fall back to a balanced split if the partition
+            // degenerated for numerical reasons
+            if (mid == start || mid == end) {
+                mid = (start + end) / 2;
+                std::nth_element(sorted_prims + start, sorted_prims + mid,
+                    sorted_prims + end, bvh_bound_prim_comp(largest_axis));
+            }
+        } break;
+        case bvh_heuristic_type::middle: {
+            // split the space in the middle along the largest axis
+            axis = largest_axis;
+            mid = (int)(std::partition(sorted_prims + start, sorted_prims + end,
+                            bvh_bound_prim_comp(largest_axis,
+                                bbox_center(centroid_bbox)[largest_axis])) -
+                        sorted_prims);
+        } break;
+        case bvh_heuristic_type::equalnum: {
+            // balanced tree split: find the largest axis of the bounding
+            // box and split along this one right in the middle
+            axis = largest_axis;
+            mid = (start + end) / 2;
+            std::nth_element(sorted_prims + start, sorted_prims + mid,
+                sorted_prims + end, bvh_bound_prim_comp(largest_axis));
+        } break;
+    }
+
+    // check correctness
+    assert(axis >= 0 && mid > 0);
+    assert(mid > start && mid < end);
+    return true;
+}
+
 inline void make_bvh_node(bvh_node* node, vector<bvh_node>& nodes,
-    bvh_bound_prim* sorted_prims, int start, int end, bool equalsize) {
+    bvh_bound_prim* sorted_prims, int start, int end,
+    const bvh_build_params& params) {
     // compute node bounds
     node->bbox = invalid_bbox3f;
     for (auto i = start; i < end; i++) node->bbox += sorted_prims[i].bbox;
 
-    // decide whether to create a leaf
-    if (end - start <= bvh_minprims) {
+    // choose the split axis and position, or decide to create a leaf
+    auto axis = 0, mid = 0;
+    if (end - start <= params.min_prims ||
+        !split_bvh_prims(sorted_prims, start, end, params, axis, mid)) {
         // makes a leaf node
         node->isleaf = true;
         node->start = start;
         node->count = end - start;
     } else {
-        // choose the split axis and position
-        // init to default values
-        auto axis = 0;
-        auto mid = (start + end) / 2;
-
-        // compute primintive bounds and size
-        auto centroid_bbox = invalid_bbox3f;
-        for (auto i = start; i < end; i++)
-            centroid_bbox += sorted_prims[i].center;
-        auto centroid_size = bbox_diagonal(centroid_bbox);
-
-        // check if it is not possible to split
-        if (centroid_size == zero3f) {
-            // we failed to split for some reasons
-            node->isleaf = true;
-            node->start = start;
-            node->count = end - start;
-        } else {
-            // split along largest
-            auto largest_axis = max_element(centroid_size).first;
-
-            // check heuristic
-            if (equalsize) {
-                // split the space in the middle along the largest axis
-                axis = largest_axis;
-                mid = (int)(std::partition(sorted_prims + start,
-                                sorted_prims + end,
-                                bvh_bound_prim_comp(largest_axis,
-                                    bbox_center(centroid_bbox)[largest_axis])) -
-                            sorted_prims);
+        // makes an internal node
+        node->isleaf = false;
+        // perform the splits by preallocating the child nodes and recurring
+        node->axis = axis;
+        node->start = (int)nodes.size();
+        node->count = 2;
+        nodes.emplace_back();
+        nodes.emplace_back();
+        // build child nodes
+        make_bvh_node(
+            &nodes[node->start], nodes, sorted_prims, start, mid, params);
+        make_bvh_node(
+            &nodes[node->start + 1], nodes, sorted_prims, mid, end, params);
+    }
+}
+
+/// Collapse the binary tree of a built BVH into wide nodes, storing the
+/// children bounds in SoA form. Each wide node absorbs a binary node and
+/// up to bvh_wide_width of its descendants, preferring to expand the
+/// descendant with the largest bounds. The binary nodes are kept, since
+/// they remain the source of truth for refits and pair queries.
+inline void make_wide_bvh(bvh_tree* bvh) {
+    bvh->wide_nodes.clear();
+    if (bvh->nodes.empty()) return;
+
+    // stack of (wide node, collapsed binary node) pairs
+    auto stack = vector<vec2i>();
+    bvh->wide_nodes.emplace_back();
+    stack.push_back({0, 0});
+    while (!stack.empty()) {
+        auto item = stack.back();
+        stack.pop_back();
+
+        // gather up to bvh_wide_width descendants, repeatedly expanding
+        // the internal one with the largest bounds
+        int slots[bvh_wide_width];
+        auto nslots = 0;
+        slots[nslots++] = item.y;
+        while (nslots < bvh_wide_width) {
+            auto expand = -1;
+            auto expand_area = -flt_max;
+            for (auto s = 0; s < nslots; s++) {
+                auto& node = bvh->nodes[slots[s]];
+                if (node.isleaf) continue;
+                auto area = bbox_area(node.bbox);
+                if (area > expand_area) {
+                    expand = s;
+                    expand_area = area;
+                }
+            }
+            if (expand < 0) break;
+            auto node = bvh->nodes[slots[expand]];
+            slots[expand] = node.start;
+            slots[nslots++] = node.start + 1;
+        }
+
+        // fill the wide node, allocating children for internal slots
+        for (auto s = 0; s < bvh_wide_width; s++) {
+            auto wnode = &bvh->wide_nodes[item.x];
+            if (s >= nslots) {
+                // empty slot: inverted bounds that never hit
+                wnode->minx[s] = flt_max;
+                wnode->miny[s] = flt_max;
+                wnode->minz[s] = flt_max;
+                wnode->maxx[s] = -flt_max;
+                wnode->maxy[s] = -flt_max;
+                wnode->maxz[s] = -flt_max;
+                wnode->child[s] = -1;
+                wnode->start[s] = 0;
+                wnode->count[s] = 0;
+                wnode->nodeid[s] = -1;
+                continue;
+            }
+            auto& node = bvh->nodes[slots[s]];
+            wnode->minx[s] = node.bbox.min.x;
+            wnode->miny[s] = node.bbox.min.y;
+            wnode->minz[s] = node.bbox.min.z;
+            wnode->maxx[s] = node.bbox.max.x;
+            wnode->maxy[s] = node.bbox.max.y;
+            wnode->maxz[s] = node.bbox.max.z;
+            wnode->nodeid[s] = slots[s];
+            if (node.isleaf) {
+                wnode->child[s] = -1;
+                wnode->start[s] = node.start;
+                wnode->count[s] = node.count;
             } else {
-                // balanced tree split: find the largest axis of the bounding
-                // box and split along this one right in the middle
-                axis = largest_axis;
-                mid = (start + end) / 2;
-                std::nth_element(sorted_prims + start, sorted_prims + mid,
-                    sorted_prims + end, bvh_bound_prim_comp(largest_axis));
+                auto childid = (int)bvh->wide_nodes.size();
+                bvh->wide_nodes.emplace_back();
+                // re-grab the node pointer after the potential realloc
+                wnode = &bvh->wide_nodes[item.x];
+                wnode->child[s] = childid;
+                wnode->start[s] = 0;
+                wnode->count[s] = 0;
+                stack.push_back({childid, slots[s]});
             }
+        }
+    }
+}
 
-            // check correctness
-            assert(axis >= 0 && mid > 0);
-            assert(mid > start && mid < end);
-
-            // makes an internal node
-            node->isleaf = false;
-            // perform the splits by preallocating the child nodes and recurring
-            node->axis = axis;
-            node->start = (int)nodes.size();
-            node->count = 2;
-            nodes.emplace_back();
-            nodes.emplace_back();
-            // build child nodes
-            make_bvh_node(&nodes[node->start], nodes, sorted_prims, start, mid,
-                equalsize);
-            make_bvh_node(&nodes[node->start + 1], nodes, sorted_prims, mid,
-                end, equalsize);
+// Refreshes the wide node bounds from the refitted binary nodes.
+inline void refit_wide_bvh(bvh_tree* bvh) {
+    for (auto& wnode : bvh->wide_nodes) {
+        for (auto s = 0; s < bvh_wide_width; s++) {
+            if (wnode.nodeid[s] < 0) continue;
+            auto& bbox = bvh->nodes[wnode.nodeid[s]].bbox;
+            wnode.minx[s] = bbox.min.x;
+            wnode.miny[s] = bbox.min.y;
+            wnode.minz[s] = bbox.min.z;
+            wnode.maxx[s] = bbox.max.x;
+            wnode.maxy[s] = bbox.max.y;
+            wnode.maxz[s] = bbox.max.z;
         }
     }
 }
 
-/// Build a BVH from a set of primitives.
+/// Build a BVH from a set of primitives. The bounds functor is taken as a
+/// deduced template parameter so that per-primitive bounds computation
+/// inlines into the build loop; on large builds the indirect call of the
+/// `function`-based overload is measurable.
+template <typename ElemBbox>
 inline bvh_tree* build_bvh(
-    int nprims, bool equalsize, const function<bbox3f(int)>& elem_bbox) {
+    int nprims, const bvh_build_params& params, const ElemBbox& elem_bbox) {
     // allocate if needed
     auto bvh = new bvh_tree();
 
@@ -6254,7 +6877,7 @@ inline bvh_tree* build_bvh(
     // start recursive splitting
     bvh->nodes.emplace_back();
     make_bvh_node(
-        &bvh->nodes[0], bvh->nodes, bound_prims.data(), 0, nprims, equalsize);
+        &bvh->nodes[0], bvh->nodes, bound_prims.data(), 0, nprims, params);
 
     // shrink back
     bvh->nodes.shrink_to_fit();
@@ -6267,63 +6890,118 @@ inline bvh_tree* build_bvh(
         bvh->sorted_prim[i] = bound_prims[i].pid;
     }
 
+    // optionally collapse into wide nodes
+    if (params.wide) make_wide_bvh(bvh);
+
     // done
     return bvh;
 }
 
+/// Build a BVH from a set of primitives (legacy interface).
+inline bvh_tree* build_bvh(
+    int nprims, bool equalsize, const function<bbox3f(int)>& elem_bbox) {
+    return build_bvh(nprims, bvh_params_from_equalsize(equalsize), elem_bbox);
+}
+
+// forward declaration
+struct thread_pool;
+
+/// Build a BVH from a set of primitives, building independent subtrees
+/// concurrently on the thread pool. The top of the tree is split serially
+/// until there are enough subtrees to keep all threads busy. Pass a null
+/// pool to use the global one. The resulting tree is identical to the one
+/// produced by `build_bvh()` with the same params.
+bvh_tree* build_bvh_parallel(int nprims, const bvh_build_params& params,
+    const function<bbox3f(int)>& elem_bbox, thread_pool* pool = nullptr);
+
 /// Build a triangles BVH.
 inline bvh_tree* build_triangles_bvh(const vector<vec3i>& triangles,
-    const vector<vec3f>& pos, bool equal_size = true) {
+    const vector<vec3f>& pos, const bvh_build_params& params = {}) {
     return build_bvh(
-        (int)triangles.size(), equal_size, [&triangles, &pos](int eid) {
+        (int)triangles.size(), params, [&triangles, &pos](int eid) {
             auto f = triangles[eid];
             return triangle_bbox(pos[f.x], pos[f.y], pos[f.z]);
         });
 }
 
+/// Build a triangles BVH (legacy interface).
+inline bvh_tree* build_triangles_bvh(const vector<vec3i>& triangles,
+    const vector<vec3f>& pos, bool equal_size) {
+    return build_triangles_bvh(
+        triangles, pos, bvh_params_from_equalsize(equal_size));
+}
+
 /// Build a quads BVH.
 inline bvh_tree* build_quads_bvh(const vector<vec4i>& quads,
-    const vector<vec3f>& pos, bool equal_size = true) {
-    return build_bvh((int)quads.size(), equal_size, [&quads, &pos](int eid) {
+    const vector<vec3f>& pos, const bvh_build_params& params = {}) {
+    return build_bvh((int)quads.size(), params, [&quads, &pos](int eid) {
         auto f = quads[eid];
         return quad_bbox(pos[f.x], pos[f.y], pos[f.z], pos[f.w]);
     });
 }
 
+/// Build a quads BVH (legacy interface).
+inline bvh_tree* build_quads_bvh(
+    const vector<vec4i>& quads, const vector<vec3f>& pos, bool equal_size) {
+    return build_quads_bvh(quads, pos, bvh_params_from_equalsize(equal_size));
+}
+
 /// Build a lines BVH.
 inline bvh_tree* build_lines_bvh(const vector<vec2i>& lines,
     const vector<vec3f>& pos, const vector<float>& radius,
-    bool equal_size = true) {
+    const bvh_build_params& params = {}) {
     return build_bvh(
-        (int)lines.size(), equal_size, [&lines, &pos, &radius](int eid) {
+        (int)lines.size(), params, [&lines, &pos, &radius](int eid) {
             auto f = lines[eid];
             return line_bbox(pos[f.x], pos[f.y], radius[f.x], radius[f.y]);
         });
 }
 
+/// Build a lines BVH (legacy interface).
+inline bvh_tree* build_lines_bvh(const vector<vec2i>& lines,
+    const vector<vec3f>& pos, const vector<float>& radius, bool equal_size) {
+    return build_lines_bvh(
+        lines, pos, radius, bvh_params_from_equalsize(equal_size));
+}
+
 /// Build a points BVH.
 inline bvh_tree* build_points_bvh(const vector<int>& points,
     const vector<vec3f>& pos, const vector<float>& radius,
-    bool equal_size = true) {
+    const bvh_build_params& params = {}) {
     return build_bvh(
-        (int)points.size(), equal_size, [&points, &pos, &radius](int eid) {
+        (int)points.size(), params, [&points, &pos, &radius](int eid) {
             auto f = points[eid];
             return point_bbox(pos[f], radius[f]);
         });
 }
 
+/// Build a points BVH (legacy interface).
+inline bvh_tree* build_points_bvh(const vector<int>& points,
+    const vector<vec3f>& pos, const vector<float>& radius, bool equal_size) {
+    return build_points_bvh(
+        points, pos, radius, bvh_params_from_equalsize(equal_size));
+}
+
 /// Build a points BVH.
 inline bvh_tree* build_points_bvh(const vector<vec3f>& pos,
-    const vector<float>& radius, bool equal_size = true) {
-    return build_bvh((int)pos.size(), equal_size, [&pos, &radius](int eid) {
+    const vector<float>& radius, const bvh_build_params& params = {}) {
+    return build_bvh((int)pos.size(), params, [&pos, &radius](int eid) {
         auto r = (radius.empty()) ? 0.00001f : radius[eid];
         return point_bbox(pos[eid], r);
     });
 }
 
-/// Recursively recomputes the node bounds for a shape bvh
-inline void refit_bvh(
-    bvh_tree* bvh, int nodeid, const function<bbox3f(int)>& elem_bbox) {
+/// Build a points BVH (legacy interface).
+inline bvh_tree* build_points_bvh(
+    const vector<vec3f>& pos, const vector<float>& radius, bool equal_size) {
+    return build_points_bvh(pos, radius, bvh_params_from_equalsize(equal_size));
+}
+
+/// Recursively recomputes the node bounds for a shape bvh. As for
+/// `build_bvh()`, the bounds functor is a deduced template parameter so
+/// that per-element bounds inline into the leaf refit loop.
+template <typename ElemBbox>
+inline void refit_bvh(bvh_tree* bvh, int nodeid, const ElemBbox& elem_bbox) {
     // refit
     auto node = &bvh->nodes[nodeid];
     node->bbox = invalid_bbox3f;
@@ -6339,6 +7017,9 @@ inline void refit_bvh(
             node->bbox += bvh->nodes[idx].bbox;
         }
     }
+
+    // propagate the refit to the wide layout if it was built
+    if (!nodeid && !bvh->wide_nodes.empty()) refit_wide_bvh(bvh);
 }
 
 /// Refit triangles bvh
@@ -6413,10 +7094,130 @@ inline void refit_points_bvh(
     refit_points_bvh(bvh, pos.data(), radius.data());
 }
 
+// Tests the children bounds of a wide node against a ray with the same
+// robust slab test used by the binary traversal, vectorized with SSE when
+// available. Entry distances are written to tmins and a bitmask of the
+// hit children is returned.
+inline int intersect_check_bbox(const ray3f& ray, const vec3f& ray_dinv,
+    const bvh_wide_node& node, float* tmins) {
+#if YGL_SSE
+    auto ox = _mm_set1_ps(ray.o.x), oy = _mm_set1_ps(ray.o.y),
+         oz = _mm_set1_ps(ray.o.z);
+    auto dx = _mm_set1_ps(ray_dinv.x), dy = _mm_set1_ps(ray_dinv.y),
+         dz = _mm_set1_ps(ray_dinv.z);
+    auto t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minx), ox), dx);
+    auto t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxx), ox), dx);
+    auto t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.miny), oy), dy);
+    auto t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxy), oy), dy);
+    auto t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minz), oz), dz);
+    auto t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxz), oz), dz);
+    auto tmin = _mm_max_ps(
+        _mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+        _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_set1_ps(ray.tmin)));
+    auto tmax = _mm_min_ps(
+        _mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+        _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(ray.tmax)));
+    tmax = _mm_mul_ps(tmax, _mm_set1_ps(1.00000024f));
+    _mm_storeu_ps(tmins, tmin);
+    return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+#else
+    auto mask = 0;
+    for (auto s = 0; s < bvh_wide_width; s++) {
+        auto t0x = (node.minx[s] - ray.o.x) * ray_dinv.x;
+        auto t1x = (node.maxx[s] - ray.o.x) * ray_dinv.x;
+        auto t0y = (node.miny[s] - ray.o.y) * ray_dinv.y;
+        auto t1y = (node.maxy[s] - ray.o.y) * ray_dinv.y;
+        auto t0z = (node.minz[s] - ray.o.z) * ray_dinv.z;
+        auto t1z = (node.maxz[s] - ray.o.z) * ray_dinv.z;
+        auto tmin = _safemax(_safemin(t0z, t1z),
+            _safemax(_safemin(t0y, t1y), _safemax(_safemin(t0x, t1x), ray.tmin)));
+        auto tmax = _safemin(_safemax(t0z, t1z),
+            _safemin(_safemax(t0y, t1y), _safemin(_safemax(t0x, t1x), ray.tmax)));
+        tmax *= 1.00000024f;
+        tmins[s] = tmin;
+        if (tmin <= tmax) mask |= 1 << s;
+    }
+    return mask;
+#endif
+}
+
+// Intersect ray with the wide layout of a bvh. Children of each node are
+// tested with one vectorized slab test and visited front to back.
+inline bool intersect_wide_bvh(const bvh_tree* bvh, const ray3f& ray_,
+    bool early_exit, float& ray_t, int& eid,
+    const function<bool(int, const ray3f&, float&)>& intersect_elem) {
+    // node stack
+    int node_stack[128];
+    auto node_cur = 0;
+    node_stack[node_cur++] = 0;
+
+    // shared variables
+    auto hit = false;
+
+    // copy ray to modify it
+    auto ray = ray_;
+
+    // prepare ray for fast queries
+    auto ray_dinv = vec3f{1, 1, 1} / ray.d;
+
+    // walking stack
+    while (node_cur) {
+        // grab node
+        auto& node = bvh->wide_nodes[node_stack[--node_cur]];
+        YGL_STAT(bvh_nodes, 1);
+
+        // intersect children bounds all at once
+        float tmins[bvh_wide_width];
+        auto mask = intersect_check_bbox(ray, ray_dinv, node, tmins);
+        if (!mask) continue;
+
+        // order the hit children by entry distance
+        int order[bvh_wide_width];
+        auto nord = 0;
+        for (auto s = 0; s < bvh_wide_width; s++) {
+            if (!(mask & (1 << s))) continue;
+            auto k = nord++;
+            while (k && tmins[order[k - 1]] < tmins[s]) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = s;
+        }
+
+        // visit children farthest first so the closest is popped first,
+        // intersecting leaf slots immediately
+        for (auto k = 0; k < nord; k++) {
+            auto s = order[k];
+            if (node.child[s] >= 0) {
+                node_stack[node_cur++] = node.child[s];
+                assert(node_cur < 128);
+            } else {
+                YGL_STAT(bvh_leaf_tests, node.count[s]);
+                for (auto i = 0; i < node.count[s]; i++) {
+                    auto idx = bvh->sorted_prim[node.start[s] + i];
+                    if (intersect_elem(idx, ray, ray_t)) {
+                        hit = true;
+                        ray.tmax = ray_t;
+                        eid = idx;
+                        if (early_exit) return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return hit;
+}
+
 /// Intersect ray with a bvh.
 inline bool intersect_bvh(const bvh_tree* bvh, const ray3f& ray_,
     bool early_exit, float& ray_t, int& eid,
     const function<bool(int, const ray3f&, float&)>& intersect_elem) {
+    // use the wide layout when it was built
+    if (!bvh->wide_nodes.empty())
+        return intersect_wide_bvh(
+            bvh, ray_, early_exit, ray_t, eid, intersect_elem);
+
     // node stack
     int node_stack[64];
     auto node_cur = 0;
@@ -6439,6 +7240,7 @@ inline bool intersect_bvh(const bvh_tree* bvh, const ray3f& ray_,
     while (node_cur) {
         // grab node
         auto node = bvh->nodes[node_stack[--node_cur]];
+        YGL_STAT(bvh_nodes, 1);
 
         // intersect bbox
         if (!intersect_check_bbox(ray, ray_dinv, ray_dsign, node.bbox))
@@ -6463,6 +7265,7 @@ inline bool intersect_bvh(const bvh_tree* bvh, const ray3f& ray_,
                 }
             }
         } else {
+            YGL_STAT(bvh_leaf_tests, node.count);
             for (auto i = 0; i < node.count; i++) {
                 auto idx = bvh->sorted_prim[node.start + i];
                 if (intersect_elem(idx, ray, ray_t)) {
@@ -6478,12 +7281,176 @@ inline bool intersect_bvh(const bvh_tree* bvh, const ray3f& ray_,
     return hit;
 }
 
-/// Finds the closest element with a bvh.
-inline bool overlap_bvh(const bvh_tree* bvh, const vec3f& pos, float max_dist,
-    bool early_exit, float& dist, int& eid,
+/// Number of rays traversed together by the ray-stream interface.
+const int bvh_packet_size = 4;
+
+// A packet of rays in SoA layout so that bbox tests can be vectorized
+// across lanes. Lanes beyond the ray count carry degenerate rays that
+// never hit. This is an internal data structure.
+struct alignas(16) bvh_ray_packet {
+    float ox[bvh_packet_size], oy[bvh_packet_size], oz[bvh_packet_size];
+    float dinvx[bvh_packet_size], dinvy[bvh_packet_size],
+        dinvz[bvh_packet_size];
+    float tmin[bvh_packet_size], tmax[bvh_packet_size];
+};
+
+// Tests a bbox against all rays of a packet with the same robust slab test
+// used by the scalar traversal, vectorized with SSE when available.
+// Returns a bitmask of the lanes whose rays hit the bbox.
+inline int intersect_check_bbox(const bvh_ray_packet& pkt, const bbox3f& bbox) {
+#if YGL_SSE
+    auto t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.min.x),
+                              _mm_load_ps(pkt.ox)),
+        _mm_load_ps(pkt.dinvx));
+    auto t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.max.x),
+                              _mm_load_ps(pkt.ox)),
+        _mm_load_ps(pkt.dinvx));
+    auto t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.min.y),
+                              _mm_load_ps(pkt.oy)),
+        _mm_load_ps(pkt.dinvy));
+    auto t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.max.y),
+                              _mm_load_ps(pkt.oy)),
+        _mm_load_ps(pkt.dinvy));
+    auto t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.min.z),
+                              _mm_load_ps(pkt.oz)),
+        _mm_load_ps(pkt.dinvz));
+    auto t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.max.z),
+                              _mm_load_ps(pkt.oz)),
+        _mm_load_ps(pkt.dinvz));
+    auto tmin = _mm_max_ps(
+        _mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+        _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_load_ps(pkt.tmin)));
+    auto tmax = _mm_min_ps(
+        _mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+        _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_load_ps(pkt.tmax)));
+    tmax = _mm_mul_ps(tmax, _mm_set1_ps(1.00000024f));
+    return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+#else
+    auto mask = 0;
+    for (auto l = 0; l < bvh_packet_size; l++) {
+        auto t0x = (bbox.min.x - pkt.ox[l]) * pkt.dinvx[l];
+        auto t1x = (bbox.max.x - pkt.ox[l]) * pkt.dinvx[l];
+        auto t0y = (bbox.min.y - pkt.oy[l]) * pkt.dinvy[l];
+        auto t1y = (bbox.max.y - pkt.oy[l]) * pkt.dinvy[l];
+        auto t0z = (bbox.min.z - pkt.oz[l]) * pkt.dinvz[l];
+        auto t1z = (bbox.max.z - pkt.oz[l]) * pkt.dinvz[l];
+        auto tmin = _safemax(_safemin(t0z, t1z),
+            _safemax(_safemin(t0y, t1y),
+                _safemax(_safemin(t0x, t1x), pkt.tmin[l])));
+        auto tmax = _safemin(_safemax(t0z, t1z),
+            _safemin(_safemax(t0y, t1y),
+                _safemin(_safemax(t0x, t1x), pkt.tmax[l])));
+        tmax *= 1.00000024f;
+        if (tmin <= tmax) mask |= 1 << l;
+    }
+    return mask;
+#endif
+}
+
+/// Intersect a stream of rays with a bvh, traversing packets of
+/// bvh_packet_size rays together so that bbox tests are amortized and
+/// vectorized across coherent rays. Hit distances and element ids are
+/// written per ray, with eids[i] left at -1 on a miss. The callback is
+/// invoked per ray like in the scalar interface, with the additional ray
+/// index so that callers can record per-ray data. With early_exit, rays
+/// are retired from the packet on their first hit. Returns the number of
+/// rays that hit.
+inline int intersect_bvh(const bvh_tree* bvh, const ray3f* rays, int nrays,
+    bool early_exit, float* ray_ts, int* eids,
+    const function<bool(int, int, const ray3f&, float&)>& intersect_elem) {
+    auto nhits = 0;
+    for (auto first = 0; first < nrays; first += bvh_packet_size) {
+        auto n = min(bvh_packet_size, nrays - first);
+
+        // local ray copies for element tests and per-lane tmax updates
+        ray3f prays[bvh_packet_size];
+        for (auto l = 0; l < n; l++) prays[l] = rays[first + l];
+
+        // pack rays in SoA order; tail lanes are made to miss everything
+        bvh_ray_packet pkt;
+        for (auto l = 0; l < bvh_packet_size; l++) {
+            auto& ray = prays[min(l, n - 1)];
+            pkt.ox[l] = ray.o.x;
+            pkt.oy[l] = ray.o.y;
+            pkt.oz[l] = ray.o.z;
+            pkt.dinvx[l] = 1 / ray.d.x;
+            pkt.dinvy[l] = 1 / ray.d.y;
+            pkt.dinvz[l] = 1 / ray.d.z;
+            pkt.tmin[l] = (l < n) ? ray.tmin : flt_max;
+            pkt.tmax[l] = (l < n) ? ray.tmax : -flt_max;
+        }
+
+        // initialize outputs
+        for (auto l = 0; l < n; l++) eids[first + l] = -1;
+
+        // traversal order follows the first ray of the packet
+        auto ray_reverse = array<bool, 4>{{pkt.dinvx[0] < 0, pkt.dinvy[0] < 0,
+            pkt.dinvz[0] < 0, false}};
+
+        // node stack
+        int node_stack[64];
+        auto node_cur = 0;
+        node_stack[node_cur++] = 0;
+
+        // lanes still looking for a hit
+        auto active = (1 << n) - 1;
+
+        // walking stack
+        while (node_cur && active) {
+            // grab node
+            auto node = bvh->nodes[node_stack[--node_cur]];
+            YGL_STAT(bvh_nodes, 1);
+
+            // intersect bbox for all lanes at once
+            auto mask = intersect_check_bbox(pkt, node.bbox) & active;
+            if (!mask) continue;
+
+            // intersect node, switching based on node type
+            // for each type, iterate over the the primitive list
+            if (!node.isleaf) {
+                // for internal nodes, attempts to proceed along the
+                // split axis from smallest to largest nodes
+                if (ray_reverse[node.axis]) {
+                    for (auto i = 0; i < node.count; i++) {
+                        auto idx = node.start + i;
+                        node_stack[node_cur++] = idx;
+                        assert(node_cur < 64);
+                    }
+                } else {
+                    for (auto i = node.count - 1; i >= 0; i--) {
+                        auto idx = node.start + i;
+                        node_stack[node_cur++] = idx;
+                        assert(node_cur < 64);
+                    }
+                }
+            } else {
+                YGL_STAT(bvh_leaf_tests, node.count);
+                for (auto i = 0; i < node.count; i++) {
+                    auto idx = bvh->sorted_prim[node.start + i];
+                    for (auto l = 0; l < n; l++) {
+                        if (!(mask & (1 << l))) continue;
+                        auto& ray_t = ray_ts[first + l];
+                        if (intersect_elem(idx, first + l, prays[l], ray_t)) {
+                            if (eids[first + l] < 0) nhits += 1;
+                            prays[l].tmax = ray_t;
+                            pkt.tmax[l] = ray_t;
+                            eids[first + l] = idx;
+                            if (early_exit) active &= ~(1 << l);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return nhits;
+}
+
+// Finds the closest element using the wide layout of a bvh.
+inline bool overlap_wide_bvh(const bvh_tree* bvh, const vec3f& pos,
+    float max_dist, bool early_exit, float& dist, int& eid,
     const function<bool(int, const vec3f&, float, float&)>& overlap_elem) {
     // node stack
-    int node_stack[64];
+    int node_stack[128];
     auto node_cur = 0;
     node_stack[node_cur++] = 0;
 
@@ -6493,7 +7460,126 @@ inline bool overlap_bvh(const bvh_tree* bvh, const vec3f& pos, float max_dist,
     // walking stack
     while (node_cur) {
         // grab node
-        auto node = bvh->nodes[node_stack[--node_cur]];
+        auto& node = bvh->wide_nodes[node_stack[--node_cur]];
+
+        // check children bounds
+        for (auto s = 0; s < bvh_wide_width; s++) {
+            if (node.nodeid[s] < 0) continue;
+            auto bbox = bbox3f{{node.minx[s], node.miny[s], node.minz[s]},
+                {node.maxx[s], node.maxy[s], node.maxz[s]}};
+            if (!distance_check_bbox(pos, max_dist, bbox)) continue;
+            if (node.child[s] >= 0) {
+                node_stack[node_cur++] = node.child[s];
+                assert(node_cur < 128);
+            } else {
+                for (auto i = 0; i < node.count[s]; i++) {
+                    auto idx = bvh->sorted_prim[node.start[s] + i];
+                    if (overlap_elem(idx, pos, max_dist, dist)) {
+                        hit = true;
+                        max_dist = dist;
+                        eid = idx;
+                        if (early_exit) return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return hit;
+}
+
+/// Test whether a ray is occluded by any element in a bvh. Unlike
+/// `intersect_bvh()` with early_exit, this traversal keeps no hit record
+/// and no front-to-back ordering: nodes are visited in stack order and
+/// the walk stops at the first occluding element. The callback only has
+/// to report whether an element blocks the ray.
+inline bool intersect_bvh_occluded(const bvh_tree* bvh, const ray3f& ray,
+    const function<bool(int, const ray3f&)>& occluded_elem) {
+    // node stack
+    int node_stack[128];
+    auto node_cur = 0;
+    node_stack[node_cur++] = 0;
+
+    // prepare ray for fast queries
+    auto ray_dinv = vec3f{1, 1, 1} / ray.d;
+    auto ray_dsign = vec3i{(ray_dinv.x < 0) ? 1 : 0, (ray_dinv.y < 0) ? 1 : 0,
+        (ray_dinv.z < 0) ? 1 : 0};
+
+    // use the wide layout when it was built
+    if (!bvh->wide_nodes.empty()) {
+        while (node_cur) {
+            auto& node = bvh->wide_nodes[node_stack[--node_cur]];
+            YGL_STAT(bvh_nodes, 1);
+            float tmins[bvh_wide_width];
+            auto mask = intersect_check_bbox(ray, ray_dinv, node, tmins);
+            if (!mask) continue;
+            for (auto s = 0; s < bvh_wide_width; s++) {
+                if (!(mask & (1 << s))) continue;
+                if (node.child[s] >= 0) {
+                    node_stack[node_cur++] = node.child[s];
+                    assert(node_cur < 128);
+                } else {
+                    YGL_STAT(bvh_leaf_tests, node.count[s]);
+                    for (auto i = 0; i < node.count[s]; i++) {
+                        auto idx = bvh->sorted_prim[node.start[s] + i];
+                        if (occluded_elem(idx, ray)) return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    // walking stack
+    while (node_cur) {
+        // grab node
+        auto node = bvh->nodes[node_stack[--node_cur]];
+        YGL_STAT(bvh_nodes, 1);
+
+        // intersect bbox
+        if (!intersect_check_bbox(ray, ray_dinv, ray_dsign, node.bbox))
+            continue;
+
+        // visit children in stack order; ordering does not matter since
+        // any hit terminates the walk
+        if (!node.isleaf) {
+            for (auto i = 0; i < node.count; i++) {
+                node_stack[node_cur++] = node.start + i;
+                assert(node_cur < 128);
+            }
+        } else {
+            YGL_STAT(bvh_leaf_tests, node.count);
+            for (auto i = 0; i < node.count; i++) {
+                auto idx = bvh->sorted_prim[node.start + i];
+                if (occluded_elem(idx, ray)) return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/// Finds the closest element with a bvh.
+inline bool overlap_bvh(const bvh_tree* bvh, const vec3f& pos, float max_dist,
+    bool early_exit, float& dist, int& eid,
+    const function<bool(int, const vec3f&, float, float&)>& overlap_elem) {
+    // use the wide layout when it was built
+    if (!bvh->wide_nodes.empty())
+        return overlap_wide_bvh(
+            bvh, pos, max_dist, early_exit, dist, eid, overlap_elem);
+
+    // node stack
+    int node_stack[64];
+    auto node_cur = 0;
+    node_stack[node_cur++] = 0;
+
+    // hit
+    auto hit = false;
+
+    // walking stack
+    while (node_cur) {
+        // grab node
+        auto node = bvh->nodes[node_stack[--node_cur]];
 
         // intersect bbox
         if (!distance_check_bbox(pos, max_dist, node.bbox)) continue;
@@ -6726,6 +7812,256 @@ inline bool overlap_points_bvh(const bvh_tree* bvh, const vector<vec3f>& pos,
         bvh, pos.data(), radius.data(), pt, max_dist, early_exit, dist, eid);
 }
 
+/// Uniform spatial hash grid, usable as an alternative acceleration
+/// structure for point overlap queries. For dense, uniformly distributed
+/// query points over roughly uniform elements (e.g. cloth proximity),
+/// bucket lookup beats tree descent. Elements are stored in every bucket
+/// their bounds touch; per-element bucket ranges are kept so deforming
+/// geometry can be rebucketed incrementally with `update_hash_grid()`
+/// instead of rebuilt.
+struct hash_grid {
+    /// world-space cell size
+    float cell_size = 0;
+    /// buckets of element ids, indexed by the cell hash
+    vector<vector<int>> buckets;
+    /// per-element bounds, for query-time culling
+    vector<bbox3f> bboxes;
+    /// per-element range of touched cells, for incremental updates
+    vector<vec3i> cell_min, cell_max;
+};
+
+/// Hash of integer cell coordinates into the bucket array.
+inline int hash_grid_bucket(const hash_grid* grid, const vec3i& c) {
+    auto h = ((uint32_t)c.x * 73856093u) ^ ((uint32_t)c.y * 19349663u) ^
+             ((uint32_t)c.z * 83492791u);
+    return (int)(h % (uint32_t)grid->buckets.size());
+}
+
+/// Cell coordinates of a world-space position.
+inline vec3i hash_grid_cell(const hash_grid* grid, const vec3f& pos) {
+    return {(int)floor(pos.x / grid->cell_size),
+        (int)floor(pos.y / grid->cell_size),
+        (int)floor(pos.z / grid->cell_size)};
+}
+
+/// Build a hash grid from a set of primitives, using the same bounds
+/// callbacks as `build_bvh()`. Pass a non-positive cell size to pick one
+/// from the average element bounds. Elements spanning several cells are
+/// inserted in each; queries may then test an element more than once,
+/// which is benign since the closest distance only shrinks.
+template <typename ElemBbox>
+inline hash_grid* build_hash_grid(
+    int nprims, float cell_size, const ElemBbox& elem_bbox) {
+    auto grid = new hash_grid();
+
+    // pick a cell size comparable to the average element if not given
+    if (cell_size <= 0) {
+        auto avg_size = 0.0f;
+        for (auto i = 0; i < nprims; i++) {
+            auto d = bbox_diagonal(elem_bbox(i));
+            avg_size += max(d.x, max(d.y, d.z));
+        }
+        cell_size = (nprims) ? max(avg_size / nprims, flt_eps) : 1;
+    }
+    grid->cell_size = cell_size;
+
+    // over-allocate buckets to keep occupancy low
+    grid->buckets.resize(max(nprims * 2, 16));
+    grid->bboxes.resize(nprims);
+    grid->cell_min.resize(nprims);
+    grid->cell_max.resize(nprims);
+
+    // insert each element in every cell its bounds touch
+    for (auto i = 0; i < nprims; i++) {
+        auto bbox = elem_bbox(i);
+        grid->bboxes[i] = bbox;
+        grid->cell_min[i] = hash_grid_cell(grid, bbox.min);
+        grid->cell_max[i] = hash_grid_cell(grid, bbox.max);
+        for (auto z = grid->cell_min[i].z; z <= grid->cell_max[i].z; z++)
+            for (auto y = grid->cell_min[i].y; y <= grid->cell_max[i].y; y++)
+                for (auto x = grid->cell_min[i].x; x <= grid->cell_max[i].x;
+                     x++)
+                    grid->buckets[hash_grid_bucket(grid, {x, y, z})].push_back(
+                        i);
+    }
+
+    return grid;
+}
+
+/// Incrementally rebuckets a hash grid after the elements deformed.
+/// Elements whose touched cell range is unchanged — the common case for
+/// small per-step deformations — are left in place; the rest are removed
+/// from their old buckets and reinserted. The cell size is kept from the
+/// build, so rebuild the grid if element sizes change drastically.
+template <typename ElemBbox>
+inline void update_hash_grid(hash_grid* grid, const ElemBbox& elem_bbox) {
+    auto nprims = (int)grid->cell_min.size();
+    for (auto i = 0; i < nprims; i++) {
+        auto bbox = elem_bbox(i);
+        grid->bboxes[i] = bbox;
+        auto cmin = hash_grid_cell(grid, bbox.min);
+        auto cmax = hash_grid_cell(grid, bbox.max);
+        if (cmin == grid->cell_min[i] && cmax == grid->cell_max[i]) continue;
+        // remove from the old buckets
+        for (auto z = grid->cell_min[i].z; z <= grid->cell_max[i].z; z++)
+            for (auto y = grid->cell_min[i].y; y <= grid->cell_max[i].y; y++)
+                for (auto x = grid->cell_min[i].x; x <= grid->cell_max[i].x;
+                     x++) {
+                    auto& bucket =
+                        grid->buckets[hash_grid_bucket(grid, {x, y, z})];
+                    for (auto b = 0; b < (int)bucket.size(); b++) {
+                        if (bucket[b] != i) continue;
+                        bucket[b] = bucket.back();
+                        bucket.pop_back();
+                        break;
+                    }
+                }
+        // insert in the new ones
+        grid->cell_min[i] = cmin;
+        grid->cell_max[i] = cmax;
+        for (auto z = cmin.z; z <= cmax.z; z++)
+            for (auto y = cmin.y; y <= cmax.y; y++)
+                for (auto x = cmin.x; x <= cmax.x; x++)
+                    grid->buckets[hash_grid_bucket(grid, {x, y, z})].push_back(
+                        i);
+    }
+}
+
+/// Finds the closest element that overlaps a point within a given radius,
+/// walking the hash grid cells touched by the query sphere. Same element
+/// callback as `overlap_bvh()`.
+inline bool overlap_hash_grid(const hash_grid* grid, const vec3f& pos,
+    float max_dist, bool early_exit, float& dist, int& eid,
+    const function<bool(int, const vec3f&, float, float&)>& overlap_elem) {
+    auto hit = false;
+    auto cmin = hash_grid_cell(grid, pos - vec3f{max_dist, max_dist, max_dist});
+    auto cmax = hash_grid_cell(grid, pos + vec3f{max_dist, max_dist, max_dist});
+    for (auto z = cmin.z; z <= cmax.z; z++) {
+        for (auto y = cmin.y; y <= cmax.y; y++) {
+            for (auto x = cmin.x; x <= cmax.x; x++) {
+                auto& bucket = grid->buckets[hash_grid_bucket(grid, {x, y, z})];
+                for (auto idx : bucket) {
+                    // cull with the element bounds as the bvh does; this
+                    // also drops hash collisions from distant cells
+                    if (!distance_check_bbox(pos, max_dist, grid->bboxes[idx]))
+                        continue;
+                    if (overlap_elem(idx, pos, max_dist, dist)) {
+                        hit = true;
+                        max_dist = dist;
+                        eid = idx;
+                        if (early_exit) return true;
+                    }
+                }
+            }
+        }
+    }
+    return hit;
+}
+
+/// Build a triangles hash grid.
+inline hash_grid* build_triangles_grid(const vector<vec3i>& triangles,
+    const vector<vec3f>& pos, float cell_size = 0) {
+    return build_hash_grid(
+        (int)triangles.size(), cell_size, [&triangles, &pos](int eid) {
+            auto f = triangles[eid];
+            return triangle_bbox(pos[f.x], pos[f.y], pos[f.z]);
+        });
+}
+
+/// Build a lines hash grid.
+inline hash_grid* build_lines_grid(const vector<vec2i>& lines,
+    const vector<vec3f>& pos, const vector<float>& radius,
+    float cell_size = 0) {
+    return build_hash_grid(
+        (int)lines.size(), cell_size, [&lines, &pos, &radius](int eid) {
+            auto f = lines[eid];
+            return line_bbox(pos[f.x], pos[f.y], radius[f.x], radius[f.y]);
+        });
+}
+
+/// Build a points hash grid.
+inline hash_grid* build_points_grid(const vector<int>& points,
+    const vector<vec3f>& pos, const vector<float>& radius,
+    float cell_size = 0) {
+    return build_hash_grid(
+        (int)points.size(), cell_size, [&points, &pos, &radius](int eid) {
+            auto f = points[eid];
+            return point_bbox(pos[f], radius[f]);
+        });
+}
+
+/// Rebucket a triangles hash grid after a deformation.
+inline void update_triangles_grid(hash_grid* grid,
+    const vector<vec3i>& triangles, const vector<vec3f>& pos) {
+    update_hash_grid(grid, [&triangles, &pos](int eid) {
+        auto f = triangles[eid];
+        return triangle_bbox(pos[f.x], pos[f.y], pos[f.z]);
+    });
+}
+
+/// Rebucket a lines hash grid after a deformation.
+inline void update_lines_grid(hash_grid* grid, const vector<vec2i>& lines,
+    const vector<vec3f>& pos, const vector<float>& radius) {
+    update_hash_grid(grid, [&lines, &pos, &radius](int eid) {
+        auto f = lines[eid];
+        return line_bbox(pos[f.x], pos[f.y], radius[f.x], radius[f.y]);
+    });
+}
+
+/// Rebucket a points hash grid after a deformation.
+inline void update_points_grid(hash_grid* grid, const vector<int>& points,
+    const vector<vec3f>& pos, const vector<float>& radius) {
+    update_hash_grid(grid, [&points, &pos, &radius](int eid) {
+        auto f = points[eid];
+        return point_bbox(pos[f], radius[f]);
+    });
+}
+
+/// Find the closest triangle to a point with a hash grid.
+inline bool overlap_triangles_grid(const hash_grid* grid,
+    const vector<vec3i>& triangles, const vector<vec3f>& pos,
+    const vector<float>& radius, const vec3f& pt, float max_dist,
+    bool early_exit, float& dist, int& eid, vec3f& euv) {
+    return overlap_hash_grid(grid, pt, max_dist, early_exit, dist, eid,
+        [&triangles, &pos, &radius, &euv](
+            int eid, const vec3f& pt, float max_dist, float& dist) {
+            auto f = triangles[eid];
+            return overlap_triangle(pt, max_dist, pos[f.x], pos[f.y], pos[f.z],
+                (radius.empty()) ? 0 : radius[f.x],
+                (radius.empty()) ? 0 : radius[f.y],
+                (radius.empty()) ? 0 : radius[f.z], dist, euv);
+        });
+}
+
+/// Find the closest line to a point with a hash grid.
+inline bool overlap_lines_grid(const hash_grid* grid,
+    const vector<vec2i>& lines, const vector<vec3f>& pos,
+    const vector<float>& radius, const vec3f& pt, float max_dist,
+    bool early_exit, float& dist, int& eid, vec2f& euv) {
+    return overlap_hash_grid(grid, pt, max_dist, early_exit, dist, eid,
+        [&lines, &pos, &radius, &euv](
+            int eid, const vec3f& pt, float max_dist, float& dist) {
+            auto f = lines[eid];
+            return overlap_line(pt, max_dist, pos[f.x], pos[f.y],
+                (radius.empty()) ? 0 : radius[f.x],
+                (radius.empty()) ? 0 : radius[f.y], dist, euv);
+        });
+}
+
+/// Find the closest point element to a point with a hash grid.
+inline bool overlap_points_grid(const hash_grid* grid,
+    const vector<int>& points, const vector<vec3f>& pos,
+    const vector<float>& radius, const vec3f& pt, float max_dist,
+    bool early_exit, float& dist, int& eid) {
+    return overlap_hash_grid(grid, pt, max_dist, early_exit, dist, eid,
+        [&points, &pos, &radius](
+            int eid, const vec3f& pt, float max_dist, float& dist) {
+            auto f = points[eid];
+            return overlap_point(
+                pt, max_dist, pos[f], (radius.empty()) ? 0 : radius[f], dist);
+        });
+}
+
 /// Finds the overlap between BVH leaf nodes.
 template <typename OverlapElem>
 void overlap_bvh_elems(const bvh_tree* bvh1, const bvh_tree* bvh2,
@@ -6795,6 +8131,9 @@ void overlap_bvh_elems(const bvh_tree* bvh1, const bvh_tree* bvh2,
 // -----------------------------------------------------------------------------
 namespace ygl {
 
+// forward declaration
+struct texture_cache;
+
 /// Scene Texture
 struct texture {
     /// name
@@ -6805,21 +8144,199 @@ struct texture {
     image4b ldr;
     /// if loaded, hdr image
     image4f hdr;
+    /// if loaded, hdr image stored as half floats (see compress_texture())
+    image4h hdrh;
+
+    // computed data ---------------------
+    /// ldr mip pyramid, finest first (created by build_mipmaps())
+    vector<image4b> ldr_mips;
+    /// hdr mip pyramid, finest first (created by build_mipmaps())
+    vector<image4f> hdr_mips;
+    /// half hdr mip pyramid, finest first (created by build_mipmaps())
+    vector<image4h> hdrh_mips;
+    /// whether cached decodes keep hdr pixels as half floats, set by
+    /// compress_texture()
+    bool compress = false;
+    /// streaming cache the texture is registered with, or null if the
+    /// pixel data is loaded eagerly (see make_texture_cache())
+    texture_cache* cache = nullptr;
+    /// whether the pixel data is resident, managed by the cache
+    std::atomic<bool> resident = {true};
+    /// last use marker for lru eviction, managed by the cache
+    std::atomic<uint64_t> last_use = {0};
 
     /// get texture width
     int width() const {
         if (ldr) return ldr.width();
         if (hdr) return hdr.width();
+        if (hdrh) return hdrh.width();
         return 0;
     }
     /// get texture height
     int height() const {
         if (ldr) return ldr.height();
         if (hdr) return hdr.height();
+        if (hdrh) return hdrh.height();
         return 0;
     }
 };
 
+/// Streaming texture cache. Registered textures start without pixel data
+/// and are decoded on the first lookup from eval_texture(); decoding is
+/// safe to call concurrently from the tracing thread pool. Eviction is
+/// explicit: call trim_texture_cache() when no tracing is in flight, e.g.
+/// between sample batches, to drop least-recently-used textures down to
+/// the residency budget.
+struct texture_cache {
+    /// residency budget in bytes
+    size_t budget = (size_t)1 << 32;
+
+    // private data ---------------------
+    /// base directory for texture paths
+    string dirname;
+    /// registered textures
+    vector<texture*> textures;
+    /// bytes currently resident
+    size_t resident_bytes = 0;
+    /// lru clock, bumped on every lookup
+    std::atomic<uint64_t> clock = {0};
+    /// protects decoding and byte accounting
+    std::mutex mutex;
+};
+
+/// Bytes used by the pixel data of a texture, including the mip pyramid
+inline size_t texture_bytes(const texture* txt) {
+    auto nbytes = (size_t)txt->ldr.width() * txt->ldr.height() * sizeof(vec4b);
+    nbytes += (size_t)txt->hdr.width() * txt->hdr.height() * sizeof(vec4f);
+    nbytes += (size_t)txt->hdrh.width() * txt->hdrh.height() * sizeof(vec4h);
+    for (auto& mip : txt->ldr_mips)
+        nbytes += (size_t)mip.width() * mip.height() * sizeof(vec4b);
+    for (auto& mip : txt->hdr_mips)
+        nbytes += (size_t)mip.width() * mip.height() * sizeof(vec4f);
+    for (auto& mip : txt->hdrh_mips)
+        nbytes += (size_t)mip.width() * mip.height() * sizeof(vec4h);
+    return nbytes;
+}
+
+/// Converts the hdr pixel data of a texture to half float storage,
+/// halving its memory; eval_texture() widens texels back to float on the
+/// fly. For cached textures, later decodes stay compressed.
+inline void compress_texture(texture* txt) {
+    txt->compress = true;
+    if (txt->hdr) {
+        txt->hdrh = float_to_half(txt->hdr);
+        txt->hdr = image4f();
+    }
+    if (!txt->hdr_mips.empty()) {
+        txt->hdrh_mips.clear();
+        for (auto& mip : txt->hdr_mips) txt->hdrh_mips += float_to_half(mip);
+        txt->hdr_mips.clear();
+    }
+}
+
+#if YGL_IMAGEIO
+
+/// Builds the mip pyramid of a texture, used by eval_texture() for
+/// minified lookups. Ldr levels are filtered in linear space to preserve
+/// the average color through the srgb conversion.
+inline void build_mipmaps(texture* txt) {
+    txt->ldr_mips.clear();
+    txt->hdr_mips.clear();
+    txt->hdrh_mips.clear();
+    if (txt->ldr) {
+        auto w = txt->ldr.width(), h = txt->ldr.height();
+        auto linear = image4f(w, h);
+        for (auto j = 0; j < h; j++)
+            for (auto i = 0; i < w; i++)
+                linear[{i, j}] = srgb_to_linear(txt->ldr[{i, j}]);
+        while (w > 1 || h > 1) {
+            w = max(w / 2, 1);
+            h = max(h / 2, 1);
+            auto lmip = image4f(w, h);
+            resize_image(linear, lmip);
+            auto mip = image4b(w, h);
+            for (auto j = 0; j < h; j++)
+                for (auto i = 0; i < w; i++)
+                    mip[{i, j}] = linear_to_srgb(lmip[{i, j}]);
+            txt->ldr_mips += mip;
+            linear = lmip;
+        }
+    }
+    if (txt->hdr) {
+        auto w = txt->hdr.width(), h = txt->hdr.height();
+        while (w > 1 || h > 1) {
+            w = max(w / 2, 1);
+            h = max(h / 2, 1);
+            auto mip = image4f(w, h);
+            resize_image(
+                (txt->hdr_mips.empty()) ? txt->hdr : txt->hdr_mips.back(), mip);
+            txt->hdr_mips += mip;
+        }
+    }
+    if (txt->hdrh) {
+        // filter in full floats, store the levels back as half
+        auto w = txt->hdrh.width(), h = txt->hdrh.height();
+        auto linear = half_to_float(txt->hdrh);
+        while (w > 1 || h > 1) {
+            w = max(w / 2, 1);
+            h = max(h / 2, 1);
+            auto lmip = image4f(w, h);
+            resize_image(linear, lmip);
+            txt->hdrh_mips += float_to_half(lmip);
+            linear = lmip;
+        }
+    }
+}
+
+#endif
+
+/// Makes the pixel data of a cached texture resident, decoding it on a
+/// miss, and marks the use for lru eviction. Called by eval_texture().
+inline void fetch_texture(texture* txt) {
+    auto cache = txt->cache;
+    txt->last_use = ++cache->clock;
+    if (txt->resident) return;
+#if YGL_IMAGEIO
+    auto lock = std::unique_lock<std::mutex>(cache->mutex);
+    if (txt->resident) return;  // another thread decoded it first
+    auto filename = cache->dirname + txt->path;
+    if (is_hdr_filename(txt->path)) {
+        if (txt->compress)
+            txt->hdrh = load_image4h(filename);
+        else
+            txt->hdr = load_image4f(filename);
+    } else {
+        txt->ldr = load_image4b(filename);
+    }
+    if (txt->ldr || txt->hdr || txt->hdrh) build_mipmaps(txt);
+    cache->resident_bytes += texture_bytes(txt);
+    txt->resident = true;
+#endif
+}
+
+/// Evicts least-recently-used textures until the cache fits its budget.
+/// Must be called when no tracing is in flight, since lookups read the
+/// pixel data without holding the cache lock.
+inline void trim_texture_cache(texture_cache* cache) {
+    auto lock = std::unique_lock<std::mutex>(cache->mutex);
+    while (cache->resident_bytes > cache->budget) {
+        auto lru = (texture*)nullptr;
+        for (auto txt : cache->textures) {
+            if (!txt->resident || !texture_bytes(txt)) continue;
+            if (!lru || txt->last_use < lru->last_use) lru = txt;
+        }
+        if (!lru) break;
+        cache->resident_bytes -= texture_bytes(lru);
+        lru->ldr = image4b();
+        lru->hdr = image4f();
+        lru->hdrh = image4h();
+        lru->ldr_mips.clear();
+        lru->hdr_mips.clear();
+        lru->hdrh_mips.clear();
+        lru->resident = false;
+    }
+}
+
 /// Scene Texture Additional Information
 struct texture_info {
     /// texture pointer
@@ -6898,6 +8415,35 @@ struct material {
     texture_info occ_txt = {};
 };
 
+// forward declarations
+struct shape;
+struct subdivision_cache;
+struct tessellation_cache;
+
+/// Lazy tessellation state of a shape registered with a
+/// tessellation_cache (see make_tessellation_cache()). The control cage
+/// and the subdivision topology are kept for the scene lifetime; the
+/// shape data itself holds the currently resident refinement.
+struct shape_tessellation {
+    /// owning cache
+    tessellation_cache* cache = nullptr;
+    /// control cage geometry
+    shape* cage = nullptr;
+    /// subdivision topology up to the maximum level
+    subdivision_cache* topology = nullptr;
+    /// maximum refinement level
+    int max_level = 0;
+    /// level requested by update_tessellation_levels()
+    int target = 0;
+    /// currently resident level, 0 for the control cage
+    std::atomic<int> level = {0};
+    /// last use marker for lru eviction, managed by the cache
+    std::atomic<uint64_t> last_use = {0};
+
+    /// cleanup
+    ~shape_tessellation();
+};
+
 /// Shape data represented as an indexed array.
 /// May contain only one of the points/lines/triangles/quads.
 struct shape {
@@ -6947,10 +8493,18 @@ struct shape {
     bvh_tree* bvh = nullptr;
     /// bounding box (needs to be updated explicitly)
     bbox3f bbox = invalid_bbox3f;
+    /// lazy tessellation state, or null if the shape is not registered
+    /// with a tessellation cache (see register_tessellation())
+    shape_tessellation* tess = nullptr;
+    /// level-of-detail chain, coarser and coarser (created by
+    /// build_lods())
+    vector<shape*> lods;
 
     // clean
     ~shape() {
         if (bvh) delete bvh;
+        if (tess) delete tess;
+        for (auto lod : lods) delete lod;
     }
 };
 
@@ -6966,6 +8520,9 @@ struct instance {
     // computed data --------------------------
     /// bounding box (needs to be updated explicitly)
     bbox3f bbox = invalid_bbox3f;
+    /// current level of detail, 0 for the full mesh (set by
+    /// update_lods())
+    int lod = 0;
 
     /// instance transform as matrix
     mat4f xform() const { return to_mat4f(frame); }
@@ -7003,6 +8560,10 @@ struct environment {
     vec3f ke = {0, 0, 0};
     /// emission texture
     texture_info ke_txt = {};
+
+    // computed data --------------------------
+    /// texel CDF for sampling (created by update_lights())
+    vector<float> elem_cdf;
 };
 
 /// Light, either an instance or an environment.
@@ -7014,6 +8575,38 @@ struct light {
     environment* env = nullptr;
 };
 
+/// Light hierarchy node. Leaves store a range of light ids in
+/// light_tree::sorted_lights; internal nodes store the index of the first of
+/// their two children.
+struct light_tree_node {
+    /// bounds of the lights below the node
+    bbox3f bbox = invalid_bbox3f;
+    /// aggregate emitted power of the lights below the node
+    float power = 0;
+    /// index of the first child (internal) or first light (leaf)
+    int start = 0;
+    /// number of lights for leaves, zero for internal nodes
+    int count = 0;
+    /// parent node id, -1 for the root
+    int parent = -1;
+};
+
+/// Light hierarchy (a BVH over the scene lights) used by the tracer to
+/// importance sample light selection on scenes with many lights.
+/// This is only used internally and is created by update_lights().
+struct light_tree {
+    /// tree nodes
+    vector<light_tree_node> nodes;
+    /// light ids sorted by tree order
+    vector<int> sorted_lights;
+    /// leaf node id of each light
+    vector<int> light_leaf;
+    /// emitted power of each light
+    vector<float> light_power;
+    /// light id of an instance or environment hit by a bsdf sample
+    unordered_map<const void*, int> light_id;
+};
+
 /// Scene
 struct scene {
     /// shape array
@@ -7031,30 +8624,38 @@ struct scene {
 
     /// light array
     vector<light*> lights;
+    /// light hierarchy for importance sampling (see update_lights())
+    light_tree* ltree = nullptr;
 
     // computed data --------------------------
     /// BVH
     bvh_tree* bvh = nullptr;
     /// bounding box (needs to be updated explicitly)
     bbox3f bbox = invalid_bbox3f;
+    /// arena holding the loader-created objects, freed wholesale; objects
+    /// added with new are still deleted individually
+    memory_arena* arena = nullptr;
 
     /// cleanup
     ~scene() {
+        auto owned = [this](void* v) { return arena && arena->owns(v); };
         for (auto v : shapes)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : instances)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : materials)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : textures)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : cameras)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : environments)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto light : lights)
-            if (light) delete light;
+            if (light && !owned(light)) delete light;
+        if (ltree) delete ltree;
         if (bvh) delete bvh;
+        if (arena) delete arena;
     }
 };
 
@@ -7114,55 +8715,157 @@ inline vec3f eval_norm(const instance* ist, int eid, const vec4f& euv) {
         normalize(eval_barycentric(ist->shp, ist->shp->norm, eid, euv)));
 }
 
-/// Evaluate a texture
+/// Evaluate a texture. The footprint is the size of the lookup along the
+/// texture coordinates, used to pick a mip level if a pyramid was built
+/// with build_mipmaps(); zero reads the full resolution image.
 inline vec4f eval_texture(const texture_info& info, const vec2f& texcoord,
-    bool srgb = true, const vec4f& def = {1, 1, 1, 1}) {
+    bool srgb = true, float footprint = 0, const vec4f& def = {1, 1, 1, 1}) {
     if (!info.txt) return def;
 
-    // get texture
+    // get texture, streaming in the pixel data if cached
     auto txt = info.txt;
-    assert(txt->hdr || txt->ldr);
-
-    auto lookup = [&def, &txt, &srgb](int i, int j) {
-        if (txt->ldr)
-            return (srgb) ? srgb_to_linear(txt->ldr[{i, j}]) :
-                            byte_to_float(txt->ldr[{i, j}]);
-        else if (txt->hdr)
-            return txt->hdr[{i, j}];
-        else
-            return def;
-    };
-
-    // get image width/height
-    auto w = txt->width(), h = txt->height();
+    if (txt->cache) fetch_texture(txt);
+    if (!txt->hdr && !txt->ldr && !txt->hdrh) return def;
+    YGL_STAT(texture_fetches, 1);
+
+    // fetch a mip level with bilinear interpolation; level 0 is the full
+    // resolution image
+    auto fetch = [&def, &txt, &srgb, &info, &texcoord](int l) {
+        auto ldr = (txt->ldr) ?
+                       ((l) ? &txt->ldr_mips[l - 1] : &txt->ldr) :
+                       nullptr;
+        auto hdr = (txt->hdr) ?
+                       ((l) ? &txt->hdr_mips[l - 1] : &txt->hdr) :
+                       nullptr;
+        auto hdrh = (txt->hdrh) ?
+                        ((l) ? &txt->hdrh_mips[l - 1] : &txt->hdrh) :
+                        nullptr;
+
+        auto lookup = [&def, &ldr, &hdr, &hdrh, &srgb](int i, int j) {
+            if (ldr)
+                return (srgb) ? srgb_to_linear((*ldr)[{i, j}]) :
+                                byte_to_float((*ldr)[{i, j}]);
+            else if (hdr)
+                return (*hdr)[{i, j}];
+            else if (hdrh)
+                return half_to_float((*hdrh)[{i, j}]);
+            else
+                return def;
+        };
+
+        // get image width/height
+        auto w = (ldr) ? ldr->width() :
+                         ((hdr) ? hdr->width() : hdrh->width()),
+             h = (ldr) ? ldr->height() :
+                         ((hdr) ? hdr->height() : hdrh->height());
+
+        // get coordinates normalized for tiling
+        auto s = 0.0f, t = 0.0f;
+        if (!info.wrap_s) {
+            s = clamp(texcoord.x, 0.0f, 1.0f) * w;
+        } else {
+            s = std::fmod(texcoord.x, 1.0f) * w;
+            if (s < 0) s += w;
+        }
+        if (!info.wrap_t) {
+            t = clamp(texcoord.y, 0.0f, 1.0f) * h;
+        } else {
+            t = std::fmod(texcoord.y, 1.0f) * h;
+            if (t < 0) t += h;
+        }
 
-    // get coordinates normalized for tiling
-    auto s = 0.0f, t = 0.0f;
-    if (!info.wrap_s) {
-        s = clamp(texcoord.x, 0.0f, 1.0f) * w;
-    } else {
-        s = std::fmod(texcoord.x, 1.0f) * w;
-        if (s < 0) s += w;
-    }
-    if (!info.wrap_t) {
-        t = clamp(texcoord.y, 0.0f, 1.0f) * h;
-    } else {
-        t = std::fmod(texcoord.y, 1.0f) * h;
-        if (t < 0) t += h;
-    }
+        // get image coordinates and residuals
+        auto i = clamp((int)s, 0, w - 1), j = clamp((int)t, 0, h - 1);
+        auto ii = (i + 1) % w, jj = (j + 1) % h;
+        auto u = s - i, v = t - j;
 
-    // get image coordinates and residuals
-    auto i = clamp((int)s, 0, w - 1), j = clamp((int)t, 0, h - 1);
-    auto ii = (i + 1) % w, jj = (j + 1) % h;
-    auto u = s - i, v = t - j;
+        // nearest lookup
+        if (!info.linear) return lookup(i, j);
 
-    // nearest lookup
-    if (!info.linear) return lookup(i, j);
+        // handle interpolation
+        return lookup(i, j) * (1 - u) * (1 - v) + lookup(i, jj) * (1 - u) * v +
+               lookup(ii, j) * u * (1 - v) + lookup(ii, jj) * u * v;
+    };
 
-    // handle interpolation
-    return lookup(i, j) * (1 - u) * (1 - v) + lookup(i, jj) * (1 - u) * v +
-           lookup(ii, j) * u * (1 - v) + lookup(ii, jj) * u * v;
-}
+    // pick the mip level from the footprint
+    auto nmips = (txt->ldr) ?
+                     (int)txt->ldr_mips.size() :
+                     ((txt->hdr) ? (int)txt->hdr_mips.size() :
+                                   (int)txt->hdrh_mips.size());
+    auto lod = 0.0f;
+    if (info.mipmap && nmips && footprint > 0) {
+        lod = clamp(std::log2(footprint * max(txt->width(), txt->height())),
+            0.0f, (float)nmips);
+    }
+
+    // lookup with trilinear interpolation across levels
+    auto l = (int)lod;
+    auto f = lod - l;
+    if (!f) return fetch(l);
+    return fetch(l) * (1 - f) + fetch(min(l + 1, nmips)) * f;
+}
+
+/// Cached topology for repeated subdivision of the same control mesh.
+/// Element splits, edge/face index maps, boundary creases and the
+/// vertex-averaging adjacency are computed once per level with
+/// make_subdivision_cache(); subdivide_shape_cached() then redoes only
+/// the floating point averaging, in parallel on the global thread pool.
+/// Intended for deformation pipelines that re-subdivide every frame.
+struct subdivision_cache {
+    /// whether the levels apply Catmull-Clark smoothing
+    bool subdiv = false;
+    /// topology of one subdivision level
+    struct level {
+        /// tessellated elements after the split
+        vector<vec2i> lines;
+        vector<vec3i> triangles;
+        vector<vec4i> quads;
+        /// edge/face maps for vertex creation (see subdivide_vert())
+        vector<vec2i> edges;
+        vector<vec4i> faces;
+        /// boundary creases of the tessellated quads
+        vector<vec2i> boundary;
+        /// vertex valence as in subdivide_catmullclark()
+        vector<int> val;
+        /// vertex-to-quad and vertex-to-crease gather maps
+        vector<int> quad_offsets, quad_adj;
+        vector<int> line_offsets, line_adj;
+        /// vertex count after this level
+        int nverts = 0;
+    };
+    /// cached levels, coarse to fine
+    vector<level> levels;
+};
+
+/// Builds the subdivision topology of a shape for nlevels subdivisions,
+/// with subdivision surface rules if subdiv is true. Returns null for
+/// face-varying shapes, which are not supported. The caller owns the
+/// cache; it stays valid as long as the control mesh topology does.
+subdivision_cache* make_subdivision_cache(
+    const shape* shp, int nlevels, bool subdiv = false);
+
+/// Subdivides the control vertex data of ctrl through the cached
+/// topology, writing the tessellated elements and vertex data into tess
+/// (which may be ctrl itself). Applies the first nlevels levels, or all
+/// of them if negative. Results match repeated subdivide_shape() calls
+/// exactly.
+void subdivide_shape_cached(const shape* ctrl, shape* tess,
+    const subdivision_cache* cache, int nlevels = -1);
+
+/// Simplifies a triangle mesh down to roughly ntriangles with iterative
+/// edge collapses ordered by quadric error. Collapsed vertices are
+/// placed at edge endpoints or midpoints, so the simplified mesh stays
+/// inside the convex hull of the input and shape bounds remain
+/// conservative; vertex data is interpolated along the collapsed edge.
+/// Returns null for shapes with elements other than triangles, which
+/// are not supported.
+shape* simplify_shape(const shape* shp, int ntriangles);
+
+/// Builds the level-of-detail chain of a triangle mesh into shp->lods,
+/// coarser and coarser, halving the triangle count per level up to
+/// nlods times, and builds their BVHs. Instances select a level with
+/// update_lods(). Does nothing for shapes that cannot be simplified.
+void build_lods(shape* shp, int nlods, const bvh_build_params& params = {});
 
 /// Subdivides shape elements. Apply subdivision surface rules if subdivide
 /// is true.
@@ -7190,7 +8893,7 @@ inline void subdivide_shape(shape* shp, bool subdiv = false) {
                 subdivide_catmullclark(shp->quads, shp->color, boundary, {});
             shp->radius =
                 subdivide_catmullclark(shp->quads, shp->radius, boundary, {});
-            shp->norm = compute_normals({}, {}, shp->quads, shp->pos);
+            shp->norm = compute_normals_parallel({}, {}, shp->quads, shp->pos);
         }
     } else if (!shp->quads_pos.empty()) {
         vector<vec2i> _lines;
@@ -7263,10 +8966,43 @@ struct load_options {
     bool preserve_facevarying = false;
 };
 
-/// Loads a scene. For now OBJ or glTF are supported.
-/// Throws an exception if an error occurs.
+/// Loads a scene. For now OBJ, glTF and the native binary format are
+/// supported. Throws an exception if an error occurs.
 scene* load_scene(const string& filename, const load_options& opts = {});
 
+/// Loads a scene saved in the native binary format (see save_binscene()).
+/// The file is memory-mapped and vertex and element arrays are bulk-copied
+/// out of it, so large scenes load in a fraction of the time of parsing
+/// OBJ or glTF. Called by load_scene() for `.ybin` files.
+/// Throws an exception if an error occurs.
+scene* load_binscene(const string& filename, const load_options& opts = {});
+
+/// Builds mip pyramids for all loaded textures, used by eval_texture()
+/// for minified lookups. Called by load_scene() when loading textures.
+void build_mipmaps(scene* scn);
+
+/// Initializes a streaming texture cache over all the textures of a
+/// scene with the given residency budget in bytes. Use together with
+/// load_options::load_textures set to false to render scenes whose
+/// textures do not fit in memory; texels are then decoded on demand by
+/// eval_texture() and evicted by trim_texture_cache(). The cache is
+/// owned by the caller.
+inline texture_cache* make_texture_cache(
+    scene* scn, const string& dirname, size_t budget) {
+    auto cache = new texture_cache();
+    cache->budget = budget;
+    cache->dirname = dirname;
+    for (auto txt : scn->textures) {
+        // pixels not backed by a file cannot be reloaded
+        if (txt->path.empty()) continue;
+        txt->cache = cache;
+        txt->resident = (bool)(txt->ldr || txt->hdr || txt->hdrh);
+        if (txt->resident) cache->resident_bytes += texture_bytes(txt);
+        cache->textures += txt;
+    }
+    return cache;
+}
+
 /// Save options
 struct save_options {
     /// Whether to save textures
@@ -7281,11 +9017,20 @@ struct save_options {
     bool gltf_separate_buffers = false;
 };
 
-/// Saves a scene. For now OBJ and glTF are supported.
-/// Throws an exception if an error occurs.
+/// Saves a scene. For now OBJ, glTF and the native binary format are
+/// supported. Throws an exception if an error occurs.
 void save_scene(
     const string& filename, const scene* scn, const save_options& opts);
 
+/// Saves a scene in the native binary format: a small versioned header
+/// followed by cameras, textures, materials, shapes, instances and
+/// environments, with all arrays stored as length-prefixed raw blobs.
+/// Texture pixel data is embedded when save_options::save_textures is
+/// set, so the file is self-contained. Called by save_scene() for
+/// `.ybin` files. Throws an exception if an error occurs.
+void save_binscene(
+    const string& filename, const scene* scn, const save_options& opts = {});
+
 /// Add elements options
 struct add_elements_options {
     /// Add missing normal
@@ -7369,36 +9114,40 @@ inline void flatten_instances(scene* scn) {
     for (auto e : instances) delete e;
 }
 
-/// Initialize the lights
+/// Initialize the lights and the light hierarchy used by the tracer
 void update_lights(scene* scn, bool point_only);
 
 /// Print scene information (call update bounds bes before)
 void print_info(const scene* scn);
 
 /// Build a shape BVH
-inline void build_bvh(shape* shp, bool equalsize = true) {
+inline void build_bvh(shape* shp, const bvh_build_params& params = {}) {
     if (!shp->points.empty()) {
         shp->bvh =
-            build_points_bvh(shp->points, shp->pos, shp->radius, equalsize);
+            build_points_bvh(shp->points, shp->pos, shp->radius, params);
     } else if (!shp->lines.empty()) {
-        shp->bvh =
-            build_lines_bvh(shp->lines, shp->pos, shp->radius, equalsize);
+        shp->bvh = build_lines_bvh(shp->lines, shp->pos, shp->radius, params);
     } else if (!shp->triangles.empty()) {
-        shp->bvh = build_triangles_bvh(shp->triangles, shp->pos, equalsize);
+        shp->bvh = build_triangles_bvh(shp->triangles, shp->pos, params);
     } else if (!shp->quads.empty()) {
-        shp->bvh = build_quads_bvh(shp->quads, shp->pos, equalsize);
+        shp->bvh = build_quads_bvh(shp->quads, shp->pos, params);
     } else {
-        shp->bvh = build_points_bvh(shp->pos, shp->radius, equalsize);
+        shp->bvh = build_points_bvh(shp->pos, shp->radius, params);
     }
     shp->bbox = shp->bvh->nodes[0].bbox;
 }
 
+/// Build a shape BVH (legacy interface)
+inline void build_bvh(shape* shp, bool equalsize) {
+    build_bvh(shp, bvh_params_from_equalsize(equalsize));
+}
+
 /// Build a scene BVH
-inline void build_bvh(
-    scene* scn, bool equalsize = true, bool do_shapes = true) {
+inline void build_bvh(scene* scn, const bvh_build_params& params = {},
+    bool do_shapes = true) {
     // do shapes
     if (do_shapes) {
-        for (auto shp : scn->shapes) build_bvh(shp, equalsize);
+        for (auto shp : scn->shapes) build_bvh(shp, params);
     }
 
     // update instance bbox
@@ -7406,10 +9155,38 @@ inline void build_bvh(
         ist->bbox = transform_bbox(ist->frame, ist->shp->bbox);
 
     // tree bvh
-    scn->bvh = build_bvh((int)scn->instances.size(), equalsize,
+    scn->bvh = build_bvh((int)scn->instances.size(), params,
         [scn](int eid) { return scn->instances[eid]->bbox; });
 }
 
+/// Build a scene BVH (legacy interface)
+inline void build_bvh(scene* scn, bool equalsize, bool do_shapes = true) {
+    build_bvh(scn, bvh_params_from_equalsize(equalsize), do_shapes);
+}
+
+/// Saves the shape and scene BVHs to a flat binary cache file, keyed by a
+/// hash of the shape and instance data they were built from. The format
+/// stores the index-based node arrays as-is, so no pointer fix-up is
+/// needed when loading. Returns whether the file was written.
+bool save_bvh(const scene* scn, const string& filename);
+
+/// Loads the shape and scene BVHs from a binary cache file written by
+/// `save_bvh()`. Returns false, leaving the scene untouched, if the file
+/// is missing, malformed, or keyed by a hash that does not match the
+/// current scene data (i.e. the cache is stale).
+bool load_bvh(scene* scn, const string& filename);
+
+/// Build a shape BVH splitting subtrees concurrently on the thread pool.
+/// Pass a null pool to use the global one.
+void build_bvh_parallel(shape* shp, const bvh_build_params& params = {},
+    thread_pool* pool = nullptr);
+
+/// Build a scene BVH using the thread pool. Shape BVHs are dispatched
+/// across the pool, while large shapes are additionally built with
+/// parallel subtree splitting. Pass a null pool to use the global one.
+void build_bvh_parallel(scene* scn, const bvh_build_params& params = {},
+    bool do_shapes = true, thread_pool* pool = nullptr);
+
 /// Refits a scene BVH
 inline void refit_bvh(shape* shp) {
     if (!shp->points.empty()) {
@@ -7441,6 +9218,323 @@ inline void refit_bvh(scene* scn, bool do_shapes = true) {
         scn->bvh, 0, [scn](int eid) { return scn->instances[eid]->bbox; });
 }
 
+/// Tracks pending scene edits for incremental BVH updates in interactive
+/// editors. Record a deformed shape or a moved instance with
+/// `mark_edited()`; `update_bvh()` then refits only the affected shape
+/// BVHs and the scene tree, so tracing can restart without touching the
+/// rest of the scene. Since repeated refits degrade tree quality as
+/// primitives drift away from the original split planes, each refitted
+/// tree is rebuilt from scratch once its total node surface area grows
+/// past `rebuild_ratio` times the area it had at build time.
+struct bvh_update_state {
+    /// rebuild a refitted tree when its node surface area grows past
+    /// this factor of the area measured at build time
+    float rebuild_ratio = 2.0f;
+
+    // private data ---------------------
+    /// shapes with edited vertex data
+    vector<shape*> edited_shapes;
+    /// whether any instance frame was edited
+    bool edited_instances = false;
+    /// node surface area of each tree at build time, keyed by owner
+    unordered_map<const void*, float> build_areas;
+};
+
+/// Total node surface area of a BVH, used by `update_bvh()` as a refit
+/// quality measure.
+inline float bvh_area(const bvh_tree* bvh) {
+    auto area = 0.0f;
+    for (auto& node : bvh->nodes) {
+        auto d = bbox_diagonal(node.bbox);
+        if (d.x < 0 || d.y < 0 || d.z < 0) continue;
+        area += 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+    return area;
+}
+
+/// Records that the vertex data of a shape was edited.
+inline void mark_edited(bvh_update_state* state, shape* shp) {
+    for (auto s : state->edited_shapes)
+        if (s == shp) return;
+    state->edited_shapes += shp;
+}
+
+/// Records that the frame of an instance was edited.
+inline void mark_edited(bvh_update_state* state, instance* ist) {
+    state->edited_instances = true;
+}
+
+/// Applies the edits recorded with `mark_edited()`: refits the BVHs of
+/// edited shapes, then the instance bounds and the scene tree, rebuilding
+/// any tree whose refit quality degraded past `state->rebuild_ratio`.
+/// Does nothing if no edits are pending. Meant for the interactive edit
+/// loop: stop tracing, apply the edit, `update_bvh()`, restart tracing.
+inline void update_bvh(
+    scene* scn, bvh_update_state* state, const bvh_build_params& params = {}) {
+    if (state->edited_shapes.empty() && !state->edited_instances) return;
+
+    // refit edited shape trees, rebuilding the ones that degraded
+    for (auto shp : state->edited_shapes) {
+        if (!shp->bvh) {
+            build_bvh(shp, params);
+            state->build_areas[shp] = bvh_area(shp->bvh);
+            continue;
+        }
+        if (!contains(state->build_areas, (const void*)shp))
+            state->build_areas[shp] = bvh_area(shp->bvh);
+        refit_bvh(shp);
+        if (bvh_area(shp->bvh) >
+            state->build_areas.at(shp) * state->rebuild_ratio) {
+            delete shp->bvh;
+            shp->bvh = nullptr;
+            build_bvh(shp, params);
+            state->build_areas[shp] = bvh_area(shp->bvh);
+        }
+    }
+
+    // instance bounds and the scene tree
+    for (auto ist : scn->instances)
+        ist->bbox = transform_bbox(ist->frame, ist->shp->bbox);
+    if (!contains(state->build_areas, (const void*)scn))
+        state->build_areas[scn] = bvh_area(scn->bvh);
+    refit_bvh(
+        scn->bvh, 0, [scn](int eid) { return scn->instances[eid]->bbox; });
+    if (bvh_area(scn->bvh) >
+        state->build_areas.at(scn) * state->rebuild_ratio) {
+        delete scn->bvh;
+        scn->bvh = build_bvh((int)scn->instances.size(), params,
+            [scn](int eid) { return scn->instances[eid]->bbox; });
+        state->build_areas[scn] = bvh_area(scn->bvh);
+    }
+
+    // edits applied
+    state->edited_shapes.clear();
+    state->edited_instances = false;
+}
+
+/// Lazy tessellation cache for subdivision shapes. Registered shapes
+/// keep their control cage; the refined mesh and its BVH are built on
+/// the first intersection at the level set by
+/// update_tessellation_levels(), chosen from projected screen size.
+/// Refinement is safe to call concurrently from the tracing thread pool.
+/// Eviction is explicit: call trim_tessellation_cache() when no tracing
+/// is in flight, e.g. between sample batches, to drop
+/// least-recently-used tessellations back to the cage down to the
+/// residency budget. Instance and scene BVHs built from the cage bounds
+/// stay valid across refinement, since subdivided meshes are convex
+/// combinations of the cage vertices.
+struct tessellation_cache {
+    /// residency budget in bytes for refined meshes and their bvhs
+    size_t budget = (size_t)1 << 32;
+
+    // private data ---------------------
+    /// registered shapes
+    vector<shape*> shapes;
+    /// bytes currently resident beyond the control cages
+    size_t resident_bytes = 0;
+    /// lru clock, bumped on every intersection
+    std::atomic<uint64_t> clock = {0};
+    /// protects refinement and byte accounting
+    std::mutex mutex;
+};
+
+// Cleanup for the per-shape tessellation state.
+inline shape_tessellation::~shape_tessellation() {
+    if (cage) delete cage;
+    if (topology) delete topology;
+}
+
+/// Bytes used by the element and vertex data of a shape, including its
+/// bvh
+inline size_t shape_bytes(const shape* shp) {
+    auto nbytes = shp->points.size() * sizeof(int) +
+                  shp->lines.size() * sizeof(vec2i) +
+                  shp->triangles.size() * sizeof(vec3i) +
+                  shp->quads.size() * sizeof(vec4i) +
+                  shp->pos.size() * sizeof(vec3f) +
+                  shp->norm.size() * sizeof(vec3f) +
+                  shp->texcoord.size() * sizeof(vec2f) +
+                  shp->color.size() * sizeof(vec4f) +
+                  shp->radius.size() * sizeof(float) +
+                  shp->elem_cdf.size() * sizeof(float);
+    if (shp->bvh) {
+        nbytes += shp->bvh->nodes.size() * sizeof(bvh_node) +
+                  shp->bvh->sorted_prim.size() * sizeof(int) +
+                  shp->bvh->wide_nodes.size() * sizeof(bvh_wide_node);
+    }
+    return nbytes;
+}
+
+/// Makes a tessellation cache with the given residency budget. Register
+/// subdivision shapes with register_tessellation() and pick levels with
+/// update_tessellation_levels(); refinement then happens on the first
+/// intersection of each shape.
+inline tessellation_cache* make_tessellation_cache(size_t budget) {
+    auto cache = new tessellation_cache();
+    cache->budget = budget;
+    return cache;
+}
+
+/// Registers a shape as a lazily-refined subdivision surface, with its
+/// current data as the control cage. Returns false for face-varying,
+/// element-less or emissive shapes, which are left as they are; light
+/// sampling CDFs from update_lights() depend on the tessellation, so
+/// emitters must stay eager. Call before build_bvh(), so that instance
+/// and scene bounds are built from the cage, which bounds every
+/// refinement level.
+inline bool register_tessellation(
+    tessellation_cache* cache, shape* shp, int max_level, bool subdiv = true) {
+    if (shp->mat && shp->mat->ke != zero3f) return false;
+    auto topology = make_subdivision_cache(shp, max_level, subdiv);
+    if (!topology) return false;
+    auto tess = new shape_tessellation();
+    tess->cache = cache;
+    tess->topology = topology;
+    tess->max_level = max_level;
+    tess->cage = new shape();
+    tess->cage->points = shp->points;
+    tess->cage->lines = shp->lines;
+    tess->cage->triangles = shp->triangles;
+    tess->cage->quads = shp->quads;
+    tess->cage->pos = shp->pos;
+    tess->cage->norm = shp->norm;
+    tess->cage->texcoord = shp->texcoord;
+    tess->cage->color = shp->color;
+    tess->cage->radius = shp->radius;
+    for (auto& p : shp->pos) tess->cage->bbox += p;
+    shp->tess = tess;
+    cache->shapes.push_back(shp);
+    return true;
+}
+
+/// Chooses the refinement level of each registered shape from its
+/// projected screen size for a render at the given resolution, so that
+/// refined quads approach pixel scale. Must be called when no tracing is
+/// in flight, since intersections check the level without holding the
+/// cache lock; the next intersections then refine shapes on demand.
+inline void update_tessellation_levels(const scene* scn,
+    tessellation_cache* cache, const camera* cam, int resolution) {
+    for (auto shp : cache->shapes) shp->tess->target = 0;
+    for (auto ist : scn->instances) {
+        if (!ist->shp || !ist->shp->tess) continue;
+        auto tess = ist->shp->tess;
+        // conservative projected diameter in pixels
+        auto bbox = transform_bbox(ist->frame, tess->cage->bbox);
+        auto diag = length(bbox_diagonal(bbox));
+        auto dist = length(bbox_center(bbox) - cam->frame.o) - diag / 2;
+        if (dist < cam->near) dist = cam->near;
+        auto proj = resolution * diag / (2 * dist * std::tan(cam->yfov / 2));
+        // each level halves the refined edge length; stop once the cage
+        // faces, roughly sqrt(nfaces) across, reach pixel scale
+        auto nelems = (int)(tess->cage->quads.size() +
+                            tess->cage->triangles.size() +
+                            tess->cage->lines.size());
+        auto across = std::sqrt((float)max(nelems, 1));
+        auto level = 0;
+        while (level < tess->max_level && across * (1 << level) < proj)
+            level++;
+        if (level > tess->target) tess->target = level;
+    }
+}
+
+/// Refines a registered shape to its target level, rebuilding its BVH,
+/// and marks the use for lru eviction. Called on demand by
+/// intersect_ray().
+inline void fetch_tessellation(shape* shp) {
+    auto tess = shp->tess;
+    auto cache = tess->cache;
+    tess->last_use = ++cache->clock;
+    if (tess->level == tess->target) return;
+    auto lock = std::unique_lock<std::mutex>(cache->mutex);
+    if (tess->level == tess->target) return;  // another thread refined it
+    if (tess->level > 0) cache->resident_bytes -= shape_bytes(shp);
+    if (tess->target > 0) {
+        subdivide_shape_cached(tess->cage, shp, tess->topology, tess->target);
+    } else {
+        shp->lines = tess->cage->lines;
+        shp->triangles = tess->cage->triangles;
+        shp->quads = tess->cage->quads;
+        shp->pos = tess->cage->pos;
+        shp->norm = tess->cage->norm;
+        shp->texcoord = tess->cage->texcoord;
+        shp->color = tess->cage->color;
+        shp->radius = tess->cage->radius;
+    }
+    if (shp->bvh) delete shp->bvh;
+    shp->bvh = nullptr;
+    build_bvh(shp, bvh_build_params());
+    // keep the conservative cage bounds for instance and scene bvhs
+    shp->bbox = tess->cage->bbox;
+    if (tess->target > 0) cache->resident_bytes += shape_bytes(shp);
+    tess->level = tess->target;
+}
+
+/// Evicts least-recently-used tessellations back to the control cage
+/// until the cache fits its budget. Must be called when no tracing is in
+/// flight, since intersections read the shape data without holding the
+/// cache lock.
+inline void trim_tessellation_cache(tessellation_cache* cache) {
+    auto lock = std::unique_lock<std::mutex>(cache->mutex);
+    while (cache->resident_bytes > cache->budget) {
+        auto lru = (shape*)nullptr;
+        for (auto shp : cache->shapes) {
+            if (!shp->tess->level) continue;
+            if (!lru || shp->tess->last_use < lru->tess->last_use) lru = shp;
+        }
+        if (!lru) break;
+        auto tess = lru->tess;
+        cache->resident_bytes -= shape_bytes(lru);
+        lru->lines = tess->cage->lines;
+        lru->triangles = tess->cage->triangles;
+        lru->quads = tess->cage->quads;
+        lru->pos = tess->cage->pos;
+        lru->norm = tess->cage->norm;
+        lru->texcoord = tess->cage->texcoord;
+        lru->color = tess->cage->color;
+        lru->radius = tess->cage->radius;
+        if (lru->bvh) delete lru->bvh;
+        lru->bvh = nullptr;
+        build_bvh(lru, bvh_build_params());
+        lru->bbox = tess->cage->bbox;
+        tess->level = 0;
+    }
+}
+
+/// Shape to intersect and shade for an instance at its current level of
+/// detail (see update_lods()).
+inline const shape* lod_shape(const instance* ist) {
+    if (!ist->lod || ist->shp->lods.empty()) return ist->shp;
+    return ist->shp->lods[min(ist->lod, (int)ist->shp->lods.size()) - 1];
+}
+
+/// Chooses the level of detail of each instance from its projected
+/// screen size for a render at the given resolution, aiming at roughly
+/// one triangle per pixel. Both intersection and shading then use the
+/// selected level, so it must be called when no tracing is in flight.
+/// Emissive instances stay at the full mesh, since light sampling CDFs
+/// from update_lights() index its elements.
+inline void update_lods(const scene* scn, const camera* cam, int resolution) {
+    for (auto ist : scn->instances) {
+        ist->lod = 0;
+        auto shp = ist->shp;
+        if (!shp || shp->lods.empty()) continue;
+        if (shp->mat && shp->mat->ke != zero3f) continue;
+        // conservative projected diameter in pixels
+        auto bbox = transform_bbox(ist->frame, shp->bbox);
+        auto diag = length(bbox_diagonal(bbox));
+        auto dist = length(bbox_center(bbox) - cam->frame.o) - diag / 2;
+        if (dist < cam->near) dist = cam->near;
+        auto proj = resolution * diag / (2 * dist * std::tan(cam->yfov / 2));
+        // each level halves the triangle count; stop once the next one
+        // would drop below a triangle per covered pixel
+        auto ntris = (float)shp->triangles.size();
+        while (ist->lod < (int)shp->lods.size() && ntris / 2 >= proj * proj) {
+            ntris /= 2;
+            ist->lod++;
+        }
+    }
+}
+
 /// Intersect the shape with a ray. Find any interstion if early_exit,
 /// otherwise find first intersection.
 ///
@@ -7455,6 +9549,9 @@ inline void refit_bvh(scene* scn, bool do_shapes = true) {
 ///     - whether it intersected
 inline bool intersect_ray(const shape* shp, const ray3f& ray, bool early_exit,
     float& ray_t, int& eid, vec4f& euv) {
+    // refine registered subdivision shapes on demand
+    if (shp->tess) fetch_tessellation((shape*)shp);
+
     // switch over shape type
     if (!shp->triangles.empty()) {
         if (intersect_triangles_bvh(shp->bvh, shp->triangles, shp->pos, ray,
@@ -7504,7 +9601,7 @@ inline bool intersect_ray(const shape* shp, const ray3f& ray, bool early_exit,
 ///     - whether it intersected
 inline bool intersect_ray(const instance* ist, const ray3f& ray,
     bool early_exit, float& ray_t, int& eid, vec4f& euv) {
-    return intersect_ray(ist->shp, transform_ray_inverse(ist->frame, ray),
+    return intersect_ray(lod_shape(ist), transform_ray_inverse(ist->frame, ray),
         early_exit, ray_t, eid, euv);
 }
 
@@ -7556,6 +9653,11 @@ struct intersection_point {
 ///     - intersection record
 inline intersection_point intersect_ray(
     const scene* scn, const ray3f& ray, bool early_exit) {
+    if (early_exit) {
+        YGL_STAT(shadow_rays, 1);
+    } else {
+        YGL_STAT(rays, 1);
+    }
     auto isec = intersection_point();
     if (!intersect_ray(
             scn, ray, early_exit, isec.dist, isec.iid, isec.eid, isec.euv))
@@ -7563,6 +9665,142 @@ inline intersection_point intersect_ray(
     return isec;
 }
 
+/// Intersect the scene with a stream of rays, traversing the scene BVH in
+/// packets of bvh_packet_size rays so coherent rays share bbox tests.
+/// Intersections are written per ray, with default records for misses.
+///
+/// - Parameters:
+///     - scn: scene to intersect
+///     - rays, nrays: ray stream to be intersected
+///     - early_exit: whether to stop at the first found hit
+///     - isecs: per-ray intersection records
+inline void intersect_ray_stream(const scene* scn, const ray3f* rays,
+    int nrays, bool early_exit, intersection_point* isecs) {
+    if (early_exit) {
+        YGL_STAT(shadow_rays, nrays);
+    } else {
+        YGL_STAT(rays, nrays);
+    }
+    auto ray_ts = vector<float>(nrays, 0.0f);
+    auto iids = vector<int>(nrays, -1);
+    for (auto i = 0; i < nrays; i++) isecs[i] = {};
+    intersect_bvh(scn->bvh, rays, nrays, early_exit, ray_ts.data(),
+        iids.data(),
+        [scn, isecs, early_exit](
+            int iid, int rid, const ray3f& ray, float& ray_t) {
+            auto eid = 0;
+            auto euv = zero4f;
+            if (!intersect_ray(scn->instances[iid], ray, early_exit, ray_t,
+                    eid, euv))
+                return false;
+            isecs[rid] = {ray_t, iid, eid, euv};
+            return true;
+        });
+}
+
+/// Intersect the scene with a stream of rays. See the pointer interface
+/// for details.
+inline vector<intersection_point> intersect_ray_stream(
+    const scene* scn, const vector<ray3f>& rays, bool early_exit) {
+    auto isecs = vector<intersection_point>(rays.size());
+    intersect_ray_stream(
+        scn, rays.data(), (int)rays.size(), early_exit, isecs.data());
+    return isecs;
+}
+
+/// Test whether a ray is occluded by the shape. Uses the dedicated
+/// occlusion traversal, which skips all hit-record bookkeeping.
+inline bool intersect_occluded(const shape* shp, const ray3f& ray) {
+    if (!shp->triangles.empty()) {
+        return intersect_bvh_occluded(shp->bvh, ray, [shp](int eid,
+                                                        const ray3f& ray) {
+            auto f = shp->triangles[eid];
+            auto ray_t = 0.0f;
+            auto euv = zero3f;
+            return intersect_triangle(
+                ray, shp->pos[f.x], shp->pos[f.y], shp->pos[f.z], ray_t, euv);
+        });
+    } else if (!shp->quads.empty()) {
+        return intersect_bvh_occluded(
+            shp->bvh, ray, [shp](int eid, const ray3f& ray) {
+                auto f = shp->quads[eid];
+                auto ray_t = 0.0f;
+                auto euv = zero4f;
+                return intersect_quad(ray, shp->pos[f.x], shp->pos[f.y],
+                    shp->pos[f.z], shp->pos[f.w], ray_t, euv);
+            });
+    } else if (!shp->lines.empty()) {
+        return intersect_bvh_occluded(
+            shp->bvh, ray, [shp](int eid, const ray3f& ray) {
+                auto f = shp->lines[eid];
+                auto ray_t = 0.0f;
+                auto euv = zero2f;
+                return intersect_line(ray, shp->pos[f.x], shp->pos[f.y],
+                    shp->radius[f.x], shp->radius[f.y], ray_t, euv);
+            });
+    } else if (!shp->points.empty()) {
+        return intersect_bvh_occluded(
+            shp->bvh, ray, [shp](int eid, const ray3f& ray) {
+                auto f = shp->points[eid];
+                auto ray_t = 0.0f;
+                return intersect_point(ray, shp->pos[f], shp->radius[f], ray_t);
+            });
+    } else {
+        return intersect_bvh_occluded(
+            shp->bvh, ray, [shp](int eid, const ray3f& ray) {
+                auto ray_t = 0.0f;
+                return intersect_point(
+                    ray, shp->pos[eid], shp->radius[eid], ray_t);
+            });
+    }
+}
+
+/// Test whether a ray is occluded by the instance, at its current level
+/// of detail so shadows agree with what camera rays hit.
+inline bool intersect_occluded(const instance* ist, const ray3f& ray) {
+    return intersect_occluded(
+        lod_shape(ist), transform_ray_inverse(ist->frame, ray));
+}
+
+/// Test whether a ray is occluded by anything in the scene.
+inline bool intersect_occluded(const scene* scn, const ray3f& ray) {
+    YGL_STAT(shadow_rays, 1);
+    return intersect_bvh_occluded(
+        scn->bvh, ray, [scn](int iid, const ray3f& ray) {
+            return intersect_occluded(scn->instances[iid], ray);
+        });
+}
+
+/// Test a batch of shadow rays against the scene, writing per-ray
+/// occlusion flags. Rays are traversed as packets through the stream
+/// interface with early exit, so lanes retire on their first hit.
+inline void intersect_shadow_rays(
+    const scene* scn, const ray3f* rays, int nrays, bool* occluded) {
+    YGL_STAT(shadow_rays, nrays);
+    auto ray_ts = vector<float>(nrays, 0.0f);
+    auto iids = vector<int>(nrays, -1);
+    for (auto i = 0; i < nrays; i++) occluded[i] = false;
+    intersect_bvh(scn->bvh, rays, nrays, true, ray_ts.data(), iids.data(),
+        [scn, occluded](int iid, int rid, const ray3f& ray, float& ray_t) {
+            if (!intersect_occluded(scn->instances[iid], ray)) return false;
+            occluded[rid] = true;
+            return true;
+        });
+}
+
+/// Test a batch of shadow rays against the scene. See the pointer
+/// interface for details.
+inline vector<bool> intersect_shadow_rays(
+    const scene* scn, const vector<ray3f>& rays) {
+    auto occluded = vector<bool>(rays.size());
+    auto buffer = vector<char>(rays.size(), 0);
+    intersect_shadow_rays(
+        scn, rays.data(), (int)rays.size(), (bool*)buffer.data());
+    for (auto i = 0; i < (int)rays.size(); i++)
+        occluded[i] = (bool)buffer[i];
+    return occluded;
+}
+
 /// Finds the closest element that overlaps a point within a given distance.
 ///
 /// - Parameters:
@@ -7772,13 +10010,19 @@ enum struct trace_rng_type {
     uniform = 0,
     /// stratified random numbers
     stratified,
+    /// scrambled sobol sequence
+    sobol,
+    /// low-discrepancy sequence with per-pixel blue-noise dithering
+    bluenoise,
 };
 
 /// Names for enumeration
 inline const vector<pair<string, trace_rng_type>>& trace_rng_names() {
     static auto names = vector<pair<string, trace_rng_type>>{
         {"uniform", trace_rng_type::uniform},
-        {"stratified", trace_rng_type::stratified}};
+        {"stratified", trace_rng_type::stratified},
+        {"sobol", trace_rng_type::sobol},
+        {"bluenoise", trace_rng_type::bluenoise}};
     return names;
 }
 
@@ -7843,6 +10087,22 @@ struct trace_params {
     uint32_t seed = 0;
     /// block size for parallel batches (probably leave it as is)
     int block_size = 32;
+    /// variance-driven adaptive sampling: stop sampling pixels whose
+    /// confidence interval fell under the threshold and spend the leftover
+    /// budget on the unconverged ones (box filter only)
+    bool adaptive = false;
+    /// adaptive sampling: 95% confidence half-width on the mean pixel
+    /// luminance, relative to the pixel brightness, below which a pixel
+    /// is considered converged
+    float adaptive_threshold = 0.01f;
+    /// adaptive sampling: samples taken before convergence is tested
+    int adaptive_min_samples = 16;
+    /// wavefront execution: advance the whole batch of paths breadth-first
+    /// one bounce at a time, with intersection, light sampling and bsdf
+    /// evaluation run as bulk stages over path-state arrays, so ray
+    /// coherence survives past the first bounce (pathtrace shader only;
+    /// other shaders keep the recursive mode)
+    bool wavefront = false;
 };
 
 /// Make image blocks
@@ -7870,6 +10130,25 @@ inline vector<rng_pcg32> trace_rngs(const trace_params& params) {
     return rngs;
 }
 
+/// Auxiliary feature images (AOVs) filled by the tracer at the primary
+/// hit of the beauty pass, e.g. for denoising, without tracing extra
+/// rays. All images must be sized like the beauty image. Albedo, normal
+/// and depth average the same camera samples as the beauty image, with
+/// the alpha channel holding the fraction of samples that hit geometry;
+/// id holds the instance index of the last sample, or -1 for a miss.
+/// Accumulation needs full floats, but finished AOVs can be narrowed to
+/// image4h with float_to_half() for compact storage.
+struct trace_aovs {
+    /// albedo at the primary hit
+    image4f albedo;
+    /// shading normal at the primary hit
+    image4f norm;
+    /// distance along the primary ray
+    image4f depth;
+    /// instance index at the primary hit
+    image4f id;
+};
+
 /// Renders a block of samples
 ///
 /// Notes: It is safe to call the function in parallel on different blocks.
@@ -7887,11 +10166,23 @@ void trace_block(const scene* scn, image4f& img, const vec2i& block_min,
     const vec2i& block_max, int samples_min, int samples_max,
     vector<rng_pcg32>& rngs, const trace_params& params);
 
+/// Renders a block of samples, filling the feature images in the same
+/// pass as the beauty image. Same constraints as trace_block().
+void trace_block(const scene* scn, image4f& img, trace_aovs& aovs,
+    const vec2i& block_min, const vec2i& block_max, int samples_min,
+    int samples_max, vector<rng_pcg32>& rngs, const trace_params& params);
+
 /// Trace the next samples in [samples_min, samples_max) range.
 /// Samples have to be traced consecutively.
 void trace_samples(const scene* scn, image4f& img, int samples_min,
     int samples_max, vector<rng_pcg32>& rngs, const trace_params& params);
 
+/// Trace the next samples in [samples_min, samples_max) range, filling
+/// the feature images in the same pass as the beauty image.
+void trace_samples(const scene* scn, image4f& img, trace_aovs& aovs,
+    int samples_min, int samples_max, vector<rng_pcg32>& rngs,
+    const trace_params& params);
+
 /// Renders a filtered block of samples
 ///
 /// Notes: It is safe to call the function in parallel on different blocks.
@@ -7919,11 +10210,60 @@ void trace_filtered_samples(const scene* scn, image4f& img, image4f& acc,
     image4f& weight, int samples_min, int samples_max, vector<rng_pcg32>& rngs,
     const trace_params& params);
 
+/// Trace the next samples adaptively: each batch spends its sample budget
+/// only on pixels whose luminance confidence interval is still above
+/// `params.adaptive_threshold`, so converged pixels stop early and heavy
+/// pixels reach the full `params.nsamples` sooner. Per-pixel statistics
+/// persist across batches in the caller-provided buffers, following the
+/// same convention as `trace_filtered_samples()`: `acc` accumulates
+/// radiance sums and `var` tracks the sum of squared luminance (x) and
+/// the samples taken (y). Box filtering only.
+void trace_adaptive_samples(const scene* scn, image4f& img, image4f& acc,
+    image4f& var, int samples_min, int samples_max, vector<rng_pcg32>& rngs,
+    const trace_params& params);
+
+/// Saves the progressive render state (beauty image, per-pixel RNGs and
+/// the number of samples taken so far) to a binary checkpoint file, so a
+/// long render killed mid-flight can be resumed with
+/// `load_trace_checkpoint()` instead of restarting from scratch. The file
+/// is written to a sidecar and atomically renamed, so an interruption
+/// during the save leaves the previous checkpoint intact. Call between
+/// `trace_samples()` batches, with no tracing in flight. Box filtering
+/// only, since the filtered and adaptive paths keep extra state. Returns
+/// false on I/O errors.
+bool save_trace_checkpoint(const string& filename, const image4f& img,
+    const vector<rng_pcg32>& rngs, int nsamples, const trace_params& params);
+
+/// Saves the progressive render state including the feature images.
+bool save_trace_checkpoint(const string& filename, const image4f& img,
+    const trace_aovs& aovs, const vector<rng_pcg32>& rngs, int nsamples,
+    const trace_params& params);
+
+/// Loads the render state written by `save_trace_checkpoint()` and sets
+/// `nsamples` to the number of samples already taken, to be passed as
+/// `samples_min` to the next `trace_samples()` call. Since the RNG states
+/// are restored exactly, the resumed render is bit-identical to an
+/// uninterrupted one. Returns false, leaving the outputs untouched, if
+/// the file is missing or malformed or was written for a different
+/// resolution, seed or AOV setting.
+bool load_trace_checkpoint(const string& filename, image4f& img,
+    vector<rng_pcg32>& rngs, int& nsamples, const trace_params& params);
+
+/// Loads the render state including the feature images.
+bool load_trace_checkpoint(const string& filename, image4f& img,
+    trace_aovs& aovs, vector<rng_pcg32>& rngs, int& nsamples,
+    const trace_params& params);
+
 /// Trace the whole image
 inline image4f trace_image(const scene* scn, const trace_params& params) {
     auto img = image4f(params.width, params.height);
     auto rngs = trace_rngs(params);
-    if (params.ftype == trace_filter_type::box) {
+    if (params.adaptive) {
+        auto acc = image4f(params.width, params.height);
+        auto var = image4f(params.width, params.height);
+        trace_adaptive_samples(
+            scn, img, acc, var, 0, params.nsamples, rngs, params);
+    } else if (params.ftype == trace_filter_type::box) {
         trace_samples(scn, img, 0, params.nsamples, rngs, params);
     } else {
         auto acc = image4f(params.width, params.height);
@@ -8193,20 +10533,26 @@ struct obj_scene {
     /// instances [extension]
     vector<obj_instance*> instances;
 
+    /// arena holding the loader-created objects, freed wholesale; objects
+    /// added with new are still deleted individually
+    memory_arena* arena = nullptr;
+
     /// cleanup
     ~obj_scene() {
+        auto owned = [this](void* v) { return arena && arena->owns(v); };
         for (auto v : objects)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : materials)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : textures)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : cameras)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : environments)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
         for (auto v : instances)
-            if (v) delete v;
+            if (v && !owned(v)) delete v;
+        if (arena) delete arena;
     }
 };
 
@@ -8297,8 +10643,67 @@ obj_mesh* get_mesh(
 // -----------------------------------------------------------------------------
 namespace ygl {
 
-/// Generic buffer data.
-using buffer_data = vector<unsigned char>;
+/// Memory-mapped file backing zero-copy buffer_data. The mapping is owned
+/// by the glTF asset it was loaded for and stays valid for its lifetime.
+struct file_mapping {
+    /// mapped bytes
+    const unsigned char* data = nullptr;
+    /// mapped size in bytes
+    size_t size = 0;
+
+    /// releases the mapping
+    ~file_mapping();
+
+    // private data --------------------
+    /// platform mapping handle
+    void* _mapped = nullptr;
+    /// file descriptor backing the mapping
+    int _fd = -1;
+};
+
+/// Generic buffer data. Owns its bytes by default, but can also alias
+/// memory owned by someone else, e.g. a memory-mapped file (see
+/// load_gltf()), in which case the bytes are read-only.
+struct buffer_data {
+    /// empty buffer constructor
+    buffer_data() {}
+    /// constructor taking ownership of the given bytes
+    buffer_data(vector<unsigned char> bytes) : _bytes(std::move(bytes)) {}
+
+    /// points at nbytes of memory owned by someone else, dropping any
+    /// owned bytes
+    void alias(const unsigned char* bytes, size_t nbytes) {
+        _bytes = {};
+        _alias = bytes;
+        _alias_size = nbytes;
+    }
+
+    /// number of bytes
+    size_t size() const { return (_alias) ? _alias_size : _bytes.size(); }
+    /// check for empty
+    bool empty() const { return !size(); }
+
+    /// data access
+    const unsigned char* data() const {
+        return (_alias) ? _alias : _bytes.data();
+    }
+    /// data access; writing is only valid for owned bytes
+    unsigned char* data() {
+        return (_alias) ? (unsigned char*)_alias : _bytes.data();
+    }
+
+    /// resizes owned storage, dropping any alias
+    void resize(size_t nbytes) {
+        _alias = nullptr;
+        _alias_size = 0;
+        _bytes.resize(nbytes);
+    }
+
+   private:
+    vector<unsigned char> _bytes;
+    const unsigned char* _alias = nullptr;
+    size_t _alias_size = 0;
+};
 
 /// Generic image data.
 struct image_data {
@@ -9075,6 +11480,8 @@ struct glTF : glTFProperty {
     vector<glTFSkin*> skins = {};
     /// An array of textures.
     vector<glTFTexture*> textures = {};
+    /// File mappings backing zero-copy buffer data (see load_gltf()).
+    vector<file_mapping*> mappings = {};
 
     /// typed access for nodes
     glTFAccessor* get(const glTFid<glTFAccessor>& id) const {
@@ -9170,12 +11577,16 @@ struct glTF : glTFProperty {
             if (v) delete v;
         for (auto v : textures)
             if (v) delete v;
+        for (auto v : mappings)
+            if (v) delete v;
     }
 };
 // #codegen end type
 // -----------------------------------------------------------
 
-/// Loads a gltf file from disk
+/// Loads a gltf file from disk. External buffers are memory-mapped when
+/// possible and aliased into buffer data without copying; the mappings
+/// are owned by the returned asset and released with it.
 ///
 /// - Parameters:
 ///     - filename: scene filename
@@ -9186,7 +11597,9 @@ struct glTF : glTFProperty {
 glTF* load_gltf(const string& filename, bool load_bin = true,
     bool load_img = false, bool skip_missing = false);
 
-/// Loads a binary gltf file from disk
+/// Loads a binary gltf file from disk. The file is memory-mapped when
+/// possible and the internal buffer chunk aliased into it without
+/// copying, as in load_gltf().
 ///
 /// - Parameters:
 ///     - filename: scene filename
@@ -10081,34 +12494,48 @@ inline void log_fatal(const string& msg, const Args&... args) {
 // -----------------------------------------------------------------------------
 namespace ygl {
 
-/// Thread pool for concurrency. This code is derived from LLVM ThreadPool
+/// Thread pool for concurrency with work stealing. Each worker owns a
+/// task deque guarded by its own lock, so task handoff never contends on
+/// a single queue lock; idle workers steal from their peers. Workers
+/// waiting on a `parallel_for()` run queued tasks instead of blocking,
+/// so parallel loops nest without deadlock (e.g. a parallel scene-BVH
+/// build spawning parallel per-shape builds). Loops are chunked so each
+/// task covers a contiguous index range sized from the worker count.
+/// The original single-queue code was derived from LLVM ThreadPool.
 struct thread_pool {
     // initialize the thread pool
     thread_pool(int nthreads = std::thread::hardware_concurrency())
-        : _working_threads(0), _stop_flag(false) {
+        : _pending(0), _unfinished(0), _push_index(0), _stop_flag(false) {
+        if (nthreads < 1) nthreads = 1;
+        _queues.reserve(nthreads);
         _threads.reserve(nthreads);
-        for (auto tid = 0; tid < nthreads; tid++) {
-            _threads.emplace_back([this] { _thread_proc(); });
-        }
+        for (auto tid = 0; tid < nthreads; tid++)
+            _queues.push_back(new _task_queue());
+        for (auto tid = 0; tid < nthreads; tid++)
+            _threads.emplace_back([this, tid] { _thread_proc(tid); });
     }
 
-    // cleanup
+    // cleanup; drains the remaining tasks before joining
     ~thread_pool() {
         {
-            std::unique_lock<std::mutex> lock_guard(_queue_lock);
+            std::unique_lock<std::mutex> lock_guard(_wake_lock);
             _stop_flag = true;
         }
-        _queue_condition.notify_all();
-        for (auto& Worker : _threads) Worker.join();
+        _wake_condition.notify_all();
+        for (auto& worker : _threads) worker.join();
+        for (auto queue : _queues) delete queue;
     }
 
-    // empty the queue
+    // empty all queues
     void _clear_pool() {
-        {
-            std::unique_lock<std::mutex> lock_guard(_queue_lock);
-            _tasks.clear();
+        for (auto queue : _queues) {
+            std::unique_lock<std::mutex> lock_guard(queue->_lock);
+            _pending -= (int)queue->_tasks.size();
+            _unfinished -= (int)queue->_tasks.size();
+            queue->_tasks.clear();
         }
-        _queue_condition.notify_all();
+        { std::unique_lock<std::mutex> lock_guard(_completion_lock); }
+        _completion_condition.notify_all();
     }
 
     // schedule an asynchronous taks
@@ -10116,68 +12543,143 @@ struct thread_pool {
         // Wrap the Task in a packaged_task to return a future object.
         std::packaged_task<void()> packaged_task(std::move(task));
         auto future = packaged_task.get_future();
-        {
-            std::unique_lock<std::mutex> lock_guard(_queue_lock);
-            assert(!_stop_flag &&
-                   "Queuing a thread during ThreadPool destruction");
-            _tasks.push_back(std::move(packaged_task));
-        }
-        _queue_condition.notify_one();
+        assert(
+            !_stop_flag && "Queuing a thread during ThreadPool destruction");
+        _push_task(std::move(packaged_task), false);
         return future.share();
     }
 
-    // wait for all tasks to finish
+    // wait for all tasks to finish, helping to run them meanwhile
     void _wait() {
-        std::unique_lock<std::mutex> lock_guard(_completion_lock);
-        _completion_condition.wait(
-            lock_guard, [&] { return _tasks.empty() && !_working_threads; });
+        while (_unfinished) {
+            if (_try_run_one()) continue;
+            std::unique_lock<std::mutex> lock_guard(_completion_lock);
+            _completion_condition.wait_for(lock_guard,
+                std::chrono::milliseconds(1), [&] { return !_unfinished; });
+        }
     }
 
-    // parallel for
+    // parallel for; chunks the indices so each task covers a contiguous
+    // range, then helps run tasks until its own chunks complete, which
+    // makes nested calls from workers safe
     void _parallel_for(int count, const function<void(int idx)>& task) {
-        for (auto idx = 0; idx < count; idx++) {
-            _run_async([&task, idx]() { task(idx); });
+        if (count <= 0) return;
+        auto nchunks = min(count, (int)_threads.size() * 4);
+        std::atomic<int> chunks_left(nchunks);
+        for (auto c = 0; c < nchunks; c++) {
+            auto start = (int)(((int64_t)count * c) / nchunks);
+            auto end = (int)(((int64_t)count * (c + 1)) / nchunks);
+            // count the chunk as done even when the task throws, so the
+            // wait loop below cannot spin forever; the exception is
+            // stored by the wrapping packaged_task as for run_async
+            _push_task(std::packaged_task<void()>(
+                           [&task, &chunks_left, start, end]() {
+                               try {
+                                   for (auto idx = start; idx < end; idx++)
+                                       task(idx);
+                               } catch (...) {
+                                   chunks_left--;
+                                   throw;
+                               }
+                               chunks_left--;
+                           }),
+                true);
+        }
+        while (chunks_left) {
+            if (_try_run_one()) continue;
+            std::unique_lock<std::mutex> lock_guard(_completion_lock);
+            _completion_condition.wait_for(lock_guard,
+                std::chrono::milliseconds(1), [&] { return !chunks_left; });
         }
-        _wait();
     }
 
     // implementation -------------------------------------------------
-    void _thread_proc() {
-        while (true) {
-            std::packaged_task<void()> task;
-            {
-                std::unique_lock<std::mutex> lock_guard(_queue_lock);
-                _queue_condition.wait(
-                    lock_guard, [&] { return _stop_flag || !_tasks.empty(); });
 
-                if (_stop_flag && _tasks.empty()) return;
+    // per-worker task queue; asynchronous tasks are appended at the back
+    // and taken from the front, keeping submission order, while chunks of
+    // blocking parallel loops jump the line at the front
+    struct _task_queue {
+        std::deque<std::packaged_task<void()>> _tasks;
+        std::mutex _lock;
+    };
 
-                {
-                    _working_threads++;
-                    std::unique_lock<std::mutex> lock_guard(_completion_lock);
-                }
-                task = std::move(_tasks.front());
-                _tasks.pop_front();
-            }
+    // which pool, if any, the calling thread works for
+    static std::pair<thread_pool*, int>& _worker_slot() {
+        static thread_local auto slot = std::pair<thread_pool*, int>{
+            nullptr, -1};
+        return slot;
+    }
 
-            task();
+    // push a task onto the calling worker's own queue, or round-robin
+    // across queues for external callers
+    void _push_task(std::packaged_task<void()>&& task, bool urgent) {
+        auto& slot = _worker_slot();
+        auto qid = (slot.first == this) ?
+                       slot.second :
+                       (int)(_push_index++ % _queues.size());
+        {
+            std::unique_lock<std::mutex> lock_guard(_queues[qid]->_lock);
+            if (urgent)
+                _queues[qid]->_tasks.push_front(std::move(task));
+            else
+                _queues[qid]->_tasks.push_back(std::move(task));
+        }
+        _unfinished++;
+        _pending++;
+        { std::unique_lock<std::mutex> lock_guard(_wake_lock); }
+        _wake_condition.notify_one();
+    }
+
+    // take a task from the caller's own queue, stealing from the other
+    // workers' queues when it is empty
+    bool _pop_task(std::packaged_task<void()>& task) {
+        auto& slot = _worker_slot();
+        auto wid = (slot.first == this) ? slot.second : -1;
+        auto nqueues = (int)_queues.size();
+        for (auto i = 0; i < nqueues; i++) {
+            auto queue = _queues[((wid < 0) ? i : wid + i) % nqueues];
+            std::unique_lock<std::mutex> lock_guard(queue->_lock);
+            if (queue->_tasks.empty()) continue;
+            task = std::move(queue->_tasks.front());
+            queue->_tasks.pop_front();
+            _pending--;
+            return true;
+        }
+        return false;
+    }
 
-            {
-                std::unique_lock<std::mutex> lock_guard(_completion_lock);
-                _working_threads--;
-            }
+    // run one queued task if any is available
+    bool _try_run_one() {
+        std::packaged_task<void()> task;
+        if (!_pop_task(task)) return false;
+        task();
+        _unfinished--;
+        { std::unique_lock<std::mutex> lock_guard(_completion_lock); }
+        _completion_condition.notify_all();
+        return true;
+    }
 
-            _completion_condition.notify_all();
+    // worker loop: run tasks until none are left, then sleep
+    void _thread_proc(int wid) {
+        _worker_slot() = {this, wid};
+        while (true) {
+            while (_try_run_one()) {}
+            std::unique_lock<std::mutex> lock_guard(_wake_lock);
+            if (_stop_flag && _pending <= 0) return;
+            _wake_condition.wait(
+                lock_guard, [&] { return _stop_flag || _pending > 0; });
+            if (_stop_flag && _pending <= 0) return;
         }
     }
 
     vector<std::thread> _threads;
-    std::deque<std::packaged_task<void()>> _tasks;
-    std::mutex _queue_lock;
-    std::condition_variable _queue_condition;
+    vector<_task_queue*> _queues;
+    std::atomic<int> _pending, _unfinished;
+    std::atomic<unsigned> _push_index;
+    std::mutex _wake_lock;
+    std::condition_variable _wake_condition;
     std::mutex _completion_lock;
     std::condition_variable _completion_condition;
-    std::atomic<unsigned> _working_threads;
     bool _stop_flag = false;
 };
 
@@ -10193,6 +12695,13 @@ inline std::shared_future<void> run_async(
     return pool->_run_async(task);
 }
 
+/// Whether the calling thread is a worker of the pool. Nested dispatch
+/// is safe with the work-stealing pool, since waiting workers run queued
+/// tasks; this remains useful to detect worker context.
+inline bool in_pool(thread_pool* pool) {
+    return thread_pool::_worker_slot().first == pool;
+}
+
 /// Wait for all jobs to finish on the global thread pool
 inline void wait_pool(thread_pool* pool) { pool->_wait(); }
 
@@ -10440,6 +12949,62 @@ inline bool is_texture_valid(const gl_texture& txt) { return (bool)txt._tid; }
 /// Destroys the texture tid.
 void clear_texture(gl_texture& txt);
 
+/// Double-buffered pixel-buffer-object streamer for frequently updated
+/// textures, such as the interactive tracer preview. update_texture()
+/// stalls the caller on the driver copy; update_texture_async() instead
+/// writes the pixels into one of two persistent pixel buffers and
+/// issues the texture copy from buffer memory, so the driver overlaps
+/// it with drawing while the next refresh fills the other buffer. A
+/// fence per buffer delays its reuse until the driver copy finished,
+/// without ever blocking on the upload just issued.
+struct gl_texture_stream {
+    // pixel buffer pair, filled in alternation
+    uint _pbos[2] = {0, 0};
+    // fences signaled when the driver finished reading each buffer
+    void* _fences[2] = {nullptr, nullptr};
+    // buffer to fill next
+    int _next = 0;
+    // allocated bytes per buffer
+    size_t _capacity = 0;
+};
+
+// Implementation of update_texture_async.
+void _update_texture_async(gl_texture& txt, gl_texture_stream& stream, int w,
+    int h, int nc, const void* pixels, bool floats, int ymin, int ymax);
+
+/// Updates the texture through the stream's pixel buffers. Only the
+/// subregion spanning rows [ymin, ymax) is copied; pixels points to the
+/// full image.
+inline void update_texture_async(gl_texture& txt, gl_texture_stream& stream,
+    int w, int h, int nc, const float* pixels, int ymin, int ymax) {
+    _update_texture_async(txt, stream, w, h, nc, pixels, true, ymin, ymax);
+}
+
+/// Updates the texture through the stream's pixel buffers. Only the
+/// subregion spanning rows [ymin, ymax) is copied; pixels points to the
+/// full image.
+inline void update_texture_async(gl_texture& txt, gl_texture_stream& stream,
+    int w, int h, int nc, const unsigned char* pixels, int ymin, int ymax) {
+    _update_texture_async(txt, stream, w, h, nc, pixels, false, ymin, ymax);
+}
+
+/// Updates the whole texture through the stream's pixel buffers.
+inline void update_texture_async(
+    gl_texture& txt, gl_texture_stream& stream, const image4f& img) {
+    update_texture_async(txt, stream, img.width(), img.height(), 4,
+        (const float*)img.data(), 0, img.height());
+}
+
+/// Updates the whole texture through the stream's pixel buffers.
+inline void update_texture_async(
+    gl_texture& txt, gl_texture_stream& stream, const image4b& img) {
+    update_texture_async(txt, stream, img.width(), img.height(), 4,
+        (const unsigned char*)img.data(), 0, img.height());
+}
+
+/// Destroys the stream's buffers and fences.
+void clear_texture_stream(gl_texture_stream& stream);
+
 /// Wrap values for texture
 enum struct gl_texture_wrap {
     /// not set
@@ -10561,6 +13126,14 @@ inline gl_vertex_buffer make_vertex_buffer(
         values.size(), 4, (const float*)values.data(), dynamic);
 }
 
+/// Creates a buffer of packed mat4 columns (four vec4 per matrix), as
+/// used for per-instance transforms.
+inline gl_vertex_buffer make_vertex_buffer(
+    const vector<mat4f>& values, bool dynamic = false) {
+    return make_vertex_buffer(
+        values.size() * 4, 4, (const float*)values.data(), dynamic);
+}
+
 /// Creates a buffer.
 inline gl_vertex_buffer make_vertex_buffer(
     const vector<int>& values, bool dynamic = false) {
@@ -10623,6 +13196,13 @@ inline void update_vertex_buffer(
     update_vertex_buffer(buf, values.size(), 4, (const float*)values.data());
 }
 
+/// Updates a buffer of packed mat4 columns (four vec4 per matrix).
+inline void update_vertex_buffer(
+    gl_vertex_buffer& buf, const vector<mat4f>& values) {
+    update_vertex_buffer(
+        buf, values.size() * 4, 4, (const float*)values.data());
+}
+
 /// Updates the buffer bid with new data.
 inline void update_vertex_buffer(
     gl_vertex_buffer& buf, const vector<int>& values) {
@@ -10761,6 +13341,10 @@ inline void update_element_buffer(
 /// Draws elements.
 void draw_elems(const gl_element_buffer& buf);
 
+/// Draws elements with hardware instancing. The per-instance data comes
+/// from attributes bound with set_program_vertattr_instanced().
+void draw_elems_instanced(const gl_element_buffer& buf, int ninstances);
+
 /// Get id
 inline uint get_element_buffer_id(const gl_element_buffer& buf) {
     return buf._bid;
@@ -10993,6 +13577,13 @@ bool set_program_vertattr(gl_program& prog, int pos, const int* value, int nc);
 bool set_program_vertattr(
     gl_program& prog, const string& var, const gl_vertex_buffer& buf);
 
+/// Sets a per-instance mat4 vertex attribute from a buffer of packed
+/// matrix columns (four vec4 per instance), advanced once per instance
+/// via attribute divisors. Pass an invalid buffer to disable the
+/// attribute and reset the divisors for later non-instanced draws.
+bool set_program_vertattr_instanced(
+    gl_program& prog, const string& var, const gl_vertex_buffer& buf);
+
 /// Sets a vartex attribute for program pid and variable var. The attribute
 /// has nc components and either buffer bid or a single value def
 /// (if bid is zero). Convenience wrapper to above functions.
@@ -11218,6 +13809,33 @@ inline void end_stdsurface_shape(gl_stdsurface_program& prog) {
     assert(gl_check_error());
 }
 
+/// Enables hardware-instanced drawing with per-instance transforms
+/// taken from a buffer of packed mat4 columns (four vec4 per instance).
+/// Instanced draws, issued with draw_elems_instanced(), ignore the
+/// transform set by begin_stdsurface_shape(). One submission per shape
+/// replaces one per instance, which is what keeps large instanced
+/// scenes interactive.
+inline void set_stdsurface_instances(
+    gl_stdsurface_program& prog, const gl_vertex_buffer& xforms) {
+    static auto instanced_id =
+        get_program_uniform_location(prog._prog, "shape_instanced");
+    assert(gl_check_error());
+    set_program_uniform(prog._prog, instanced_id, true);
+    set_program_vertattr_instanced(prog._prog, "vert_ist_xform", xforms);
+    assert(gl_check_error());
+}
+
+/// Disables hardware-instanced drawing and resets the attribute
+/// divisors for later non-instanced draws.
+inline void set_stdsurface_instances_off(gl_stdsurface_program& prog) {
+    static auto instanced_id =
+        get_program_uniform_location(prog._prog, "shape_instanced");
+    assert(gl_check_error());
+    set_program_uniform(prog._prog, instanced_id, false);
+    set_program_vertattr_instanced(prog._prog, "vert_ist_xform", {});
+    assert(gl_check_error());
+}
+
 /// Set the object as highlighted.
 inline void set_stdsurface_highlight(
     gl_stdsurface_program& prog, const vec4f& highlight) {